@@ -0,0 +1,245 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "appsearch.h"
+#include "associationsnapshot.h"
+#include "mimeapps.h"
+#include "xdgtree.h"
+
+using namespace mimeapps;
+
+// Benchmarks taking XDG tree are parameterized by (number of MIME types, number of desktop files, number of XDG dirs).
+static void treeArguments(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({"types", "desktops", "dirs"});
+    bench->Args({100, 50, 2});
+    bench->Args({1000, 500, 4});
+    bench->Args({5000, 2000, 8});
+}
+
+static void BM_listAssociatedApplications(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        std::vector<std::string> desktopIds;
+        listAssociatedApplications(mimeType, std::back_inserter(desktopIds));
+        benchmark::DoNotOptimize(desktopIds.data());
+    }
+}
+BENCHMARK(BM_listAssociatedApplications)->Apply(treeArguments);
+
+static void BM_listAssociatedApplications_baseDirs(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    BaseDirs baseDirs;
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        std::vector<std::string> desktopIds;
+        listAssociatedApplications(baseDirs, mimeType, std::back_inserter(desktopIds));
+        benchmark::DoNotOptimize(desktopIds.data());
+    }
+}
+BENCHMARK(BM_listAssociatedApplications_baseDirs)->Apply(treeArguments);
+
+static void BM_listAssociatedApplications_index(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        std::vector<std::string> desktopIds;
+        listAssociatedApplications(index, hierarchy, mimeType, std::back_inserter(desktopIds));
+        benchmark::DoNotOptimize(desktopIds.data());
+    }
+}
+BENCHMARK(BM_listAssociatedApplications_index)->Apply(treeArguments);
+
+static void BM_findDefaultApplication(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        DesktopFile file = findDefaultApplication(mimeType);
+        benchmark::DoNotOptimize(file.isValid());
+    }
+}
+BENCHMARK(BM_findDefaultApplication)->Apply(treeArguments);
+
+static void BM_findDefaultApplication_index(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        DesktopFile file = findDefaultApplication(index, hierarchy, mimeType);
+        benchmark::DoNotOptimize(file.isValid());
+    }
+}
+BENCHMARK(BM_findDefaultApplication_index)->Apply(treeArguments);
+
+static void BM_findDefaultApplication_snapshot(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    const std::string path = tree.root + "/mimeapps.snapshot";
+    AssociationSnapshotPublisher publisher(path);
+    publisher.publish();
+    AssociationSnapshot snapshot(path);
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        SnapshotApplication application;
+        benchmark::DoNotOptimize(snapshot.findDefaultApplication(mimeType, application));
+        benchmark::DoNotOptimize(application.fileName.data());
+    }
+}
+BENCHMARK(BM_findDefaultApplication_snapshot)->Apply(treeArguments);
+
+static void BM_findAssociatedApplications_cache(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    DesktopFileCache cache;
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount / 2);
+    for (auto _ : state) {
+        std::vector<DesktopFile> files;
+        findAssociatedApplications(index, hierarchy, mimeType, std::back_inserter(files), &cache);
+        benchmark::DoNotOptimize(files.data());
+    }
+}
+BENCHMARK(BM_findAssociatedApplications_cache)->Apply(treeArguments);
+
+static void BM_findDesktopFile(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), state.range(1), state.range(2));
+    std::vector<std::string> applicationsPaths;
+    getApplicationsPaths(std::back_inserter(applicationsPaths));
+    // Desktop file from the last directory is the worst case.
+    const std::string desktopId = tree.desktopId(tree.dirCount - 1);
+    for (auto _ : state) {
+        std::string path = findDesktopFile(applicationsPaths.begin(), applicationsPaths.end(), desktopId);
+        benchmark::DoNotOptimize(path.data());
+    }
+}
+BENCHMARK(BM_findDesktopFile)->Apply(treeArguments);
+
+static void BM_searchApplications(benchmark::State& state)
+{
+    XdgTree tree(1, state.range(0), 1);
+    ApplicationSearchIndex index;
+    index.load();
+    const char* const queries[] = {"b", "be", "bench 1", "number 42", "synthetic"};
+    std::size_t i = 0;
+    for (auto _ : state) {
+        std::vector<ApplicationMatch> matches;
+        index.search(queries[i++ % 5], std::back_inserter(matches), 10);
+        benchmark::DoNotOptimize(matches.data());
+    }
+}
+BENCHMARK(BM_searchApplications)->ArgName("desktops")->Arg(500)->Arg(5000);
+
+static void BM_searchKeyValues(benchmark::State& state)
+{
+    XdgTree tree(state.range(0), 50, 1);
+    const std::string contents = tree.mimeInfoCache(0);
+    const std::string mimeType = tree.mimeType(tree.mimeTypeCount - 1);
+    for (auto _ : state) {
+        std::istringstream stream(contents);
+        SearchRequest request;
+        request.addRequest("MIME Cache", mimeType);
+        request.searchKeyValues(stream);
+        benchmark::DoNotOptimize(request.getValue("MIME Cache", mimeType).found());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * contents.size());
+}
+BENCHMARK(BM_searchKeyValues)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Large value with escape sequence every state.range(0) characters.
+static void BM_unescapeValue(benchmark::State& state)
+{
+    std::string value;
+    const char* const escapes[] = {"\\s", "\\n", "\\t", "\\\\", "\\x"};
+    for (std::size_t i=0; value.size() < 64 * 1024; ++i) {
+        value.append(static_cast<std::size_t>(state.range(0)), static_cast<char>('a' + i % 26));
+        value += escapes[i % 5];
+    }
+    for (auto _ : state) {
+        const std::string unescaped = unescapeValue(value);
+        benchmark::DoNotOptimize(unescaped.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * value.size());
+}
+BENCHMARK(BM_unescapeValue)->ArgName("run")->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_isValidDesktopFileKey(benchmark::State& state)
+{
+    std::vector<std::string> keys;
+    for (int i=0; i<1024; ++i) {
+        std::string key = "X-Vendor-Key" + std::to_string(i) + "-Name";
+        if (i % 7 == 0) {
+            key += "[de_DE]";
+        } else if (i % 13 == 0) {
+            key += "_invalid";
+        }
+        keys.push_back(key);
+    }
+    std::size_t bytes = 0;
+    for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+        bytes += it->size();
+    }
+    for (auto _ : state) {
+        std::size_t valid = 0;
+        for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+            valid += isValidDesktopFileKey(*it);
+        }
+        benchmark::DoNotOptimize(valid);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * bytes);
+}
+BENCHMARK(BM_isValidDesktopFileKey);
+
+static void BM_unquoteExec(benchmark::State& state)
+{
+    const std::string exec = state.range(0)
+        ? "\"/opt/Some App/bin/app\" --name \"quoted \\\\\\\"value\\\\\\\"\" 'single quoted' escaped\\ space %F"
+        : "/usr/bin/app --new-window %U";
+    for (auto _ : state) {
+        std::vector<std::string> args;
+        unquoteExec(exec, std::back_inserter(args));
+        benchmark::DoNotOptimize(args.data());
+    }
+}
+BENCHMARK(BM_unquoteExec)->ArgName("quoted")->Arg(0)->Arg(1);
+
+static void BM_unquoteExec_long(benchmark::State& state)
+{
+    std::string exec = "/usr/bin/app";
+    for (int i=0; i<256; ++i) {
+        exec += (i % 4 == 0) ? " \"quoted argument number " + std::to_string(i) + "\"" : " --option-" + std::to_string(i) + "=value\\ with\\ spaces";
+    }
+    for (auto _ : state) {
+        std::vector<std::string> args;
+        unquoteExec(exec, std::back_inserter(args));
+        benchmark::DoNotOptimize(args.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * exec.size());
+}
+BENCHMARK(BM_unquoteExec_long);
+
+BENCHMARK_MAIN();
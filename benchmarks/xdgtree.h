@@ -0,0 +1,145 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Generator of synthetic XDG directory trees for benchmarks.
+ */
+
+#ifndef MIMEAPPS_BENCHMARKS_XDGTREE_H
+#define MIMEAPPS_BENCHMARKS_XDGTREE_H
+
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "path.h"
+#include "../unittests/tempxdg.h"
+
+/**
+ * \brief Temporary XDG tree with MIME types, desktop files and association files spread over several base directories.
+ *
+ * The first directory plays role of XDG_DATA_HOME and XDG_CONFIG_HOME, the rest are XDG_DATA_DIRS and XDG_CONFIG_DIRS.
+ * Desktop files are distributed over data directories round-robin.
+ * Every MIME type is associated with three desktop files in mimeinfo.cache of each data directory
+ * and gets a default application in mimeapps.list of each config directory.
+ * Each type "application/x-bench-N" is a subclass of "application/x-bench-base", which has associations of its own.
+ * Environment is changed to point to the tree and restored on destruction.
+ */
+struct XdgTree : TempXdgDir
+{
+    XdgTree(std::size_t mimeTypeCount, std::size_t desktopFileCount, std::size_t dirCount)
+        : TempXdgDir("mimeapps-bench"), mimeTypeCount(mimeTypeCount), desktopFileCount(desktopFileCount), dirCount(dirCount)
+    {
+        if (mimeTypeCount == 0 || desktopFileCount == 0 || dirCount == 0) {
+            throw std::invalid_argument("XdgTree needs at least one MIME type, desktop file and directory");
+        }
+
+        std::string dataDirs, configDirs;
+        for (std::size_t d=0; d<dirCount; ++d) {
+            const std::string data = dataDir(d);
+            const std::string config = configDir(d);
+            if (d != 0) {
+                dataDirs += (dataDirs.empty() ? "" : ":") + data;
+                configDirs += (configDirs.empty() ? "" : ":") + config;
+            }
+            createFile(mimeapps::buildPath(data, "applications/mimeinfo.cache"), mimeInfoCache(d));
+            createFile(mimeapps::buildPath(config, "mimeapps.list"), mimeAppsList(d));
+        }
+        for (std::size_t i=0; i<desktopFileCount; ++i) {
+            createFile(mimeapps::buildPath(dataDir(i % dirCount), "applications/" + desktopId(i)), desktopFile(i));
+        }
+        createFile(mimeapps::buildPath(dataDir(0), "mime/subclasses"), subclasses());
+
+        setVariable("XDG_DATA_HOME", dataDir(0));
+        setVariable("XDG_CONFIG_HOME", configDir(0));
+        setVariable("XDG_DATA_DIRS", dataDirs.empty() ? root + "/none" : dataDirs);
+        setVariable("XDG_CONFIG_DIRS", configDirs.empty() ? root + "/none" : configDirs);
+    }
+
+    std::string mimeType(std::size_t i) const {
+        std::ostringstream stream;
+        stream << "application/x-bench-" << i;
+        return stream.str();
+    }
+
+    std::string desktopId(std::size_t i) const {
+        std::ostringstream stream;
+        stream << "bench-app-" << i << ".desktop";
+        return stream.str();
+    }
+
+    std::string dataDir(std::size_t d) const {
+        std::ostringstream stream;
+        stream << root << "/data" << d;
+        return stream.str();
+    }
+
+    std::string configDir(std::size_t d) const {
+        std::ostringstream stream;
+        stream << root << "/config" << d;
+        return stream.str();
+    }
+
+    /// Contents of mimeinfo.cache of data directory d.
+    std::string mimeInfoCache(std::size_t d) const {
+        std::ostringstream stream;
+        stream << "[MIME Cache]\n";
+        stream << "application/x-bench-base=" << desktopId(d % desktopFileCount) << ";\n";
+        for (std::size_t i=0; i<mimeTypeCount; ++i) {
+            stream << mimeType(i) << '=';
+            for (std::size_t k=0; k<3; ++k) {
+                stream << desktopId((i * 3 + k + d) % desktopFileCount) << ';';
+            }
+            stream << '\n';
+        }
+        return stream.str();
+    }
+
+    /// Contents of mimeapps.list of config directory d.
+    std::string mimeAppsList(std::size_t d) const {
+        std::ostringstream stream;
+        stream << "[Default Applications]\n";
+        for (std::size_t i=0; i<mimeTypeCount; ++i) {
+            stream << mimeType(i) << '=' << desktopId((i + d) % desktopFileCount) << '\n';
+        }
+        stream << "[Removed Associations]\n";
+        for (std::size_t i=0; i<mimeTypeCount; i+=7) {
+            stream << mimeType(i) << '=' << desktopId((i * 3 + 1) % desktopFileCount) << ";\n";
+        }
+        return stream.str();
+    }
+
+    std::string desktopFile(std::size_t i) const {
+        std::ostringstream stream;
+        stream << "[Desktop Entry]\n"
+               << "Type=Application\n"
+               << "Name=Bench " << i << "\n"
+               << "Comment=Synthetic application number " << i << "\n"
+               << "Exec=/bin/sh %f\n"
+               << "Icon=bench\n"
+               << "Terminal=false\n"
+               << "\n[Desktop Action Other]\nName=Other\nExec=/bin/sh\n";
+        return stream.str();
+    }
+
+    std::string subclasses() const {
+        std::ostringstream stream;
+        for (std::size_t i=0; i<mimeTypeCount; ++i) {
+            stream << mimeType(i) << " application/x-bench-base\n";
+        }
+        return stream.str();
+    }
+
+    const std::size_t mimeTypeCount;
+    const std::size_t desktopFileCount;
+    const std::size_t dirCount;
+
+private:
+    XdgTree(const XdgTree&);
+    XdgTree& operator=(const XdgTree&);
+};
+
+#endif
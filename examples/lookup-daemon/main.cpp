@@ -0,0 +1,37 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <iostream>
+#include <csignal>
+#include <stdexcept>
+#include "lookupdaemon.h"
+
+using namespace mimeapps;
+
+static LookupServer* server = NULL;
+
+static void handleSignal(int)
+{
+    if (server) {
+        server->stop();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        LookupServer lookupServer(argc > 1 ? std::string(argv[1]) : lookupSocketPath());
+        server = &lookupServer;
+        std::signal(SIGINT, handleSignal);
+        std::signal(SIGTERM, handleSignal);
+        std::cout << "Listening on " << lookupServer.socketPath() << std::endl;
+        lookupServer.run();
+        server = NULL;
+        std::cout << lookupServer.requestCount() << " requests served" << std::endl;
+    } catch(std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
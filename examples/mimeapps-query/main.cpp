@@ -0,0 +1,166 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "associationindex.h"
+#include "classifier.h"
+#include "desktopfilecache.h"
+#include "mimeapps.h"
+#include "mimeglobs.h"
+#include "mimehierarchy.h"
+#include "mimemagic.h"
+#include "stats.h"
+
+using namespace mimeapps;
+
+static void writeJsonString(std::ostream& stream, const StringRef& str)
+{
+    stream << '"';
+    for (const char* it = str.begin(); it != str.end(); ++it) {
+        const unsigned char c = static_cast<unsigned char>(*it);
+        if (c == '"' || c == '\\') {
+            stream << '\\' << *it;
+        } else if (c == '\n') {
+            stream << "\\n";
+        } else if (c == '\t') {
+            stream << "\\t";
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            stream << escaped;
+        } else {
+            stream << *it;
+        }
+    }
+    stream << '"';
+}
+
+static void writeApplication(std::ostream& stream, const DesktopFile& file, const std::string* desktopId)
+{
+    stream << '{';
+    if (desktopId) {
+        stream << "\"id\":";
+        writeJsonString(stream, *desktopId);
+        stream << ',';
+    }
+    stream << "\"path\":";
+    writeJsonString(stream, file.fileName());
+    stream << ",\"name\":";
+    writeJsonString(stream, file.name());
+    stream << '}';
+}
+
+static unsigned long long percentile(const std::vector<unsigned long long>& sorted, unsigned int percent)
+{
+    return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * percent / 100];
+}
+
+int main(int argc, char** argv)
+{
+    bool paths = false;
+    bool printStats = false;
+    for (int i=1; i<argc; ++i) {
+        if (std::strcmp(argv[i], "--paths") == 0) {
+            paths = true;
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--paths] [--stats] < queries\n"
+                         "Read MIME types (or file paths with --paths) from standard input, one per line, and print JSON Lines.\n", argv[0]);
+            return 1;
+        }
+    }
+    if (printStats && !statsEnabled()) {
+        std::cerr << "Library is built without MIMEAPPS_STATS, only latency will be reported" << std::endl;
+    }
+
+    // Everything is loaded once, so queries measure lookups on warm data.
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    MimeGlobs globs;
+    MimeMagic magic;
+    if (paths) {
+        globs.load();
+        magic.load();
+    }
+    const Classifier classifier(globs, magic, index, hierarchy);
+    DesktopFileCache cache(1024);
+
+    std::vector<unsigned long long> latencies;
+    std::string query;
+    std::vector<DesktopFile> applications;
+    while(std::getline(std::cin, query)) {
+        if (query.empty()) {
+            continue;
+        }
+        resetStats();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        const std::string mimeType = paths ? classifier.mimeTypeForFile(query) : query;
+        std::string desktopId;
+        DesktopFile defaultApplication;
+        applications.clear();
+        if (!mimeType.empty()) {
+            defaultApplication = findDefaultApplication(index, hierarchy, mimeType, &desktopId, &cache);
+            findAssociatedApplications(index, hierarchy, mimeType, std::back_inserter(applications), &cache);
+        }
+
+        const unsigned long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        const Stats stats = getStats();
+        latencies.push_back(nanoseconds);
+
+        std::cout << "{\"query\":";
+        writeJsonString(std::cout, query);
+        std::cout << ",\"mime_type\":";
+        if (mimeType.empty()) {
+            std::cout << "null";
+        } else {
+            writeJsonString(std::cout, mimeType);
+        }
+        std::cout << ",\"default\":";
+        if (defaultApplication.isValid()) {
+            writeApplication(std::cout, defaultApplication, &desktopId);
+        } else {
+            std::cout << "null";
+        }
+        std::cout << ",\"applications\":[";
+        for (std::size_t i=0; i<applications.size(); ++i) {
+            if (i) {
+                std::cout << ',';
+            }
+            writeApplication(std::cout, applications[i], NULL);
+        }
+        std::cout << ']';
+        if (printStats) {
+            std::cout << ",\"stats\":{\"nanoseconds\":" << nanoseconds
+                      << ",\"files_opened\":" << stats.filesOpened << ",\"bytes_read\":" << stats.bytesRead
+                      << ",\"stat_calls\":" << stats.statCalls << ",\"access_calls\":" << stats.accessCalls
+                      << ",\"cache_hits\":" << stats.cacheHits << ",\"cache_misses\":" << stats.cacheMisses << '}';
+        }
+        std::cout << "}\n";
+    }
+    std::cout.flush();
+
+    if (printStats) {
+        unsigned long long total = 0;
+        for (std::vector<unsigned long long>::const_iterator it = latencies.begin(); it != latencies.end(); ++it) {
+            total += *it;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cerr << latencies.size() << " queries, total " << total / 1000 << " us, mean "
+                  << (latencies.empty() ? 0 : total / latencies.size() / 1000) << " us, p50 " << percentile(latencies, 50) / 1000
+                  << " us, p99 " << percentile(latencies, 99) / 1000 << " us, max " << (latencies.empty() ? 0 : latencies.back() / 1000) << " us" << std::endl;
+    }
+    return 0;
+}
@@ -7,13 +7,16 @@
 #include <vector>
 #include <cstdio>
 #include <cstddef>
+#include <sys/stat.h>
 #include "mimeapps.h"
+#include "mimeglobs.h"
+#include "mimemagic.h"
 
 using namespace mimeapps;
 
 int main(int argc, char** argv)
 {
-    std::string mimeTypeHint = "text/plain";
+    std::string mimeTypeHint;
     std::string filePath;
 
     if (argc < 2) {
@@ -24,6 +27,21 @@ int main(int argc, char** argv)
     }
     if (argc > 2) {
         mimeTypeHint = argv[2];
+    } else {
+        struct stat st;
+        if (::stat(filePath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            mimeTypeHint = "inode/directory";
+        } else {
+            MimeGlobs globs;
+            globs.load();
+            const char* detected = globs.mimeTypeForFileName(filePath);
+            if (!detected) {
+                MimeMagic magic;
+                magic.load();
+                detected = magic.mimeTypeForFile(filePath);
+            }
+            mimeTypeHint = detected ? detected : "text/plain";
+        }
     }
 
     DesktopFile defaultApp = findDefaultApplication(mimeTypeHint);
@@ -0,0 +1,40 @@
+#include "applicationloader.h"
+
+#include <QByteArray>
+
+#include "../../source/mimeapps.h"
+#include "../../source/desktopfile.h"
+
+using namespace mimeapps;
+
+ApplicationLoader::ApplicationLoader(const QString &mimeType, QObject *parent)
+    : QThread(parent), _mimeType(mimeType), _cancelled(false)
+{
+
+}
+
+QString ApplicationLoader::mimeType() const
+{
+    return _mimeType;
+}
+
+void ApplicationLoader::cancel()
+{
+    _cancelled = true;
+}
+
+void ApplicationLoader::run()
+{
+    QByteArray arr = _mimeType.toUtf8();
+    // Desktop files are read one by one while iterating, so the first application is reported without waiting for the rest.
+    AssociatedApplications applications(std::string(arr.begin(), arr.end()));
+    DesktopFile file;
+    while(!_cancelled && applications.next(file)) {
+        QString tooltip = QString::fromUtf8(file.comment().c_str());
+        if (tooltip.isEmpty()) {
+            tooltip = QString::fromUtf8(file.genericName().c_str());
+        }
+        emit applicationFound(QString::fromUtf8(file.name().c_str()), QString::fromUtf8(file.fileName().c_str()),
+                              QString::fromUtf8(file.icon().c_str()), tooltip);
+    }
+}
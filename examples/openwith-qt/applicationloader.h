@@ -0,0 +1,33 @@
+#ifndef APPLICATIONLOADER_H
+#define APPLICATIONLOADER_H
+
+#include <QThread>
+#include <QString>
+
+#include <atomic>
+
+// Lists applications associated with MIME type in worker thread, reporting each one as soon as it's parsed.
+class ApplicationLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit ApplicationLoader(const QString& mimeType, QObject *parent = 0);
+
+    QString mimeType() const;
+
+    // Stop after the current application. Safe to call from any thread.
+    void cancel();
+
+signals:
+    void applicationFound(QString name, QString fileName, QString icon, QString tooltip);
+
+protected:
+    void run();
+
+private:
+    QString _mimeType;
+    std::atomic<bool> _cancelled;
+};
+
+#endif // APPLICATIONLOADER_H
@@ -8,23 +8,62 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+CONFIG += c++11
+
 TARGET = openwith-qt
 TEMPLATE = app
 
 
 SOURCES += main.cpp\
+        applicationloader.cpp \
         widget.cpp \
+    ../../source/appsearch.cpp \
+    ../../source/arena.cpp \
+    ../../source/associationindex.cpp \
+    ../../source/associationsnapshot.cpp \
     ../../source/basedir.cpp \
+    ../../source/classifier.cpp \
     ../../source/desktopfile.cpp \
+    ../../source/desktopfilecache.cpp \
+    ../../source/icontheme.cpp \
     ../../source/inilike.cpp \
+    ../../source/lookupdaemon.cpp \
+    ../../source/mimeapps.cpp \
+    ../../source/mimeappslist.cpp \
+    ../../source/mimecache.cpp \
+    ../../source/mimeglobs.cpp \
+    ../../source/mimehierarchy.cpp \
+    ../../source/mimeinfocache.cpp \
+    ../../source/mimemagic.cpp \
     ../../source/path.cpp \
-    ../../source/system.cpp
+    ../../source/stats.cpp \
+    ../../source/system.cpp \
+    ../../source/trace.cpp
 
 HEADERS  += widget.h \
+        applicationloader.h \
+    ../../source/appsearch.h \
+    ../../source/arena.h \
+    ../../source/associationindex.h \
+    ../../source/associationsnapshot.h \
     ../../source/basedir.h \
+    ../../source/chartable.h \
+    ../../source/classifier.h \
     ../../source/desktopfile.h \
+    ../../source/desktopfilecache.h \
+    ../../source/icontheme.h \
     ../../source/inilike.h \
+    ../../source/lookupdaemon.h \
     ../../source/mimeapps.h \
+    ../../source/mimeappslist.h \
+    ../../source/mimecache.h \
+    ../../source/mimeglobs.h \
+    ../../source/mimehierarchy.h \
+    ../../source/mimeinfocache.h \
+    ../../source/mimemagic.h \
     ../../source/path.h \
     ../../source/splitter.h \
-    ../../source/system.h
+    ../../source/stats.h \
+    ../../source/stringref.h \
+    ../../source/system.h \
+    ../../source/trace.h
@@ -1,4 +1,5 @@
 #include "widget.h"
+#include "applicationloader.h"
 
 #include <QPushButton>
 #include <QLineEdit>
@@ -16,15 +17,12 @@
 #include <QByteArray>
 #include <QMessageBox>
 
-#include <vector>
-#include <iterator>
-#include "../../source/mimeapps.h"
 #include "../../source/desktopfile.h"
 
 using namespace mimeapps;
 
 Widget::Widget(QWidget *parent)
-    : QWidget(parent)
+    : QWidget(parent), _loader(0), _firstItemTime(-1)
 {
     _lastDirectory = QDir::homePath();
 
@@ -61,10 +59,12 @@ Widget::Widget(QWidget *parent)
     hbox->addWidget(_mimeTypeHint);
 
     _appList = new QListWidget;
+    _status = new QLabel;
 
     QVBoxLayout* vbox = new QVBoxLayout;
     vbox->addLayout(hbox);
     vbox->addWidget(_appList);
+    vbox->addWidget(_status);
 
     listApplications(_mimeTypeHint->currentText());
     connect(_mimeTypeHint, SIGNAL(activated(QString)), SLOT(listApplications(QString)));
@@ -75,7 +75,12 @@ Widget::Widget(QWidget *parent)
 
 Widget::~Widget()
 {
-
+    // Loaders are children of the widget and must not be destroyed while running.
+    QList<ApplicationLoader*> loaders = findChildren<ApplicationLoader*>();
+    for (int i=0; i<loaders.size(); ++i) {
+        loaders[i]->cancel();
+        loaders[i]->wait();
+    }
 }
 
 void Widget::fileDialog()
@@ -89,23 +94,52 @@ void Widget::fileDialog()
 
 void Widget::listApplications(QString mimeType)
 {
-    QByteArray arr = mimeType.toUtf8();
-    std::vector<DesktopFile> vec;
-    findAssociatedApplications(std::string(arr.begin(), arr.end()), std::back_inserter(vec));
+    // Results of previous request are not needed anymore. Its loader deletes itself once it stops.
+    if (_loader) {
+        disconnect(_loader, 0, this, 0);
+        _loader->cancel();
+    }
 
     _appList->clear();
-    for (size_t i=0; i<vec.size(); ++i) {
-        QString text = QString::fromUtf8(vec[i].name().c_str()) + " (" + QString::fromUtf8(vec[i].fileName().c_str()) + ")";
+    _status->setText("Loading applications for " + mimeType + "...");
+    _firstItemTime = -1;
+    _loadTimer.start();
+
+    _loader = new ApplicationLoader(mimeType, this);
+    connect(_loader, SIGNAL(applicationFound(QString,QString,QString,QString)), SLOT(addApplication(QString,QString,QString,QString)));
+    connect(_loader, SIGNAL(finished()), SLOT(loadingFinished()));
+    connect(_loader, SIGNAL(finished()), _loader, SLOT(deleteLater()));
+    _loader->start();
+}
 
-        QListWidgetItem* item = new QListWidgetItem(QIcon::fromTheme(QString::fromUtf8(vec[i].icon().c_str()), QIcon::fromTheme("application-x-desktop")), text);
-        QString tooltip = QString::fromUtf8(vec[i].comment().c_str());
-        if (tooltip.isEmpty()) {
-            tooltip = QString::fromUtf8(vec[i].genericName().c_str());
-        }
-        item->setToolTip(tooltip);
-        item->setData(Qt::UserRole, QString::fromUtf8(vec[i].fileName().c_str()));
-        _appList->addItem(item);
+void Widget::addApplication(QString name, QString fileName, QString icon, QString tooltip)
+{
+    // Signals already queued by cancelled loader may still arrive.
+    if (sender() != _loader) {
+        return;
+    }
+    if (_firstItemTime < 0) {
+        _firstItemTime = _loadTimer.elapsed();
+    }
+
+    QListWidgetItem* item = new QListWidgetItem(QIcon::fromTheme(icon, QIcon::fromTheme("application-x-desktop")), name + " (" + fileName + ")");
+    item->setToolTip(tooltip);
+    item->setData(Qt::UserRole, fileName);
+    _appList->addItem(item);
+}
+
+void Widget::loadingFinished()
+{
+    if (sender() != _loader) {
+        return;
+    }
+    QString status = QString("%1 applications for %2").arg(_appList->count()).arg(_loader->mimeType());
+    if (_firstItemTime >= 0) {
+        status += QString(", first after %1 ms").arg(_firstItemTime);
     }
+    status += QString(", all after %1 ms").arg(_loadTimer.elapsed());
+    _status->setText(status);
+    _loader = 0;
 }
 
 void Widget::spawnApplication(QListWidgetItem *item)
@@ -3,11 +3,14 @@
 
 #include <QWidget>
 #include <QString>
+#include <QElapsedTimer>
 
 class QLineEdit;
 class QComboBox;
+class QLabel;
 class QListWidget;
 class QListWidgetItem;
+class ApplicationLoader;
 
 class Widget : public QWidget
 {
@@ -22,11 +25,20 @@ public slots:
     void listApplications(QString mimeType);
     void spawnApplication(QListWidgetItem* item);
 
+private slots:
+    void addApplication(QString name, QString fileName, QString icon, QString tooltip);
+    void loadingFinished();
+
 private:
     QString _lastDirectory;
     QLineEdit* _urlInput;
     QComboBox* _mimeTypeHint;
     QListWidget* _appList;
+    QLabel* _status;
+
+    ApplicationLoader* _loader;
+    QElapsedTimer _loadTimer;
+    qint64 _firstItemTime;
 };
 
 #endif // WIDGET_H
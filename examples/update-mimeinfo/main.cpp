@@ -0,0 +1,46 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "mimeinfocache.h"
+
+using namespace mimeapps;
+
+int main(int argc, char** argv)
+{
+    bool incremental = false;
+    unsigned int threadCount = 0;
+    int i = 1;
+    for (; i<argc; ++i) {
+        if (std::strcmp(argv[i], "-i") == 0) {
+            incremental = true;
+        } else if (std::strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            threadCount = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else {
+            break;
+        }
+    }
+
+    if (i >= argc) {
+        std::fprintf(stderr, "Usage: %s [-i] [-j threads] <applications directory>...\n", argv[0]);
+        return 1;
+    }
+
+    int status = 0;
+    for (; i<argc; ++i) {
+        try {
+            MimeInfoCacheStats stats = generateMimeInfoCache(argv[i], incremental, threadCount);
+            std::cout << argv[i] << ": " << stats.desktopFiles << " desktop files, " << stats.parsed << " parsed, "
+                      << stats.mimeTypes << " MIME types, " << stats.threads << " threads\n";
+        } catch(std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
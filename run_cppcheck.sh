@@ -1,2 +1,2 @@
 #!/bin/sh
-cppcheck --std=c++03 --std=posix --enable=warning --enable=portability --language=c++ -I source --force --quiet source
+cppcheck --std=c++11 --std=posix --enable=warning --enable=portability --language=c++ -I source --force --quiet source
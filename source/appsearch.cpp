@@ -0,0 +1,323 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <cstdlib>
+#include <iterator>
+
+#include "appsearch.h"
+#include "mimeapps.h"
+#include "mimeinfocache.h"
+#include "system.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        char toLower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        }
+
+        /// Non-ASCII bytes are considered parts of words, so UTF-8 words are not split.
+        bool isWordChar(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (static_cast<unsigned char>(c) & 0x80);
+        }
+
+        bool isWordStart(const std::string& text, std::size_t pos)
+        {
+            return isWordChar(text[pos]) && (pos == 0 || !isWordChar(text[pos-1]));
+        }
+
+        /// Key of trigram or word prefix of 1 or 2 characters. Length is stored in the highest byte, so keys don't collide.
+        std::uint32_t makeKey(const char* chars, std::size_t length)
+        {
+            std::uint32_t key = static_cast<std::uint32_t>(length);
+            for (std::size_t i=0; i<length; ++i) {
+                key = (key << 8) | static_cast<unsigned char>(chars[i]);
+            }
+            return key;
+        }
+
+        void appendLower(std::string& text, const StringRef& value)
+        {
+            for (const char* it = value.begin(); it != value.end(); ++it) {
+                text += (*it == '\n') ? ' ' : toLower(*it);
+            }
+        }
+
+        void collectKeys(const std::string& text, std::vector<std::uint32_t>& keys)
+        {
+            for (std::size_t i=0; i<text.size(); ++i) {
+                if (i + 3 <= text.size() && text.find('\n', i) >= i + 3) {
+                    keys.push_back(makeKey(text.data() + i, 3));
+                }
+                if (isWordStart(text, i)) {
+                    keys.push_back(makeKey(text.data() + i, 1));
+                    if (i + 1 < text.size() && text[i+1] != '\n') {
+                        keys.push_back(makeKey(text.data() + i, 2));
+                    }
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        }
+
+        bool isSearchable(const DesktopFile& file, const StringRef& desktops)
+        {
+            if (file.type() != DesktopFile::Application || file.hidden() || file.noDisplay() || !file.isShownIn(desktops)) {
+                return false;
+            }
+            const StringRef tryExec = file.tryExecValue();
+            return tryExec.empty() || !ExecutableCache::global().find(tryExec.str()).empty();
+        }
+
+        bool shorterPosting(const std::vector<std::uint32_t>* a, const std::vector<std::uint32_t>* b)
+        {
+            return a->size() < b->size();
+        }
+
+        /// Matched entry. Matches are built only for candidates that make it to results.
+        struct Candidate
+        {
+            int rank;
+            std::uint32_t slot;
+            const std::string* text;
+            std::size_t nameLength;
+            const std::string* desktopId;
+        };
+
+        bool betterCandidate(const Candidate& a, const Candidate& b)
+        {
+            if (a.rank != b.rank) {
+                return a.rank > b.rank;
+            }
+            const int nameOrder = a.text->compare(0, a.nameLength, *b.text, 0, b.nameLength);
+            if (nameOrder != 0) {
+                return nameOrder < 0;
+            }
+            return *a.desktopId < *b.desktopId;
+        }
+    }
+
+    ApplicationSearchIndex::ApplicationSearchIndex() : _size(0)
+    {
+    }
+
+    void ApplicationSearchIndex::load()
+    {
+        std::vector<std::string> applicationsPaths;
+        getApplicationsPaths(std::back_inserter(applicationsPaths));
+        load(applicationsPaths);
+    }
+
+    void ApplicationSearchIndex::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> applicationsPaths;
+        getApplicationsPaths(baseDirs, std::back_inserter(applicationsPaths));
+        load(applicationsPaths);
+    }
+
+    void ApplicationSearchIndex::load(const std::vector<std::string>& applicationsPaths)
+    {
+        _applicationsPaths = applicationsPaths;
+        _entries.clear();
+        _freeSlots.clear();
+        _slots.clear();
+        _postings.clear();
+        _size = 0;
+        update();
+    }
+
+    std::size_t ApplicationSearchIndex::update()
+    {
+        details::TraceSpan span("update_application_search_index");
+
+        // Desktop file in more important directory hides files with the same id in less important ones.
+        std::unordered_map<std::string, details::DesktopEntryFile> found;
+        std::vector<details::DesktopEntryFile> files;
+        for (std::vector<std::string>::const_iterator it = _applicationsPaths.begin(); it != _applicationsPaths.end(); ++it) {
+            try {
+                details::listDesktopEntryFiles(*it, files);
+            } catch(std::exception& e) {
+                continue;
+            }
+            for (std::vector<details::DesktopEntryFile>::const_iterator fileIt = files.begin(); fileIt != files.end(); ++fileIt) {
+                found.insert(std::make_pair(fileIt->desktopId, *fileIt));
+            }
+        }
+
+        std::size_t changed = 0;
+        for (std::uint32_t slot = 0; slot < _entries.size(); ++slot) {
+            if (!_entries[slot].desktopId.empty() && found.find(_entries[slot].desktopId) == found.end()) {
+                removeEntry(slot);
+                ++changed;
+            }
+        }
+
+        const char* desktops = std::getenv("XDG_CURRENT_DESKTOP");
+        for (std::unordered_map<std::string, details::DesktopEntryFile>::const_iterator it = found.begin(); it != found.end(); ++it) {
+            std::uint32_t slot;
+            std::unordered_map<std::string, std::uint32_t>::const_iterator existing = _slots.find(it->first);
+            if (existing != _slots.end()) {
+                slot = existing->second;
+                if (_entries[slot].path == it->second.path && _entries[slot].changeTime == it->second.changeTime) {
+                    continue;
+                }
+                unindexEntry(slot);
+            } else if (!_freeSlots.empty()) {
+                slot = _freeSlots.back();
+                _freeSlots.pop_back();
+                _slots[it->first] = slot;
+            } else {
+                slot = static_cast<std::uint32_t>(_entries.size());
+                _entries.push_back(Entry());
+                _slots[it->first] = slot;
+            }
+
+            Entry& entry = _entries[slot];
+            entry.desktopId = it->first;
+            entry.path = it->second.path;
+            entry.changeTime = it->second.changeTime;
+            entry.file = DesktopFile(entry.path);
+            entry.text.clear();
+            entry.nameLength = 0;
+            if (isSearchable(entry.file, desktops ? StringRef(desktops) : StringRef())) {
+                appendLower(entry.text, entry.file.name());
+                entry.nameLength = entry.text.size();
+                entry.text += '\n';
+                appendLower(entry.text, entry.file.genericName());
+                entry.text += '\n';
+                appendLower(entry.text, entry.file.comment());
+                entry.text += '\n';
+                appendLower(entry.text, entry.file.keywordsValue());
+                indexEntry(slot);
+            }
+            ++changed;
+        }
+
+        span.addAttribute("desktop_files", found.size());
+        span.addAttribute("changed", changed);
+        return changed;
+    }
+
+    std::size_t ApplicationSearchIndex::size() const
+    {
+        return _size;
+    }
+
+    void ApplicationSearchIndex::indexEntry(std::uint32_t slot)
+    {
+        std::vector<std::uint32_t> keys;
+        collectKeys(_entries[slot].text, keys);
+        for (std::vector<std::uint32_t>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+            std::vector<std::uint32_t>& posting = _postings[*it];
+            posting.insert(std::lower_bound(posting.begin(), posting.end(), slot), slot);
+        }
+        ++_size;
+    }
+
+    void ApplicationSearchIndex::unindexEntry(std::uint32_t slot)
+    {
+        if (_entries[slot].text.empty()) {
+            return;
+        }
+        std::vector<std::uint32_t> keys;
+        collectKeys(_entries[slot].text, keys);
+        for (std::vector<std::uint32_t>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+            std::unordered_map<std::uint32_t, std::vector<std::uint32_t> >::iterator found = _postings.find(*it);
+            std::vector<std::uint32_t>::iterator position = std::lower_bound(found->second.begin(), found->second.end(), slot);
+            found->second.erase(position);
+            if (found->second.empty()) {
+                _postings.erase(found);
+            }
+        }
+        _entries[slot].text.clear();
+        --_size;
+    }
+
+    void ApplicationSearchIndex::removeEntry(std::uint32_t slot)
+    {
+        unindexEntry(slot);
+        _slots.erase(_entries[slot].desktopId);
+        _entries[slot] = Entry();
+        _freeSlots.push_back(slot);
+    }
+
+    void ApplicationSearchIndex::findMatches(const std::string& query, std::size_t maxResults, std::vector<ApplicationMatch>& matches) const
+    {
+        matches.clear();
+        std::string lowered;
+        for (std::string::const_iterator it = query.begin(); it != query.end(); ++it) {
+            lowered += toLower(*it);
+        }
+        if (lowered.empty() || lowered.find('\n') != std::string::npos) {
+            return;
+        }
+
+        // Posting lists of all query keys, the shortest first.
+        std::vector<const std::vector<std::uint32_t>*> postings;
+        if (lowered.size() < 3) {
+            if (!isWordChar(lowered[0])) {
+                return;
+            }
+            std::unordered_map<std::uint32_t, std::vector<std::uint32_t> >::const_iterator found = _postings.find(makeKey(lowered.data(), lowered.size()));
+            if (found == _postings.end()) {
+                return;
+            }
+            postings.push_back(&found->second);
+        } else {
+            for (std::size_t i=0; i+3 <= lowered.size(); ++i) {
+                std::unordered_map<std::uint32_t, std::vector<std::uint32_t> >::const_iterator found = _postings.find(makeKey(lowered.data() + i, 3));
+                if (found == _postings.end()) {
+                    return;
+                }
+                postings.push_back(&found->second);
+            }
+            std::sort(postings.begin(), postings.end(), shorterPosting);
+        }
+
+        std::vector<Candidate> ranked;
+        const std::vector<std::uint32_t>& candidates = *postings[0];
+        for (std::vector<std::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+            bool inAll = true;
+            for (std::size_t p=1; p<postings.size() && inAll; ++p) {
+                inAll = std::binary_search(postings[p]->begin(), postings[p]->end(), *it);
+            }
+            if (!inAll) {
+                continue;
+            }
+
+            // Trigrams may come from different places of text, so check the actual occurrence.
+            const Entry& entry = _entries[*it];
+            int rank = 0;
+            for (std::size_t pos = entry.text.find(lowered); pos != std::string::npos && rank < WordPrefixMatch; pos = entry.text.find(lowered, pos + 1)) {
+                rank = std::max(rank, isWordStart(entry.text, pos) ? static_cast<int>(WordPrefixMatch) : static_cast<int>(SubstringMatch));
+            }
+            if (rank == 0) {
+                continue;
+            }
+            if (lowered.size() <= entry.nameLength && entry.text.compare(0, lowered.size(), lowered) == 0) {
+                rank = NamePrefixMatch;
+            }
+
+            const Candidate candidate = {rank, *it, &entry.text, entry.nameLength, &entry.desktopId};
+            ranked.push_back(candidate);
+        }
+
+        if (maxResults && maxResults < ranked.size()) {
+            std::partial_sort(ranked.begin(), ranked.begin() + maxResults, ranked.end(), betterCandidate);
+            ranked.resize(maxResults);
+        } else {
+            std::sort(ranked.begin(), ranked.end(), betterCandidate);
+        }
+        matches.resize(ranked.size());
+        for (std::size_t i=0; i<ranked.size(); ++i) {
+            const Entry& entry = _entries[ranked[i].slot];
+            matches[i].desktopId = entry.desktopId;
+            matches[i].file = entry.file;
+            matches[i].rank = static_cast<MatchRank>(ranked[i].rank);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Full-text search over installed applications.
+ */
+
+#ifndef MIMEAPPS_APPSEARCH_H
+#define MIMEAPPS_APPSEARCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "basedir.h"
+#include "desktopfile.h"
+
+namespace mimeapps
+{
+    /// How well application matches search query. Better matches have greater values.
+    enum MatchRank
+    {
+        /// Query occurs somewhere in Name, GenericName, Comment or Keywords.
+        SubstringMatch = 1,
+        /// Some word of Name, GenericName, Comment or Keywords starts with query.
+        WordPrefixMatch,
+        /// Name starts with query.
+        NamePrefixMatch
+    };
+
+    /// Application found by ApplicationSearchIndex.
+    struct ApplicationMatch
+    {
+        std::string desktopId;
+        DesktopFile file;
+        MatchRank rank;
+    };
+
+    /**
+     * \brief In-memory search index over Name, GenericName, Comment and Keywords of installed applications.
+     *
+     * Queries of three or more characters are looked up by trigrams, shorter queries by prefixes of words,
+     * so search does not scan all applications. Matching is case-insensitive for ASCII letters.
+     * Only applications that should be shown in menus are indexed: hidden, NoDisplay entries,
+     * entries not shown in XDG_CURRENT_DESKTOP and entries with missing TryExec program are skipped.
+     * Index can be searched from several threads at once, but update() and load() require exclusive access.
+     */
+    struct ApplicationSearchIndex
+    {
+        ApplicationSearchIndex();
+
+        /// Index desktop files in applications directories from standard locations.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+        /// ditto, but take applications directories in order of precedence.
+        void load(const std::vector<std::string>& applicationsPaths);
+
+        /**
+         * \brief Rescan applications directories and reindex changed desktop files.
+         *
+         * Only new desktop files and files whose modification or status change time differs from indexed are parsed.
+         * \return number of added, changed and removed desktop files.
+         */
+        std::size_t update();
+
+        /// Number of indexed applications.
+        std::size_t size() const;
+
+        /**
+         * \brief Find applications matching query.
+         * Matches are ordered by rank, then by name and desktop id.
+         * \param maxResults if not 0, output at most maxResults best matches.
+         */
+        template<typename OutputIterator>
+        void search(const std::string& query, OutputIterator out, std::size_t maxResults = 0) const {
+            std::vector<ApplicationMatch> matches;
+            findMatches(query, maxResults, matches);
+            std::copy(matches.begin(), matches.end(), out);
+        }
+
+    private:
+        struct Entry
+        {
+            std::string desktopId;
+            std::string path;
+            long long changeTime;
+            DesktopFile file;
+            /// Lowercased Name, GenericName, Comment and Keywords separated by newlines. Empty if entry is not searchable.
+            std::string text;
+            std::size_t nameLength;
+        };
+
+        void findMatches(const std::string& query, std::size_t maxResults, std::vector<ApplicationMatch>& matches) const;
+        void indexEntry(std::uint32_t slot);
+        void unindexEntry(std::uint32_t slot);
+        void removeEntry(std::uint32_t slot);
+
+        std::vector<std::string> _applicationsPaths;
+        // Slots of removed entries have empty desktop id and are reused.
+        std::vector<Entry> _entries;
+        std::vector<std::uint32_t> _freeSlots;
+        std::unordered_map<std::string, std::uint32_t> _slots;
+        // Sorted slots of entries by trigram or word prefix.
+        std::unordered_map<std::uint32_t, std::vector<std::uint32_t> > _postings;
+        std::size_t _size;
+    };
+}
+
+#endif
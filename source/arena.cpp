@@ -0,0 +1,94 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <cstdint>
+
+#include "arena.h"
+
+namespace mimeapps
+{
+    static char* alignPointer(char* p, std::size_t alignment)
+    {
+        const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(p);
+        return p + ((alignment - value % alignment) % alignment);
+    }
+
+    Arena::Arena(std::size_t chunkSize) : _current(_initial), _end(_initial + InitialSize), _chunks(NULL),
+        _firstChunkSize(chunkSize ? chunkSize : InitialSize), _chunkSize(_firstChunkSize), _chunkCount(0), _allocated(0)
+    {
+    }
+
+    Arena::~Arena()
+    {
+        release();
+    }
+
+    void* Arena::allocate(std::size_t size, std::size_t alignment)
+    {
+        char* aligned = alignPointer(_current, alignment);
+        if (aligned <= _end && size <= static_cast<std::size_t>(_end - aligned)) {
+            _allocated += (aligned - _current) + size;
+            _current = aligned + size;
+            return aligned;
+        }
+        return allocateFromChunk(size, alignment);
+    }
+
+    void* Arena::allocateFromChunk(std::size_t size, std::size_t alignment)
+    {
+        std::size_t required = sizeof(Chunk) + alignment + size;
+        std::size_t chunkSize = _chunkSize;
+        while(chunkSize < required) {
+            chunkSize *= 2;
+        }
+        Chunk* chunk = static_cast<Chunk*>(::operator new(chunkSize));
+        chunk->previous = _chunks;
+        _chunks = chunk;
+        ++_chunkCount;
+        _chunkSize = chunkSize * 2;
+
+        _current = reinterpret_cast<char*>(chunk + 1);
+        _end = reinterpret_cast<char*>(chunk) + chunkSize;
+
+        char* aligned = alignPointer(_current, alignment);
+        _allocated += (aligned - _current) + size;
+        _current = aligned + size;
+        return aligned;
+    }
+
+    void Arena::release()
+    {
+        while(_chunks) {
+            Chunk* previous = _chunks->previous;
+            ::operator delete(_chunks);
+            _chunks = previous;
+        }
+        _current = _initial;
+        _end = _initial + InitialSize;
+        _chunkSize = _firstChunkSize;
+        _chunkCount = 0;
+        _allocated = 0;
+    }
+
+    std::size_t Arena::chunkCount() const
+    {
+        return _chunkCount;
+    }
+
+    std::size_t Arena::bytesAllocated() const
+    {
+        return _allocated;
+    }
+
+    std::size_t ArenaStringHash::operator()(const ArenaString& str) const
+    {
+        // FNV-1a
+        std::size_t hash = static_cast<std::size_t>(14695981039346656037ULL);
+        for (ArenaString::const_iterator it = str.begin(); it != str.end(); ++it) {
+            hash ^= static_cast<unsigned char>(*it);
+            hash *= static_cast<std::size_t>(1099511628211ULL);
+        }
+        return hash;
+    }
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Monotonic memory arena for temporary data of a single query.
+ */
+
+#ifndef MIMEAPPS_ARENA_H
+#define MIMEAPPS_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <scoped_allocator>
+#include <string>
+#include <vector>
+
+namespace mimeapps
+{
+    /**
+     * \brief Monotonic allocator that frees all memory at once.
+     *
+     * First allocations are served from buffer inside the object, so arena on stack does not touch heap
+     * for small queries. Next chunks are taken from heap and grow geometrically, so number of heap allocations
+     * is logarithmic in total size. Deallocation of separate blocks is no-op.
+     * Arena is not thread-safe.
+     */
+    struct Arena
+    {
+        /// Size of buffer inside the object.
+        static const std::size_t InitialSize = 1024;
+
+        /// \param chunkSize size of the first chunk allocated from heap.
+        explicit Arena(std::size_t chunkSize = 4096);
+        ~Arena();
+
+        /// Allocate size bytes aligned by alignment, which must be power of two.
+        void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+        /// Free all memory at once. All previously allocated blocks become invalid. Chunk growth starts over.
+        void release();
+
+        /// Number of chunks currently taken from heap.
+        std::size_t chunkCount() const;
+        /// Number of bytes allocated since construction or last release(), including alignment padding.
+        std::size_t bytesAllocated() const;
+
+    private:
+        Arena(const Arena&);
+        Arena& operator=(const Arena&);
+
+        struct Chunk
+        {
+            Chunk* previous;
+        };
+
+        void* allocateFromChunk(std::size_t size, std::size_t alignment);
+
+        alignas(std::max_align_t) char _initial[InitialSize];
+        char* _current;
+        char* _end;
+        Chunk* _chunks;
+        std::size_t _firstChunkSize;
+        std::size_t _chunkSize;
+        std::size_t _chunkCount;
+        std::size_t _allocated;
+    };
+
+    /**
+     * \brief Standard allocator taking memory from Arena.
+     *
+     * Default constructed allocator or allocator constructed from NULL uses global operator new and delete,
+     * so containers with ArenaAllocator can be used without arena too.
+     */
+    template<typename T>
+    struct ArenaAllocator
+    {
+        typedef T value_type;
+
+        ArenaAllocator() : _arena(NULL) {}
+        explicit ArenaAllocator(Arena* arena) : _arena(arena) {}
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+        T* allocate(std::size_t n) {
+            if (_arena) {
+                return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+            }
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        void deallocate(T* p, std::size_t) {
+            if (!_arena) {
+                ::operator delete(p);
+            }
+        }
+
+        Arena* arena() const {
+            return _arena;
+        }
+
+    private:
+        Arena* _arena;
+    };
+
+    template<typename T, typename U>
+    bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+        return a.arena() == b.arena();
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+        return a.arena() != b.arena();
+    }
+
+    typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+    /// Vector of strings that passes its arena to elements.
+    typedef std::vector<ArenaString, std::scoped_allocator_adaptor<ArenaAllocator<ArenaString> > > ArenaStringVector;
+
+    /// Hash function for unordered containers of ArenaString.
+    struct ArenaStringHash
+    {
+        std::size_t operator()(const ArenaString& str) const;
+    };
+}
+
+#endif
@@ -0,0 +1,141 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <algorithm>
+#include <iterator>
+
+#include "associationindex.h"
+#include "inilike.h"
+#include "mimeapps.h"
+#include "splitter.h"
+
+namespace mimeapps
+{
+    namespace {
+        template<typename Records>
+        struct MimeAppsListHandler
+        {
+            explicit MimeAppsListHandler(Records& records) : _records(records) {}
+
+            void operator()(const std::string& group, const std::string& key, const std::string& value) {
+                if (group == "Added Associations") {
+                    details::splitDesktopIds(value, _records[key].added);
+                } else if (group == "Removed Associations") {
+                    details::splitDesktopIds(value, _records[key].removed);
+                } else if (group == "Default Applications") {
+                    details::splitDesktopIds(value, _records[key].defaults);
+                }
+            }
+        private:
+            Records& _records;
+        };
+
+        template<typename Records>
+        struct MimeInfoCacheHandler
+        {
+            explicit MimeInfoCacheHandler(Records& records) : _records(records) {}
+
+            void operator()(const std::string& group, const std::string& key, const std::string& value) {
+                if (group == "MIME Cache") {
+                    details::splitDesktopIds(value, _records[key].added);
+                }
+            }
+        private:
+            Records& _records;
+        };
+    }
+
+    AssociationIndex::Record::Record() : source(0) {}
+
+    AssociationIndex::AssociationIndex() : _sourceCount(0) {}
+
+    void AssociationIndex::load()
+    {
+        std::vector<std::string> mimeAppsListPaths, mimeInfoCachePaths;
+        getMimeAppsListPaths(std::back_inserter(mimeAppsListPaths));
+        getMimeInfoCachePaths(std::back_inserter(mimeInfoCachePaths));
+        load(mimeAppsListPaths.begin(), mimeAppsListPaths.end(), mimeInfoCachePaths.begin(), mimeInfoCachePaths.end());
+    }
+
+    void AssociationIndex::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> mimeAppsListPaths, mimeInfoCachePaths;
+        getMimeAppsListPaths(baseDirs, std::back_inserter(mimeAppsListPaths));
+        getMimeInfoCachePaths(baseDirs, std::back_inserter(mimeInfoCachePaths));
+        load(mimeAppsListPaths.begin(), mimeAppsListPaths.end(), mimeInfoCachePaths.begin(), mimeInfoCachePaths.end());
+    }
+
+    void AssociationIndex::addMimeAppsList(std::istream& stream, const std::string& path)
+    {
+        SourceRecords records;
+        readKeyValues(stream, MimeAppsListHandler<SourceRecords>(records));
+        addSource(records, path);
+    }
+
+    void AssociationIndex::addMimeInfoCache(std::istream& stream)
+    {
+        SourceRecords records;
+        readKeyValues(stream, MimeInfoCacheHandler<SourceRecords>(records));
+        addSource(records);
+    }
+
+    void AssociationIndex::addSource(const SourceRecords& records, const std::string& path)
+    {
+        for (SourceRecords::const_iterator it = records.begin(); it != records.end(); ++it) {
+            std::vector<Record>& mimeRecords = _entries[it->first];
+            mimeRecords.push_back(it->second);
+            mimeRecords.back().source = _sourceCount;
+        }
+        _sourcePaths.push_back(path);
+        ++_sourceCount;
+    }
+
+    bool AssociationIndex::updateMimeAppsList(const std::string& path, const std::string& mimeType, const std::vector<std::string>& added,
+                                              const std::vector<std::string>& removed, const std::vector<std::string>& defaults)
+    {
+        if (path.empty()) {
+            return false;
+        }
+        std::vector<std::string>::const_iterator pathIt = std::find(_sourcePaths.begin(), _sourcePaths.end(), path);
+        if (pathIt == _sourcePaths.end()) {
+            return false;
+        }
+        const unsigned int source = static_cast<unsigned int>(pathIt - _sourcePaths.begin());
+
+        std::vector<Record>& mimeRecords = _entries[mimeType];
+        std::vector<Record>::iterator it = mimeRecords.begin();
+        while(it != mimeRecords.end() && it->source < source) {
+            ++it;
+        }
+        if (added.empty() && removed.empty() && defaults.empty()) {
+            if (it != mimeRecords.end() && it->source == source) {
+                mimeRecords.erase(it);
+            }
+            if (mimeRecords.empty()) {
+                _entries.erase(mimeType);
+            }
+            return true;
+        }
+        if (it == mimeRecords.end() || it->source != source) {
+            it = mimeRecords.insert(it, Record());
+            it->source = source;
+        }
+        it->added = added;
+        it->removed = removed;
+        it->defaults = defaults;
+        return true;
+    }
+
+    void AssociationIndex::clear()
+    {
+        _entries.clear();
+        _sourceCount = 0;
+        _sourcePaths.clear();
+    }
+
+    bool AssociationIndex::contains(const std::string& mimeType) const
+    {
+        return _entries.find(mimeType) != _entries.end();
+    }
+}
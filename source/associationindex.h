@@ -0,0 +1,236 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief In-memory index of mimeapps.list and mimeinfo.cache associations.
+ */
+
+#ifndef MIMEAPPS_ASSOCIATIONINDEX_H
+#define MIMEAPPS_ASSOCIATIONINDEX_H
+
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "arena.h"
+#include "basedir.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace details {
+        /**
+         * \brief Merges desktop ids in precedence order.
+         *
+         * Duplicates and removed associations are rejected with a hash lookup,
+         * so merging n candidates costs O(n) instead of O(n^2).
+         */
+        struct AssociationMerger
+        {
+            /// \param arena if not NULL, merged desktop ids are allocated from it. It must outlive the merger.
+            explicit AssociationMerger(Arena* arena = NULL) : _removed(BucketCount, ArenaStringHash(), std::equal_to<ArenaString>(), Allocator(arena)),
+                _seen(BucketCount, ArenaStringHash(), std::equal_to<ArenaString>(), Allocator(arena)), _key(ArenaAllocator<char>(arena)) {}
+
+            /// Mark desktop id as removed. It will be rejected by all subsequent add() calls.
+            void remove(const std::string& desktopId) {
+                _key.assign(desktopId.data(), desktopId.size());
+                _removed.insert(_key);
+            }
+            /// Returns true if desktop id was not seen or removed before.
+            bool add(const std::string& desktopId) {
+                if (desktopId.empty()) {
+                    return false;
+                }
+                _key.assign(desktopId.data(), desktopId.size());
+                if (_removed.find(_key) != _removed.end()) {
+                    return false;
+                }
+                return _seen.insert(_key).second;
+            }
+        private:
+            static const std::size_t BucketCount = 16;
+            typedef ArenaAllocator<ArenaString> Allocator;
+            typedef std::unordered_set<ArenaString, ArenaStringHash, std::equal_to<ArenaString>, Allocator> Set;
+            Set _removed;
+            Set _seen;
+            ArenaString _key;
+        };
+    }
+
+    /**
+     * \brief Associations of all MIME types read from mimeapps.list and mimeinfo.cache files at once.
+     *
+     * Files are parsed only on load, so each lookup is a single hash probe.
+     * Sources must be added in order of precedence, all mimeapps.list files before mimeinfo.cache files.
+     */
+    struct AssociationIndex
+    {
+        AssociationIndex();
+
+        /// Load mimeapps.list and mimeinfo.cache files from standard locations.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+
+        /**
+         * \brief Load given mimeapps.list and mimeinfo.cache files.
+         * Files that don't exist or can't be parsed are skipped.
+         */
+        template<typename Iterator>
+        void load(Iterator mimeAppsListFirst, Iterator mimeAppsListLast, Iterator mimeInfoCacheFirst, Iterator mimeInfoCacheLast)
+        {
+            for (Iterator it = mimeAppsListFirst; it != mimeAppsListLast; ++it) {
+                const std::string path(*it);
+                const unsigned int sourceCount = _sourceCount;
+                try {
+                    details::TraceSpan span("parse_mimeapps_list");
+                    span.addAttribute("path", path);
+                    std::ifstream stream(path.c_str());
+                    if (stream.is_open()) {
+                        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+                        addMimeAppsList(stream, path);
+                    }
+                } catch(std::exception& e) {
+
+                }
+                // Missing file still takes its place, so it can be updated after it's written.
+                if (sourceCount == _sourceCount) {
+                    addSource(SourceRecords(), path);
+                }
+            }
+            for (Iterator it = mimeInfoCacheFirst; it != mimeInfoCacheLast; ++it) {
+                try {
+                    details::TraceSpan span("parse_mimeinfo_cache");
+                    span.addAttribute("path", std::string(*it));
+                    std::ifstream stream(std::string(*it).c_str());
+                    if (stream.is_open()) {
+                        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+                        addMimeInfoCache(stream);
+                    }
+                } catch(std::exception& e) {
+
+                }
+            }
+        }
+
+        /**
+         * \brief Add mimeapps.list source with lower precedence than already added ones.
+         * \param path path of file the stream was read from. It allows to update source with updateMimeAppsList() later.
+         * \throws std::runtime_error on parse error. Index is not modified in this case.
+         */
+        void addMimeAppsList(std::istream& stream, const std::string& path = std::string());
+        /// ditto, but for mimeinfo.cache
+        void addMimeInfoCache(std::istream& stream);
+
+        /**
+         * \brief Replace lists of mimeType defined by mimeapps.list source at path.
+         *
+         * Used to apply changes of written file without reloading the whole index.
+         * Precedence of the source is preserved.
+         * \return false if there's no mimeapps.list source with this path.
+         * \sa MimeAppsListEditor
+         */
+        bool updateMimeAppsList(const std::string& path, const std::string& mimeType, const std::vector<std::string>& added,
+                                const std::vector<std::string>& removed, const std::vector<std::string>& defaults);
+
+        void clear();
+
+        /// Check if there're any records for mimeType.
+        bool contains(const std::string& mimeType) const;
+
+        /// List MIME types that have records in any source. Order is unspecified.
+        template<typename OutputIterator>
+        void mimeTypes(OutputIterator out) const
+        {
+            for (Entries::const_iterator it = _entries.begin(); it != _entries.end(); ++it) {
+                *out = it->first;
+            }
+        }
+
+        /**
+         * \brief List desktop ids associated with mimeType merging them into merger.
+         * Used to merge associations of several MIME types.
+         */
+        template<typename OutputIterator>
+        void associatedApplications(const std::string& mimeType, details::AssociationMerger& merger, OutputIterator out) const
+        {
+            Entries::const_iterator found = _entries.find(mimeType);
+            if (found == _entries.end()) {
+                return;
+            }
+            for (std::vector<Record>::const_iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                for (std::vector<std::string>::const_iterator idIt = it->removed.begin(); idIt != it->removed.end(); ++idIt) {
+                    merger.remove(*idIt);
+                }
+                for (std::vector<std::string>::const_iterator idIt = it->added.begin(); idIt != it->added.end(); ++idIt) {
+                    if (merger.add(*idIt)) {
+                        *out = *idIt;
+                    }
+                }
+            }
+        }
+
+        /// List desktop ids associated with mimeType in order of preference.
+        template<typename OutputIterator>
+        void associatedApplications(const std::string& mimeType, OutputIterator out) const
+        {
+            details::AssociationMerger merger;
+            associatedApplications(mimeType, merger, out);
+        }
+
+        /// List desktop ids of default applications for mimeType merging them into merger.
+        template<typename OutputIterator>
+        void defaultApplications(const std::string& mimeType, details::AssociationMerger& merger, OutputIterator out) const
+        {
+            Entries::const_iterator found = _entries.find(mimeType);
+            if (found == _entries.end()) {
+                return;
+            }
+            for (std::vector<Record>::const_iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                for (std::vector<std::string>::const_iterator idIt = it->defaults.begin(); idIt != it->defaults.end(); ++idIt) {
+                    if (merger.add(*idIt)) {
+                        *out = *idIt;
+                    }
+                }
+            }
+        }
+
+        /// List desktop ids of default applications for mimeType in order of preference.
+        template<typename OutputIterator>
+        void defaultApplications(const std::string& mimeType, OutputIterator out) const
+        {
+            details::AssociationMerger merger;
+            defaultApplications(mimeType, merger, out);
+        }
+
+    private:
+        /// Lists of desktop ids that one source defines for MIME type.
+        struct Record
+        {
+            Record();
+
+            unsigned int source;
+            std::vector<std::string> removed;
+            std::vector<std::string> added;
+            std::vector<std::string> defaults;
+        };
+        typedef std::unordered_map<std::string, std::vector<Record> > Entries;
+        typedef std::unordered_map<std::string, Record> SourceRecords;
+
+        void addSource(const SourceRecords& records, const std::string& path = std::string());
+
+        Entries _entries;
+        unsigned int _sourceCount;
+        // Paths of sources by source number, empty for sources added from stream without path.
+        std::vector<std::string> _sourcePaths;
+    };
+}
+
+#endif
@@ -0,0 +1,633 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "associationsnapshot.h"
+#include "mimeapps.h"
+#include "path.h"
+#include "system.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        /**
+         * Snapshot layout. All numbers are big-endian 32-bit, except superseded word which is only compared with zero.
+         * Header is followed by string pool, application table, lists and MIME type table.
+         * Strings are NUL-terminated. Lists are count followed by items.
+         * MIME type table is count followed by sorted records of MimeTypeFieldCount numbers.
+         * Application table is count followed by records of ApplicationFieldCount numbers sorted by desktop id.
+         */
+        enum {
+            MagicSize = 8,
+            VersionOffset = 8,
+            SupersededOffset = 12,
+            GenerationOffset = 16,
+            MimeTypeTableOffset = 20,
+            ApplicationTableOffset = 24,
+            FileSizeOffset = 28,
+            HeaderSize = 32,
+            SnapshotVersion = 1,
+            NoApplication = 0xffffffff
+        };
+
+        const char snapshotMagic[MagicSize+1] = "MIMESNAP";
+
+        enum ApplicationField
+        {
+            DesktopIdField,
+            FileNameField,
+            NameField,
+            GenericNameField,
+            CommentField,
+            IconField,
+            ExecField,
+            FlagsField,
+            ApplicationFieldCount
+        };
+
+        enum {
+            TerminalFlag = 1,
+            NoDisplayFlag = 2
+        };
+
+        const std::size_t mimeTypeRecordSize = 5 * 4;
+        const std::size_t applicationRecordSize = ApplicationFieldCount * 4;
+
+        void appendCard32(std::string& data, std::size_t value)
+        {
+            data += static_cast<char>((value >> 24) & 0xff);
+            data += static_cast<char>((value >> 16) & 0xff);
+            data += static_cast<char>((value >> 8) & 0xff);
+            data += static_cast<char>(value & 0xff);
+        }
+
+        void setCard32(std::string& data, std::size_t offset, std::size_t value)
+        {
+            data[offset] = static_cast<char>((value >> 24) & 0xff);
+            data[offset+1] = static_cast<char>((value >> 16) & 0xff);
+            data[offset+2] = static_cast<char>((value >> 8) & 0xff);
+            data[offset+3] = static_cast<char>(value & 0xff);
+        }
+
+        std::size_t readCard32(const unsigned char* data)
+        {
+            return (static_cast<std::size_t>(data[0]) << 24) | (static_cast<std::size_t>(data[1]) << 16) |
+                (static_cast<std::size_t>(data[2]) << 8) | data[3];
+        }
+
+        /// Superseded word is written by publisher while readers have the file mapped.
+        std::uint32_t loadSuperseded(const unsigned char* header)
+        {
+            return __atomic_load_n(reinterpret_cast<const std::uint32_t*>(header + SupersededOffset), __ATOMIC_ACQUIRE);
+        }
+
+        void storeSuperseded(unsigned char* header, std::uint32_t generation)
+        {
+            __atomic_store_n(reinterpret_cast<std::uint32_t*>(header + SupersededOffset), generation, __ATOMIC_RELEASE);
+        }
+
+        int compare(const StringRef& a, const std::string& b)
+        {
+            const int order = std::memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+            if (order != 0) {
+                return order;
+            }
+            return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+        }
+
+        bool isSnapshotHeader(const unsigned char* data, std::size_t size)
+        {
+            return size >= HeaderSize && std::memcmp(data, snapshotMagic, MagicSize) == 0 &&
+                readCard32(data + VersionOffset) == SnapshotVersion && readCard32(data + FileSizeOffset) == size;
+        }
+
+        /// Get desktop id of file lying in one of applications directories, e.g. kde4-okular.desktop for kde4/okular.desktop.
+        std::string desktopIdFromPath(const std::vector<std::string>& applicationsPaths, const std::string& path)
+        {
+            for (std::vector<std::string>::const_iterator it = applicationsPaths.begin(); it != applicationsPaths.end(); ++it) {
+                if (path.size() > it->size() + 1 && path.compare(0, it->size(), *it) == 0 && path[it->size()] == '/') {
+                    std::string desktopId = path.substr(it->size() + 1);
+                    std::replace(desktopId.begin(), desktopId.end(), '/', '-');
+                    return desktopId;
+                }
+            }
+            const std::string::size_type slash = path.rfind('/');
+            return slash == std::string::npos ? path : path.substr(slash + 1);
+        }
+
+        struct MimeTypeRecord
+        {
+            std::string mimeType;
+            std::vector<std::string> defaultIds;
+            std::vector<std::string> associatedIds;
+            std::size_t defaultApplication;
+            std::vector<std::size_t> associatedApplications;
+        };
+
+        /// Collects applications and strings of snapshot while it's being built.
+        struct SnapshotBuilder
+        {
+            explicit SnapshotBuilder(const std::vector<std::string>& applicationsPaths) : _applicationsPaths(applicationsPaths) {}
+
+            std::size_t addApplication(const DesktopFile& file, const std::string& desktopId) {
+                const std::string fileName = file.fileName().str();
+                std::unordered_map<std::string, std::size_t>::const_iterator found = _applicationIndices.find(fileName);
+                if (found != _applicationIndices.end()) {
+                    return found->second;
+                }
+                std::vector<std::string> fields(ApplicationFieldCount);
+                fields[DesktopIdField] = desktopId.empty() ? desktopIdFromPath(_applicationsPaths, fileName) : desktopId;
+                fields[FileNameField] = fileName;
+                fields[NameField] = file.name().str();
+                fields[GenericNameField] = file.genericName().str();
+                fields[CommentField] = file.comment().str();
+                fields[IconField] = file.icon().str();
+                fields[ExecField] = file.execValue().str();
+                fields[FlagsField] = std::string(1, static_cast<char>((file.terminal() ? TerminalFlag : 0) | (file.noDisplay() ? NoDisplayFlag : 0)));
+                _applications.push_back(fields);
+                _applicationIndices[fileName] = _applications.size() - 1;
+                return _applications.size() - 1;
+            }
+
+            std::string build(unsigned int generation, std::vector<MimeTypeRecord>& records);
+
+        private:
+            std::size_t addString(const std::string& str) {
+                std::unordered_map<std::string, std::size_t>::const_iterator found = _strings.find(str);
+                if (found != _strings.end()) {
+                    return found->second;
+                }
+                const std::size_t offset = _data.size();
+                _data.append(str.c_str(), str.size() + 1);
+                _strings[str] = offset;
+                return offset;
+            }
+
+            std::size_t addStringList(const std::vector<std::string>& strings) {
+                std::vector<std::size_t> offsets;
+                for (std::vector<std::string>::const_iterator it = strings.begin(); it != strings.end(); ++it) {
+                    offsets.push_back(addString(*it));
+                }
+                return addList(offsets);
+            }
+
+            std::size_t addList(const std::vector<std::size_t>& items) {
+                const std::size_t offset = _data.size();
+                appendCard32(_data, items.size());
+                for (std::vector<std::size_t>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                    appendCard32(_data, *it);
+                }
+                return offset;
+            }
+
+            std::vector<std::string> _applicationsPaths;
+            std::vector<std::vector<std::string> > _applications;
+            std::unordered_map<std::string, std::size_t> _applicationIndices;
+            std::unordered_map<std::string, std::size_t> _strings;
+            std::string _data;
+        };
+
+        bool lessByMimeType(const MimeTypeRecord& a, const MimeTypeRecord& b)
+        {
+            return a.mimeType < b.mimeType;
+        }
+
+        struct ApplicationOrder
+        {
+            explicit ApplicationOrder(const std::vector<std::vector<std::string> >& applications) : applications(applications) {}
+            bool operator()(std::size_t a, std::size_t b) const {
+                return applications[a][DesktopIdField] < applications[b][DesktopIdField];
+            }
+            const std::vector<std::vector<std::string> >& applications;
+        };
+
+        std::string SnapshotBuilder::build(unsigned int generation, std::vector<MimeTypeRecord>& records)
+        {
+            _data.assign(HeaderSize, '\0');
+            std::memcpy(&_data[0], snapshotMagic, MagicSize);
+            setCard32(_data, VersionOffset, SnapshotVersion);
+            setCard32(_data, GenerationOffset, generation);
+
+            // Applications are sorted by desktop id for lookup, so indices stored in MIME type records are remapped.
+            std::vector<std::size_t> order(_applications.size());
+            for (std::size_t i=0; i<order.size(); ++i) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), ApplicationOrder(_applications));
+            std::vector<std::size_t> position(order.size());
+            std::vector<std::size_t> fieldOffsets(order.size() * ApplicationFieldCount);
+            for (std::size_t i=0; i<order.size(); ++i) {
+                position[order[i]] = i;
+                const std::vector<std::string>& fields = _applications[order[i]];
+                for (std::size_t field=0; field<FlagsField; ++field) {
+                    fieldOffsets[i * ApplicationFieldCount + field] = addString(fields[field]);
+                }
+                fieldOffsets[i * ApplicationFieldCount + FlagsField] = static_cast<unsigned char>(fields[FlagsField][0]);
+            }
+
+            std::vector<std::size_t> mimeTypeFields;
+            std::sort(records.begin(), records.end(), lessByMimeType);
+            for (std::vector<MimeTypeRecord>::iterator it = records.begin(); it != records.end(); ++it) {
+                mimeTypeFields.push_back(addString(it->mimeType));
+                mimeTypeFields.push_back(addStringList(it->defaultIds));
+                mimeTypeFields.push_back(addStringList(it->associatedIds));
+                mimeTypeFields.push_back(it->defaultApplication == NoApplication ? static_cast<std::size_t>(NoApplication) : position[it->defaultApplication]);
+                for (std::vector<std::size_t>::iterator appIt = it->associatedApplications.begin(); appIt != it->associatedApplications.end(); ++appIt) {
+                    *appIt = position[*appIt];
+                }
+                mimeTypeFields.push_back(addList(it->associatedApplications));
+            }
+
+            setCard32(_data, ApplicationTableOffset, _data.size());
+            appendCard32(_data, order.size());
+            for (std::vector<std::size_t>::const_iterator it = fieldOffsets.begin(); it != fieldOffsets.end(); ++it) {
+                appendCard32(_data, *it);
+            }
+            setCard32(_data, MimeTypeTableOffset, _data.size());
+            appendCard32(_data, records.size());
+            for (std::vector<std::size_t>::const_iterator it = mimeTypeFields.begin(); it != mimeTypeFields.end(); ++it) {
+                appendCard32(_data, *it);
+            }
+            setCard32(_data, FileSizeOffset, _data.size());
+            return _data;
+        }
+
+        /**
+         * Snapshot path may be predictable, e.g. in /tmp, and snapshot names programs to launch,
+         * so only regular files owned by the user and not writable by others are trusted.
+         */
+        bool isTrustedSnapshotFile(const struct stat& st)
+        {
+            return S_ISREG(st.st_mode) && st.st_uid == ::geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+        }
+    }
+
+    std::string associationSnapshotPath()
+    {
+        const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+        if (runtimeDir && isAbsolutePath(runtimeDir)) {
+            return buildPath(runtimeDir, "mimeapps.snapshot");
+        }
+        std::ostringstream stream;
+        stream << "/tmp/mimeapps-" << ::getuid() << ".snapshot";
+        return stream.str();
+    }
+
+    SnapshotApplication::SnapshotApplication() : terminal(false), noDisplay(false)
+    {
+    }
+
+    AssociationSnapshotPublisher::AssociationSnapshotPublisher(const std::string& path) : _path(path), _generation(0), _header(NULL)
+    {
+        int fd = ::open(_path.c_str(), O_RDWR | O_CLOEXEC | O_NONBLOCK);
+        if (fd != -1) {
+            adopt(fd);
+        }
+    }
+
+    AssociationSnapshotPublisher::~AssociationSnapshotPublisher()
+    {
+        release();
+    }
+
+    const std::string& AssociationSnapshotPublisher::path() const
+    {
+        return _path;
+    }
+
+    unsigned int AssociationSnapshotPublisher::generation() const
+    {
+        return _generation;
+    }
+
+    void AssociationSnapshotPublisher::adopt(int fd)
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && isTrustedSnapshotFile(st) && st.st_size >= HeaderSize) {
+            void* data = ::mmap(NULL, HeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                unsigned char* header = static_cast<unsigned char*>(data);
+                if (std::memcmp(header, snapshotMagic, MagicSize) == 0 && readCard32(header + VersionOffset) == SnapshotVersion) {
+                    _header = header;
+                    _generation = static_cast<unsigned int>(readCard32(header + GenerationOffset));
+                } else {
+                    ::munmap(data, HeaderSize);
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    void AssociationSnapshotPublisher::release()
+    {
+        if (_header) {
+            ::munmap(_header, HeaderSize);
+            _header = NULL;
+        }
+    }
+
+    unsigned int AssociationSnapshotPublisher::publish()
+    {
+        AssociationIndex index;
+        index.load();
+        MimeHierarchy hierarchy;
+        hierarchy.load();
+        return publish(index, hierarchy);
+    }
+
+    unsigned int AssociationSnapshotPublisher::publish(const AssociationIndex& index, const MimeHierarchy& hierarchy, DesktopFileCache* cache)
+    {
+        details::TraceSpan span("publish_association_snapshot");
+        DesktopFileCache localCache;
+        if (!cache) {
+            cache = &localCache;
+        }
+
+        std::vector<std::string> mimeTypes;
+        index.mimeTypes(std::back_inserter(mimeTypes));
+        hierarchy.mimeTypes(std::back_inserter(mimeTypes));
+        std::sort(mimeTypes.begin(), mimeTypes.end());
+        mimeTypes.erase(std::unique(mimeTypes.begin(), mimeTypes.end()), mimeTypes.end());
+
+        const details::AssociationPaths paths;
+        SnapshotBuilder builder(paths.applications);
+        std::vector<MimeTypeRecord> records(mimeTypes.size());
+        std::vector<DesktopFile> files;
+        for (std::size_t i=0; i<mimeTypes.size(); ++i) {
+            MimeTypeRecord& record = records[i];
+            record.mimeType = mimeTypes[i];
+            index.defaultApplications(record.mimeType, std::back_inserter(record.defaultIds));
+            index.associatedApplications(record.mimeType, std::back_inserter(record.associatedIds));
+
+            std::string desktopId;
+            const DesktopFile file = findDefaultApplication(index, hierarchy, record.mimeType, &desktopId, cache);
+            record.defaultApplication = file.isValid() ? builder.addApplication(file, desktopId) : static_cast<std::size_t>(NoApplication);
+
+            files.clear();
+            findAssociatedApplications(index, hierarchy, record.mimeType, std::back_inserter(files), cache);
+            for (std::vector<DesktopFile>::const_iterator it = files.begin(); it != files.end(); ++it) {
+                record.associatedApplications.push_back(builder.addApplication(*it, std::string()));
+            }
+        }
+
+        const unsigned int generation = _generation + 1;
+        const std::string contents = builder.build(generation, records);
+        details::writeFileAtomically(_path, contents);
+
+        // Readers of the previous generation switch once they see it superseded.
+        if (_header) {
+            storeSuperseded(_header, generation);
+            release();
+        }
+        _generation = generation;
+        int fd = ::open(_path.c_str(), O_RDWR | O_CLOEXEC | O_NONBLOCK);
+        if (fd != -1) {
+            adopt(fd);
+        }
+
+        span.addAttribute("generation", generation);
+        span.addAttribute("mime_types", records.size());
+        span.addAttribute("size", contents.size());
+        return generation;
+    }
+
+    AssociationSnapshot::AssociationSnapshot(const std::string& path) : _path(path), _data(NULL), _size(0)
+    {
+        map(_path);
+    }
+
+    AssociationSnapshot::~AssociationSnapshot()
+    {
+        unmap();
+    }
+
+    bool AssociationSnapshot::map(const std::string& path)
+    {
+        // Non-blocking, so FIFO planted at snapshot path does not hang the reader.
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd == -1) {
+            return false;
+        }
+        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !isTrustedSnapshotFile(st) || st.st_size < HeaderSize) {
+            ::close(fd);
+            return false;
+        }
+        void* data = ::mmap(NULL, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        if (!isSnapshotHeader(static_cast<const unsigned char*>(data), static_cast<std::size_t>(st.st_size))) {
+            ::munmap(data, static_cast<std::size_t>(st.st_size));
+            return false;
+        }
+        unmap();
+        _data = static_cast<const unsigned char*>(data);
+        _size = static_cast<std::size_t>(st.st_size);
+        return true;
+    }
+
+    void AssociationSnapshot::unmap()
+    {
+        if (_data) {
+            ::munmap(const_cast<unsigned char*>(_data), _size);
+            _data = NULL;
+            _size = 0;
+        }
+    }
+
+    bool AssociationSnapshot::isValid() const
+    {
+        return _data != NULL;
+    }
+
+    const std::string& AssociationSnapshot::path() const
+    {
+        return _path;
+    }
+
+    unsigned int AssociationSnapshot::generation() const
+    {
+        return _data ? static_cast<unsigned int>(readCard32(_data + GenerationOffset)) : 0;
+    }
+
+    bool AssociationSnapshot::isStale() const
+    {
+        return _data && loadSuperseded(_data) != 0;
+    }
+
+    bool AssociationSnapshot::refresh()
+    {
+        if (_data && !isStale()) {
+            return false;
+        }
+        const unsigned int oldGeneration = generation();
+        // Publisher could have replaced the file again while we were mapping it.
+        for (int attempt = 0; attempt < 3 && (!_data || isStale()); ++attempt) {
+            if (!map(_path)) {
+                break;
+            }
+        }
+        return generation() != oldGeneration;
+    }
+
+    bool AssociationSnapshot::card32(std::size_t offset, std::size_t& value) const
+    {
+        if (offset > _size || _size - offset < 4) {
+            return false;
+        }
+        value = readCard32(_data + offset);
+        return true;
+    }
+
+    bool AssociationSnapshot::string(std::size_t offset, StringRef& str) const
+    {
+        if (offset >= _size) {
+            return false;
+        }
+        const void* end = std::memchr(_data + offset, '\0', _size - offset);
+        if (!end) {
+            return false;
+        }
+        const char* begin = reinterpret_cast<const char*>(_data + offset);
+        str = StringRef(begin, static_cast<const char*>(end) - begin);
+        return true;
+    }
+
+    bool AssociationSnapshot::findMimeType(const std::string& mimeType, std::size_t& recordOffset) const
+    {
+        std::size_t tableOffset, count;
+        if (!_data || !card32(MimeTypeTableOffset, tableOffset) || !card32(tableOffset, count)) {
+            return false;
+        }
+        const std::size_t recordsOffset = tableOffset + 4;
+        if (count > (_size - recordsOffset) / mimeTypeRecordSize) {
+            return false;
+        }
+        std::size_t low = 0, high = count;
+        while(low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            const std::size_t offset = recordsOffset + middle * mimeTypeRecordSize;
+            std::size_t nameOffset;
+            StringRef name;
+            if (!card32(offset, nameOffset) || !string(nameOffset, name)) {
+                return false;
+            }
+            const int order = compare(name, mimeType);
+            if (order == 0) {
+                recordOffset = offset;
+                return true;
+            } else if (order < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return false;
+    }
+
+    bool AssociationSnapshot::contains(const std::string& mimeType) const
+    {
+        std::size_t recordOffset;
+        return findMimeType(mimeType, recordOffset);
+    }
+
+    bool AssociationSnapshot::list(const std::string& mimeType, MimeTypeField field, std::size_t& listOffset, std::size_t& count) const
+    {
+        std::size_t recordOffset;
+        if (!findMimeType(mimeType, recordOffset) || !card32(recordOffset + field * 4, listOffset) || !card32(listOffset, count)) {
+            return false;
+        }
+        listOffset += 4;
+        return count <= (_size - listOffset) / 4;
+    }
+
+    bool AssociationSnapshot::stringAt(std::size_t listOffset, std::size_t index, StringRef& str) const
+    {
+        std::size_t offset;
+        return card32(listOffset + index * 4, offset) && string(offset, str);
+    }
+
+    bool AssociationSnapshot::applicationAt(std::size_t listOffset, std::size_t index, SnapshotApplication& app) const
+    {
+        std::size_t applicationIndex;
+        return card32(listOffset + index * 4, applicationIndex) && application(applicationIndex, app);
+    }
+
+    bool AssociationSnapshot::application(std::size_t index, SnapshotApplication& app) const
+    {
+        std::size_t tableOffset, count;
+        if (!card32(ApplicationTableOffset, tableOffset) || !card32(tableOffset, count) || index >= count) {
+            return false;
+        }
+        const std::size_t offset = tableOffset + 4 + index * applicationRecordSize;
+        std::size_t fields[ApplicationFieldCount];
+        for (std::size_t i=0; i<ApplicationFieldCount; ++i) {
+            if (!card32(offset + i * 4, fields[i])) {
+                return false;
+            }
+        }
+        if (!string(fields[DesktopIdField], app.desktopId) || !string(fields[FileNameField], app.fileName) ||
+            !string(fields[NameField], app.name) || !string(fields[GenericNameField], app.genericName) ||
+            !string(fields[CommentField], app.comment) || !string(fields[IconField], app.icon) || !string(fields[ExecField], app.exec)) {
+            return false;
+        }
+        app.terminal = (fields[FlagsField] & TerminalFlag) != 0;
+        app.noDisplay = (fields[FlagsField] & NoDisplayFlag) != 0;
+        return true;
+    }
+
+    bool AssociationSnapshot::findDefaultApplication(const std::string& mimeType, SnapshotApplication& app) const
+    {
+        std::size_t recordOffset, applicationIndex;
+        return findMimeType(mimeType, recordOffset) && card32(recordOffset + DefaultApplicationField * 4, applicationIndex) &&
+            applicationIndex != NoApplication && application(applicationIndex, app);
+    }
+
+    bool AssociationSnapshot::findApplication(const std::string& desktopId, SnapshotApplication& app) const
+    {
+        std::size_t tableOffset, count;
+        if (!_data || !card32(ApplicationTableOffset, tableOffset) || !card32(tableOffset, count)) {
+            return false;
+        }
+        if (count > (_size - tableOffset - 4) / applicationRecordSize) {
+            return false;
+        }
+        std::size_t low = 0, high = count;
+        while(low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            std::size_t idOffset;
+            StringRef id;
+            if (!card32(tableOffset + 4 + middle * applicationRecordSize, idOffset) || !string(idOffset, id)) {
+                return false;
+            }
+            const int order = compare(id, desktopId);
+            if (order == 0) {
+                return application(middle, app);
+            } else if (order < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,215 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Resolved associations published into a file that other processes map into memory.
+ */
+
+#ifndef MIMEAPPS_ASSOCIATIONSNAPSHOT_H
+#define MIMEAPPS_ASSOCIATIONSNAPSHOT_H
+
+#include <cstddef>
+#include <string>
+
+#include "associationindex.h"
+#include "desktopfilecache.h"
+#include "mimehierarchy.h"
+#include "stringref.h"
+
+namespace mimeapps
+{
+    /**
+     * \brief Default path of association snapshot: $XDG_RUNTIME_DIR/mimeapps.snapshot or /tmp/mimeapps-<uid>.snapshot if runtime directory is not set.
+     *
+     * Snapshot files not owned by the effective user or writable by group or others are ignored by readers and publisher.
+     */
+    std::string associationSnapshotPath();
+
+    /// \brief Application as stored in snapshot. Strings point into the snapshot mapping.
+    struct SnapshotApplication
+    {
+        SnapshotApplication();
+
+        StringRef desktopId;
+        StringRef fileName;
+        StringRef name;
+        StringRef genericName;
+        StringRef comment;
+        StringRef icon;
+        StringRef exec;
+        bool terminal;
+        bool noDisplay;
+    };
+
+    /**
+     * \brief Writes resolved association table and desktop entry fields into snapshot file.
+     *
+     * Each publish() writes new generation into a new file and renames it over the snapshot path,
+     * then marks the previous generation as superseded, so mapped readers notice the change without syscalls.
+     * Only one publisher per snapshot path should exist.
+     */
+    struct AssociationSnapshotPublisher
+    {
+        /// If snapshot already exists at path, generations continue from it.
+        explicit AssociationSnapshotPublisher(const std::string& path = associationSnapshotPath());
+        ~AssociationSnapshotPublisher();
+
+        const std::string& path() const;
+
+        /// Generation of the last published snapshot, 0 if nothing was published yet.
+        unsigned int generation() const;
+
+        /**
+         * \brief Load associations from standard locations and publish them.
+         * \return generation of the published snapshot.
+         * \throws std::runtime_error if snapshot can't be written.
+         */
+        unsigned int publish();
+
+        /**
+         * \brief ditto, but publish preloaded index and MIME hierarchy.
+         * \param cache if not NULL, desktop files are taken from it.
+         */
+        unsigned int publish(const AssociationIndex& index, const MimeHierarchy& hierarchy, DesktopFileCache* cache = NULL);
+
+    private:
+        AssociationSnapshotPublisher(const AssociationSnapshotPublisher&);
+        AssociationSnapshotPublisher& operator=(const AssociationSnapshotPublisher&);
+
+        void adopt(int fd);
+        void release();
+
+        std::string _path;
+        unsigned int _generation;
+        // Writable mapping of header of the current generation, to mark it superseded.
+        unsigned char* _header;
+    };
+
+    /**
+     * \brief Read-only mapping of association snapshot.
+     *
+     * Lookups read the mapping directly: they make no syscalls and copy nothing.
+     * Snapshot contains MIME types known to association files or MIME hierarchy, others are reported as missing,
+     * so caller can fall back to in-process lookup. Aliases are not resolved.
+     *
+     * Mapping stays on the generation it was opened with until refresh() is called,
+     * so returned strings are valid until then. Every offset read from the file is checked against the mapping size.
+     * Object is not thread-safe.
+     */
+    struct AssociationSnapshot
+    {
+        /// Map snapshot at path. If there's no valid snapshot yet, object is invalid until refresh() succeeds.
+        explicit AssociationSnapshot(const std::string& path = associationSnapshotPath());
+        ~AssociationSnapshot();
+
+        bool isValid() const;
+        const std::string& path() const;
+        /// Generation of the mapped snapshot, 0 if snapshot is invalid.
+        unsigned int generation() const;
+
+        /// Whether newer generation was published. This is a single memory read.
+        bool isStale() const;
+
+        /**
+         * \brief Switch to the latest generation if mapped one is stale or snapshot is invalid.
+         * Strings obtained earlier become invalid if switch happens.
+         * \return true if generation has changed.
+         */
+        bool refresh();
+
+        /// Whether snapshot has entry for MIME type.
+        bool contains(const std::string& mimeType) const;
+
+        /**
+         * \brief Default application for mimeType as findDefaultApplication() would give.
+         * \return false if there's no such MIME type in snapshot or it has no valid default application.
+         */
+        bool findDefaultApplication(const std::string& mimeType, SnapshotApplication& application) const;
+
+        /**
+         * \brief Applications for mimeType and its ancestors as findAssociatedApplications() would give.
+         * \return false if there's no such MIME type in snapshot.
+         */
+        template<typename OutputIterator>
+        bool findAssociatedApplications(const std::string& mimeType, OutputIterator out) const {
+            std::size_t listOffset, count;
+            if (!list(mimeType, AssociatedApplicationsField, listOffset, count)) {
+                return false;
+            }
+            SnapshotApplication application;
+            for (std::size_t i=0; i<count; ++i) {
+                if (applicationAt(listOffset, i, application)) {
+                    *out = application;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * \brief Desktop ids associated with exactly mimeType as listAssociatedApplications() would give.
+         * \return false if there's no such MIME type in snapshot.
+         */
+        template<typename OutputIterator>
+        bool listAssociatedApplications(const std::string& mimeType, OutputIterator out) const {
+            return listDesktopIds(mimeType, AssociatedIdsField, out);
+        }
+
+        /// \brief Desktop ids set as default for exactly mimeType as listDefaultApplications() would give.
+        template<typename OutputIterator>
+        bool listDefaultApplications(const std::string& mimeType, OutputIterator out) const {
+            return listDesktopIds(mimeType, DefaultIdsField, out);
+        }
+
+        /// Find application stored in snapshot by desktop id.
+        bool findApplication(const std::string& desktopId, SnapshotApplication& application) const;
+
+    private:
+        AssociationSnapshot(const AssociationSnapshot&);
+        AssociationSnapshot& operator=(const AssociationSnapshot&);
+
+        /// Fields of MIME type record.
+        enum MimeTypeField
+        {
+            MimeTypeNameField,
+            DefaultIdsField,
+            AssociatedIdsField,
+            DefaultApplicationField,
+            AssociatedApplicationsField,
+            MimeTypeFieldCount
+        };
+
+        template<typename OutputIterator>
+        bool listDesktopIds(const std::string& mimeType, MimeTypeField field, OutputIterator out) const {
+            std::size_t listOffset, count;
+            if (!list(mimeType, field, listOffset, count)) {
+                return false;
+            }
+            StringRef desktopId;
+            for (std::size_t i=0; i<count; ++i) {
+                if (stringAt(listOffset, i, desktopId)) {
+                    *out = desktopId.str();
+                }
+            }
+            return true;
+        }
+
+        bool map(const std::string& path);
+        void unmap();
+
+        bool card32(std::size_t offset, std::size_t& value) const;
+        bool string(std::size_t offset, StringRef& str) const;
+        bool findMimeType(const std::string& mimeType, std::size_t& recordOffset) const;
+        bool list(const std::string& mimeType, MimeTypeField field, std::size_t& listOffset, std::size_t& count) const;
+        bool stringAt(std::size_t listOffset, std::size_t index, StringRef& str) const;
+        bool applicationAt(std::size_t listOffset, std::size_t index, SnapshotApplication& application) const;
+        bool application(std::size_t index, SnapshotApplication& application) const;
+
+        std::string _path;
+        const unsigned char* _data;
+        std::size_t _size;
+    };
+}
+
+#endif
@@ -2,7 +2,15 @@
 // Distributed under the Boost Software License, Version 1.0.
 // http://www.boost.org/LICENSE_1_0.txt
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iterator>
+
 #include "basedir.h"
+#include "stats.h"
 
 namespace mimeapps
 {
@@ -26,4 +34,127 @@ namespace mimeapps
     std::string dataHome() {
         return xdgHomeDir("XDG_DATA_HOME", ".local/share");
     }
+
+    static BaseDirs::Directory openDirectory(const std::string& path)
+    {
+        BaseDirs::Directory directory;
+        directory.path = path;
+        const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return directory;
+        }
+        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+        struct stat st;
+        MIMEAPPS_STAT_ADD(StatCalls, 1);
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return directory;
+        }
+        directory.fd = fd;
+        directory.device = st.st_dev;
+        directory.inode = st.st_ino;
+        return directory;
+    }
+
+    static bool isSameDirectory(const BaseDirs::Directory& first, const BaseDirs::Directory& second)
+    {
+        return first.fd >= 0 && second.fd >= 0 && first.device == second.device && first.inode == second.inode;
+    }
+
+    // Open directories, skipping nonexistent ones and ones already opened in list or equal to home.
+    static void openDirectories(const std::vector<std::string>& paths, const BaseDirs::Directory& home, std::vector<BaseDirs::Directory>& directories)
+    {
+        for (std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it) {
+            BaseDirs::Directory directory = openDirectory(*it);
+            if (directory.fd < 0) {
+                continue;
+            }
+            bool duplicate = isSameDirectory(home, directory);
+            for (std::vector<BaseDirs::Directory>::const_iterator dirIt = directories.begin(); !duplicate && dirIt != directories.end(); ++dirIt) {
+                duplicate = isSameDirectory(*dirIt, directory);
+            }
+            if (duplicate) {
+                ::close(directory.fd);
+            } else {
+                directories.push_back(directory);
+            }
+        }
+    }
+
+    BaseDirs::Directory::Directory() : fd(-1), device(0), inode(0) {}
+
+    BaseDirs::BaseDirs()
+    {
+        refresh();
+    }
+
+    BaseDirs::~BaseDirs()
+    {
+        close();
+    }
+
+    void BaseDirs::close()
+    {
+        if (_configHome.fd >= 0) {
+            ::close(_configHome.fd);
+        }
+        if (_dataHome.fd >= 0) {
+            ::close(_dataHome.fd);
+        }
+        for (std::vector<Directory>::const_iterator it = _configDirs.begin(); it != _configDirs.end(); ++it) {
+            ::close(it->fd);
+        }
+        for (std::vector<Directory>::const_iterator it = _dataDirs.begin(); it != _dataDirs.end(); ++it) {
+            ::close(it->fd);
+        }
+        _configHome = Directory();
+        _dataHome = Directory();
+        _configDirs.clear();
+        _dataDirs.clear();
+    }
+
+    void BaseDirs::refresh()
+    {
+        close();
+        _configHome = openDirectory(mimeapps::configHome());
+        _dataHome = openDirectory(mimeapps::dataHome());
+
+        std::vector<std::string> paths;
+        mimeapps::configDirs(std::back_inserter(paths));
+        openDirectories(paths, _configHome, _configDirs);
+
+        paths.clear();
+        mimeapps::dataDirs(std::back_inserter(paths));
+        openDirectories(paths, _dataHome, _dataDirs);
+    }
+
+    const std::string& BaseDirs::configHome() const
+    {
+        return _configHome.path;
+    }
+
+    const std::string& BaseDirs::dataHome() const
+    {
+        return _dataHome.path;
+    }
+
+    const BaseDirs::Directory& BaseDirs::configHomeDirectory() const
+    {
+        return _configHome;
+    }
+
+    const BaseDirs::Directory& BaseDirs::dataHomeDirectory() const
+    {
+        return _dataHome;
+    }
+
+    const std::vector<BaseDirs::Directory>& BaseDirs::configDirectories() const
+    {
+        return _configDirs;
+    }
+
+    const std::vector<BaseDirs::Directory>& BaseDirs::dataDirectories() const
+    {
+        return _dataDirs;
+    }
 }
@@ -10,7 +10,10 @@
 #ifndef MIMEAPPS_BASEDIR_H
 #define MIMEAPPS_BASEDIR_H
 
+#include <sys/types.h>
+
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <cstring>
 
@@ -54,6 +57,76 @@ namespace mimeapps
     void dataDirs(OutputIterator out, const char* subPath = "") {
         details::baseDirs("XDG_DATA_DIRS", "/usr/local/share:/usr/share", out, subPath);
     }
+
+    /**
+     * \brief Snapshot of XDG base directories.
+     *
+     * Environment is read and directories are opened once on construction or refresh(),
+     * so lookups taking BaseDirs don't call getenv or split variables each time.
+     * System directories that don't exist or duplicate earlier ones (including symbolic links to the same directory)
+     * are dropped. Directories are held open until refresh() or destruction.
+     */
+    struct BaseDirs
+    {
+        /// Opened directory.
+        struct Directory
+        {
+            Directory();
+            std::string path;
+            /// Descriptor of directory suitable for *at() system calls or -1 if directory does not exist.
+            int fd;
+            /// Device and inode of opened directory, used to skip duplicate directories.
+            dev_t device;
+            ino_t inode;
+        };
+
+        /// Take snapshot of current environment.
+        BaseDirs();
+        ~BaseDirs();
+
+        /// Read environment again and reopen directories.
+        void refresh();
+
+        /// User config directory. It's given even if it does not exist.
+        const std::string& configHome() const;
+        /// User data directory. It's given even if it does not exist.
+        const std::string& dataHome() const;
+
+        const Directory& configHomeDirectory() const;
+        const Directory& dataHomeDirectory() const;
+
+        /// Existing system config directories in order of precedence.
+        const std::vector<Directory>& configDirectories() const;
+        /// Existing system data directories in order of precedence.
+        const std::vector<Directory>& dataDirectories() const;
+
+        /// Like free configDirs(), but uses snapshot.
+        template<typename OutputIterator>
+        void configDirs(OutputIterator out, const char* subPath = "") const {
+            for (std::vector<Directory>::const_iterator it = _configDirs.begin(); it != _configDirs.end(); ++it) {
+                *out = buildPath(it->path, subPath);
+            }
+        }
+
+        /// Like free dataDirs(), but uses snapshot.
+        template<typename OutputIterator>
+        void dataDirs(OutputIterator out, const char* subPath = "") const {
+            for (std::vector<Directory>::const_iterator it = _dataDirs.begin(); it != _dataDirs.end(); ++it) {
+                *out = buildPath(it->path, subPath);
+            }
+        }
+
+    private:
+        BaseDirs(const BaseDirs&);
+        BaseDirs& operator=(const BaseDirs&);
+
+        void close();
+
+        Directory _configHome;
+        Directory _dataHome;
+        std::vector<Directory> _configDirs;
+        std::vector<Directory> _dataDirs;
+    };
 }
 
 #endif
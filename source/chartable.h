@@ -0,0 +1,91 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Compile-time character tables shared by text parsers.
+ */
+
+#ifndef MIMEAPPS_CHARTABLE_H
+#define MIMEAPPS_CHARTABLE_H
+
+namespace mimeapps
+{
+    namespace details {
+        /// Character classes. Character may belong to several classes.
+        enum CharClass
+        {
+            /// Whitespace trimmed from the end of ini-like lines.
+            SpaceChar = 1,
+            /// Separator of Exec arguments.
+            ArgumentSeparatorChar = 2,
+            /// Quote starting quoted Exec argument.
+            QuoteChar = 4,
+            /// Character allowed in desktop file key.
+            KeyChar = 8
+        };
+
+        constexpr unsigned char charClass(unsigned int c)
+        {
+            return static_cast<unsigned char>(
+                ((c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') ? SpaceChar : 0) |
+                ((c == ' ' || c == '\t') ? ArgumentSeparatorChar : 0) |
+                ((c == '"' || c == '\'') ? QuoteChar : 0) |
+                (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-') ? KeyChar : 0));
+        }
+
+        /// Character that escape sequence in ini-like value stands for, 0 if it's not an escape sequence.
+        constexpr char valueEscape(unsigned int c)
+        {
+            return c == 's' ? ' ' : c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c == '\\' ? '\\' : '\0';
+        }
+
+        /// Character that escape sequence in quoted Exec argument stands for, 0 if it's not an escape sequence.
+        constexpr char quotedArgumentEscape(unsigned int c)
+        {
+            return (c == '`' || c == '$' || c == '"' || c == '\\') ? static_cast<char>(c) : '\0';
+        }
+
+        template<unsigned int... Indices>
+        struct IndexList {};
+
+        template<unsigned int N, unsigned int... Indices>
+        struct MakeIndexList : MakeIndexList<N-1, N-1, Indices...> {};
+
+        template<unsigned int... Indices>
+        struct MakeIndexList<0, Indices...>
+        {
+            typedef IndexList<Indices...> type;
+        };
+
+        /// 256-entry table of Function values for every byte, filled at compile time.
+        template<typename T, T (*Function)(unsigned int), typename List = typename MakeIndexList<256>::type>
+        struct CharTable;
+
+        template<typename T, T (*Function)(unsigned int), unsigned int... Indices>
+        struct CharTable<T, Function, IndexList<Indices...> >
+        {
+            static constexpr T values[256] = {Function(Indices)...};
+        };
+
+        template<typename T, T (*Function)(unsigned int), unsigned int... Indices>
+        constexpr T CharTable<T, Function, IndexList<Indices...> >::values[256];
+
+        typedef CharTable<unsigned char, charClass> CharClassTable;
+        typedef CharTable<char, valueEscape> ValueEscapeTable;
+        typedef CharTable<char, quotedArgumentEscape> QuotedArgumentEscapeTable;
+
+        inline unsigned char charClassOf(char c)
+        {
+            return CharClassTable::values[static_cast<unsigned char>(c)];
+        }
+
+        inline bool hasCharClass(char c, CharClass mask)
+        {
+            return (charClassOf(c) & mask) != 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,249 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/stat.h>
+
+#include "classifier.h"
+
+namespace mimeapps
+{
+    namespace {
+        /// Number of results worker collects before handing them over to consumer.
+        const std::size_t batchSize = 64;
+        /// Number of batches per worker that may wait for consumer.
+        const std::size_t queuedBatches = 4;
+    }
+
+    ClassificationStats::ClassificationStats() : files(0), resolved(0), seconds(0), threads(0) {}
+
+    double ClassificationStats::filesPerSecond() const
+    {
+        return seconds > 0 ? files / seconds : 0;
+    }
+
+    details::ClassificationPool::ClassificationPool(const Classifier& classifier, const std::vector<std::string>& paths, unsigned int threadCount)
+        : _classifier(classifier), _paths(paths), _maxResults(0), _runningWorkers(0), _stop(false)
+    {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        if (threadCount > paths.size()) {
+            threadCount = static_cast<unsigned int>(paths.empty() ? 1 : paths.size());
+        }
+        _maxResults = threadCount * queuedBatches * batchSize;
+
+        for (unsigned int i=0; i<threadCount; ++i) {
+            std::unique_ptr<Shard> shard(new Shard);
+            const std::size_t first = paths.size() * i / threadCount;
+            const std::size_t last = paths.size() * (i + 1) / threadCount;
+            for (std::size_t task = first; task < last; ++task) {
+                shard->tasks.push_back(task);
+            }
+            _shards.push_back(std::move(shard));
+        }
+
+        _runningWorkers = threadCount;
+        try {
+            for (unsigned int i=0; i<threadCount; ++i) {
+                _threads.push_back(std::thread(&ClassificationPool::work, this, i));
+            }
+        } catch(...) {
+            {
+                std::lock_guard<std::mutex> lock(_resultsMutex);
+                _stop = true;
+            }
+            _resultsSpace.notify_all();
+            for (std::size_t i=0; i<_threads.size(); ++i) {
+                _threads[i].join();
+            }
+            throw;
+        }
+    }
+
+    details::ClassificationPool::~ClassificationPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_resultsMutex);
+            _stop = true;
+        }
+        _resultsSpace.notify_all();
+        for (std::size_t i=0; i<_threads.size(); ++i) {
+            _threads[i].join();
+        }
+    }
+
+    unsigned int details::ClassificationPool::threadCount() const
+    {
+        return static_cast<unsigned int>(_shards.size());
+    }
+
+    bool details::ClassificationPool::next(Classification& result)
+    {
+        std::unique_lock<std::mutex> lock(_resultsMutex);
+        while(_results.empty() && _runningWorkers != 0) {
+            _resultsReady.wait(lock);
+        }
+        if (_results.empty()) {
+            return false;
+        }
+        result = std::move(_results.front());
+        _results.pop_front();
+        lock.unlock();
+        _resultsSpace.notify_one();
+        return true;
+    }
+
+    bool details::ClassificationPool::take(std::size_t shard, std::size_t& task)
+    {
+        std::lock_guard<std::mutex> lock(_shards[shard]->mutex);
+        std::deque<std::size_t>& tasks = _shards[shard]->tasks;
+        if (tasks.empty()) {
+            return false;
+        }
+        task = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+
+    bool details::ClassificationPool::steal(std::size_t thief, std::size_t& task)
+    {
+        std::vector<std::size_t> stolen;
+        for (std::size_t i=1; i<_shards.size() && stolen.empty(); ++i) {
+            Shard& victim = *_shards[(thief + i) % _shards.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            const std::size_t count = (victim.tasks.size() + 1) / 2;
+            stolen.assign(victim.tasks.begin(), victim.tasks.begin() + count);
+            victim.tasks.erase(victim.tasks.begin(), victim.tasks.begin() + count);
+        }
+        if (stolen.empty()) {
+            return false;
+        }
+        task = stolen.back();
+        stolen.pop_back();
+        if (!stolen.empty()) {
+            std::lock_guard<std::mutex> lock(_shards[thief]->mutex);
+            _shards[thief]->tasks.insert(_shards[thief]->tasks.end(), stolen.begin(), stolen.end());
+        }
+        return true;
+    }
+
+    void details::ClassificationPool::publish(std::vector<Classification>& batch)
+    {
+        if (batch.empty()) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(_resultsMutex);
+            while(_results.size() >= _maxResults && !_stop) {
+                _resultsSpace.wait(lock);
+            }
+            for (std::vector<Classification>::iterator it = batch.begin(); it != batch.end(); ++it) {
+                _results.push_back(std::move(*it));
+            }
+        }
+        batch.clear();
+        _resultsReady.notify_one();
+    }
+
+    void details::ClassificationPool::work(std::size_t shard)
+    {
+        std::vector<Classification> batch;
+        batch.reserve(batchSize);
+        std::unordered_map<std::string, std::string> defaults;
+        std::size_t task;
+        while(!_stop && (take(shard, task) || steal(shard, task))) {
+            try {
+                batch.push_back(classify(_paths[task], defaults));
+            } catch(std::exception& e) {
+                Classification failed;
+                failed.path = _paths[task];
+                batch.push_back(failed);
+            }
+            if (batch.size() >= batchSize) {
+                publish(batch);
+            }
+        }
+        publish(batch);
+
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        --_runningWorkers;
+        _resultsReady.notify_one();
+    }
+
+    Classification details::ClassificationPool::classify(const std::string& path, std::unordered_map<std::string, std::string>& defaults) const
+    {
+        Classification result;
+        result.path = path;
+        result.mimeType = _classifier.mimeTypeForFile(path);
+        if (!result.mimeType.empty()) {
+            std::unordered_map<std::string, std::string>::const_iterator found = defaults.find(result.mimeType);
+            if (found != defaults.end()) {
+                result.desktopId = found->second;
+            } else {
+                result.desktopId = _classifier.defaultApplicationId(result.mimeType);
+                defaults.insert(std::make_pair(result.mimeType, result.desktopId));
+            }
+        }
+        return result;
+    }
+
+    Classifier::Classifier(const MimeGlobs& globs, const MimeMagic& magic, const AssociationIndex& index, const MimeHierarchy& hierarchy)
+        : _globs(globs), _magic(magic), _index(index), _hierarchy(hierarchy)
+    {
+    }
+
+    Classification Classifier::classify(const std::string& path) const
+    {
+        Classification result;
+        result.path = path;
+        result.mimeType = mimeTypeForFile(path);
+        if (!result.mimeType.empty()) {
+            result.desktopId = defaultApplicationId(result.mimeType);
+        }
+        return result;
+    }
+
+    std::string Classifier::mimeTypeForFile(const std::string& path) const
+    {
+        struct stat st;
+        MIMEAPPS_STAT_ADD(StatCalls, 1);
+        if (stat(path.c_str(), &st) != 0) {
+            return std::string();
+        }
+        if (S_ISDIR(st.st_mode)) {
+            return "inode/directory";
+        }
+        const char* mimeType = _globs.mimeTypeForFileName(path);
+        if (mimeType) {
+            return mimeType;
+        }
+        mimeType = _magic.mimeTypeForFile(path);
+        if (mimeType) {
+            return mimeType;
+        }
+        return "application/octet-stream";
+    }
+
+    std::string Classifier::defaultApplicationId(const std::string& mimeType) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(_defaultsMutex);
+            std::unordered_map<std::string, std::string>::const_iterator it = _defaults.find(mimeType);
+            if (it != _defaults.end()) {
+                MIMEAPPS_STAT_ADD(CacheHits, 1);
+                return it->second;
+            }
+        }
+        MIMEAPPS_STAT_ADD(CacheMisses, 1);
+        // Resolve without holding the lock. Concurrent resolution of the same type gives the same answer.
+        std::string desktopId;
+        findDefaultApplication(_index, _hierarchy, mimeType, &desktopId);
+        std::lock_guard<std::mutex> lock(_defaultsMutex);
+        _defaults.insert(std::make_pair(mimeType, desktopId));
+        return desktopId;
+    }
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Detecting MIME types and default applications of many files in parallel.
+ */
+
+#ifndef MIMEAPPS_CLASSIFIER_H
+#define MIMEAPPS_CLASSIFIER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mimeapps.h"
+#include "mimeglobs.h"
+#include "mimemagic.h"
+
+namespace mimeapps
+{
+    /// \brief Result of classifying a single file.
+    struct Classification
+    {
+        std::string path;
+        /// Detected MIME type. Empty if file does not exist.
+        std::string mimeType;
+        /// Desktop id of default application for mimeType. Empty if there's none.
+        std::string desktopId;
+    };
+
+    /// \brief Statistics of bulk classification.
+    struct ClassificationStats
+    {
+        ClassificationStats();
+
+        /// Number of classified files.
+        std::size_t files;
+        /// Number of files that got default application.
+        std::size_t resolved;
+        /// Wall clock time spent in seconds.
+        double seconds;
+        /// Number of threads used.
+        unsigned int threads;
+
+        double filesPerSecond() const;
+    };
+
+    struct Classifier;
+
+    namespace details {
+        /// Number of paths Classifier::classify() takes from input range at once.
+        const std::size_t ClassificationChunkSize = 16384;
+
+        /**
+         * \brief Work-stealing pool classifying paths in worker threads.
+         *
+         * Paths are split into contiguous shards, one per worker.
+         * Worker takes paths from the back of its own shard and, once it's empty,
+         * steals half of the front of another shard, so slow files (e.g. on network mounts) don't stall the rest.
+         * Results are handed over to consumer in batches. Number of results waiting for consumer is bounded,
+         * workers wait for consumer to catch up when the limit is reached.
+         * Each worker memoizes default applications of MIME types it has seen, so workers don't contend for shared memo.
+         */
+        struct ClassificationPool
+        {
+            ClassificationPool(const Classifier& classifier, const std::vector<std::string>& paths, unsigned int threadCount);
+            /// Stops workers and waits for them.
+            ~ClassificationPool();
+
+            /// Get next result in completion order. Blocks until result is available. Returns false when all paths are done.
+            bool next(Classification& result);
+
+            unsigned int threadCount() const;
+
+        private:
+            ClassificationPool(const ClassificationPool&);
+            ClassificationPool& operator=(const ClassificationPool&);
+
+            struct Shard
+            {
+                std::mutex mutex;
+                std::deque<std::size_t> tasks;
+            };
+
+            void work(std::size_t shard);
+            bool take(std::size_t shard, std::size_t& task);
+            bool steal(std::size_t thief, std::size_t& task);
+            void publish(std::vector<Classification>& batch);
+            Classification classify(const std::string& path, std::unordered_map<std::string, std::string>& defaults) const;
+
+            const Classifier& _classifier;
+            const std::vector<std::string>& _paths;
+            std::vector<std::unique_ptr<Shard> > _shards;
+            std::vector<std::thread> _threads;
+
+            std::mutex _resultsMutex;
+            std::condition_variable _resultsReady;
+            std::condition_variable _resultsSpace;
+            std::deque<Classification> _results;
+            std::size_t _maxResults;
+            std::size_t _runningWorkers;
+            std::atomic<bool> _stop;
+        };
+    }
+
+    /**
+     * \brief Detects MIME type of files and resolves their default applications.
+     *
+     * Paths that don't exist get no MIME type and directories get inode/directory regardless of their names.
+     * Other files are detected by file name first, then by contents, and get application/octet-stream if both fail.
+     * Default application is resolved once per MIME type and memoized.
+     *
+     * Globs, magic, association index and hierarchy are shared between threads and must not be modified while Classifier is used.
+     */
+    struct Classifier
+    {
+        Classifier(const MimeGlobs& globs, const MimeMagic& magic, const AssociationIndex& index, const MimeHierarchy& hierarchy);
+
+        /// Classify single file.
+        Classification classify(const std::string& path) const;
+
+        /// Detect MIME type of file. Returns empty string if file does not exist.
+        std::string mimeTypeForFile(const std::string& path) const;
+
+        /// Get desktop id of default application for MIME type or empty string if there's none. Result is memoized.
+        std::string defaultApplicationId(const std::string& mimeType) const;
+
+        /**
+         * \brief Classify range of paths in parallel.
+         *
+         * Results are written to out from the calling thread in order of completion, not in order of input.
+         * Paths are read from input in chunks of details::ClassificationChunkSize and results wait for out in bounded queue,
+         * so memory use does not grow with number of paths.
+         * \param out output iterator accepting Classification.
+         * \param threadCount number of worker threads. 0 means number of hardware threads.
+         */
+        template<typename Iterator, typename OutputIterator>
+        ClassificationStats classify(Iterator first, Iterator last, OutputIterator out, unsigned int threadCount = 0) const {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ClassificationStats stats;
+            std::vector<std::string> paths;
+            do {
+                paths.clear();
+                for (; first != last && paths.size() < details::ClassificationChunkSize; ++first) {
+                    paths.push_back(*first);
+                }
+                details::ClassificationPool pool(*this, paths, threadCount);
+                stats.threads = pool.threadCount() > stats.threads ? pool.threadCount() : stats.threads;
+                Classification result;
+                while(pool.next(result)) {
+                    ++stats.files;
+                    if (!result.desktopId.empty()) {
+                        ++stats.resolved;
+                    }
+                    *out = result;
+                }
+            } while(first != last);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+    private:
+        const MimeGlobs& _globs;
+        const MimeMagic& _magic;
+        const AssociationIndex& _index;
+        const MimeHierarchy& _hierarchy;
+
+        mutable std::mutex _defaultsMutex;
+        mutable std::unordered_map<std::string, std::string> _defaults;
+    };
+}
+
+#endif
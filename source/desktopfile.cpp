@@ -2,20 +2,26 @@
 // Distributed under the Boost Software License, Version 1.0.
 // http://www.boost.org/LICENSE_1_0.txt
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <new>
 #include <stdexcept>
 #include "desktopfile.h"
+#include "stats.h"
 #include "system.h"
+#include "trace.h"
 
 namespace mimeapps
 {
-    void details::expand(const std::string& token, std::string& expanded, std::string::size_type& restPos, std::string::size_type& i, const std::string& insert)
+    void details::expand(const std::string& token, std::string& expanded, std::string::size_type& restPos, std::string::size_type& i, const StringRef& insert)
     {
         if (token.size() == 2) {
-            expanded = insert;
+            expanded.assign(insert.data(), insert.size());
         } else {
-            expanded.append(token.begin() + restPos, token.begin()+i).append(insert);
+            expanded.append(token.begin() + restPos, token.begin()+i).append(insert.data(), insert.size());
         }
         restPos = i+2;
         ++i;
@@ -25,30 +31,119 @@ namespace mimeapps
         return isValidDesktopFileKey(str.begin(), str.end());
     }
 
-    DesktopFile::DesktopFile() {
-        init();
+    /// Reference counter followed by offsets of fields and their null-terminated characters, allocated as one block.
+    struct DesktopFile::Storage
+    {
+        std::atomic<unsigned int> references;
+        std::size_t offsets[FieldCount + 1];
+
+        char* chars() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        static Storage* create(const std::string* fields) {
+            std::size_t total = 0;
+            for (int i=0; i<FieldCount; ++i) {
+                total += fields[i].size() + 1;
+            }
+            Storage* storage = new(::operator new(sizeof(Storage) + total)) Storage();
+            storage->references = 1;
+            std::size_t offset = 0;
+            for (int i=0; i<FieldCount; ++i) {
+                storage->offsets[i] = offset;
+                std::memcpy(storage->chars() + offset, fields[i].c_str(), fields[i].size() + 1);
+                offset += fields[i].size() + 1;
+            }
+            storage->offsets[FieldCount] = offset;
+            return storage;
+        }
+
+        static void acquire(Storage* storage) {
+            if (storage) {
+                storage->references.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        static void release(Storage* storage) {
+            if (storage && storage->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                storage->~Storage();
+                ::operator delete(storage);
+            }
+        }
+    };
+
+    DesktopFile::DesktopFile() : _storage(NULL), _type(Unknown), _terminal(false), _hidden(false), _noDisplay(false) {
     }
 
-    DesktopFile::DesktopFile(std::istream& stream, const std::string& fileName) : _fileName(fileName) {
-        init(stream);
+    DesktopFile::DesktopFile(std::istream& stream, const std::string& fileName, Arena* arena) : _storage(NULL), _type(Unknown), _terminal(false), _hidden(false), _noDisplay(false) {
+        init(stream, fileName, arena);
     }
-    DesktopFile::DesktopFile(const std::string& fileName) : _fileName(fileName) {
-        init();
+    DesktopFile::DesktopFile(const std::string& fileName, Arena* arena) : _storage(NULL), _type(Unknown), _terminal(false), _hidden(false), _noDisplay(false) {
+        details::TraceSpan span("parse_desktop_file");
+        span.addAttribute("path", fileName);
         std::ifstream file(fileName.c_str(), std::ifstream::binary);
         if(file.is_open()) {
-            init(file);
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            init(file, fileName, arena);
+        } else {
+            std::string fields[FieldCount];
+            fields[FileNameField] = fileName;
+            setFields(fields);
         }
     }
 
-    void DesktopFile::init() {
+    DesktopFile::DesktopFile(const DesktopFile& other) : _storage(other._storage), _type(other._type), _terminal(other._terminal), _hidden(other._hidden), _noDisplay(other._noDisplay) {
+        Storage::acquire(_storage);
+    }
+
+    DesktopFile::DesktopFile(DesktopFile&& other) : _storage(other._storage), _type(other._type), _terminal(other._terminal), _hidden(other._hidden), _noDisplay(other._noDisplay) {
+        other._storage = NULL;
+        other._type = Unknown;
+        other._terminal = false;
+        other._hidden = false;
+        other._noDisplay = false;
+    }
+
+    DesktopFile& DesktopFile::operator=(DesktopFile other) {
+        swap(other);
+        return *this;
+    }
+
+    DesktopFile::~DesktopFile() {
+        Storage::release(_storage);
+    }
+
+    void DesktopFile::swap(DesktopFile& other) {
+        std::swap(_storage, other._storage);
+        std::swap(_type, other._type);
+        std::swap(_terminal, other._terminal);
+        std::swap(_hidden, other._hidden);
+        std::swap(_noDisplay, other._noDisplay);
+    }
+
+    void DesktopFile::setFields(const std::string* fields) {
+        Storage* storage = Storage::create(fields);
+        Storage::release(_storage);
+        _storage = storage;
+    }
+
+    StringRef DesktopFile::field(Field f) const {
+        if (!_storage) {
+            return StringRef();
+        }
+        return StringRef(_storage->chars() + _storage->offsets[f], _storage->offsets[f+1] - _storage->offsets[f] - 1);
+    }
+
+    void DesktopFile::init(std::istream& stream, const std::string& fileName, Arena* arena) {
         _type = Unknown;
         _terminal = false;
-    }
+        _hidden = false;
+        _noDisplay = false;
 
-    void DesktopFile::init(std::istream& stream) {
-        init();
+        std::string fields[FieldCount];
+        fields[FileNameField] = fileName;
 
-        SearchRequest request;
+        SearchRequest request(arena);
         const std::string desktopEntry = "Desktop Entry";
         request.addRequest(desktopEntry, "Type");
         request.addRequest(desktopEntry, "Exec");
@@ -58,6 +153,13 @@ namespace mimeapps
         request.addRequest(desktopEntry, "Icon");
         request.addRequest(desktopEntry, "Path");
         request.addRequest(desktopEntry, "Terminal");
+        request.addRequest(desktopEntry, "MimeType");
+        request.addRequest(desktopEntry, "TryExec");
+        request.addRequest(desktopEntry, "Hidden");
+        request.addRequest(desktopEntry, "NoDisplay");
+        request.addRequest(desktopEntry, "OnlyShowIn");
+        request.addRequest(desktopEntry, "NotShowIn");
+        request.addRequest(desktopEntry, "Keywords");
 
         try {
             request.searchKeyValues(stream);
@@ -75,16 +177,24 @@ namespace mimeapps
                 }
             }
 
-            _execValue = request.getValue(desktopEntry, "Exec").value();
-            _name = request.getValue(desktopEntry, "Name").value();
-            _genericName = request.getValue(desktopEntry, "GenericName").value();
-            _comment = request.getValue(desktopEntry, "Comment").value();
-            _icon = request.getValue(desktopEntry, "Icon").value();
-            _workingDirectory = request.getValue(desktopEntry, "Path").value();
+            fields[ExecField] = request.getValue(desktopEntry, "Exec").value();
+            fields[NameField] = request.getValue(desktopEntry, "Name").value();
+            fields[GenericNameField] = request.getValue(desktopEntry, "GenericName").value();
+            fields[CommentField] = request.getValue(desktopEntry, "Comment").value();
+            fields[IconField] = request.getValue(desktopEntry, "Icon").value();
+            fields[PathField] = request.getValue(desktopEntry, "Path").value();
+            fields[MimeTypeField] = request.getValue(desktopEntry, "MimeType").value();
+            fields[TryExecField] = request.getValue(desktopEntry, "TryExec").value();
+            fields[OnlyShowInField] = request.getValue(desktopEntry, "OnlyShowIn").value();
+            fields[NotShowInField] = request.getValue(desktopEntry, "NotShowIn").value();
+            fields[KeywordsField] = request.getValue(desktopEntry, "Keywords").value();
             _terminal = isTrue(request.getValue(desktopEntry, "Terminal").value());
+            _hidden = isTrue(request.getValue(desktopEntry, "Hidden").value());
+            _noDisplay = isTrue(request.getValue(desktopEntry, "NoDisplay").value());
         } catch(std::exception& e) {
             _type = Unknown;
         }
+        setFields(fields);
     }
 
     bool DesktopFile::isValid() const {
@@ -94,29 +204,83 @@ namespace mimeapps
     DesktopFile::Type DesktopFile::type() const {
         return _type;
     }
-    std::string DesktopFile::execValue() const {
-        return _execValue;
+    StringRef DesktopFile::execValue() const {
+        return field(ExecField);
     }
-    std::string DesktopFile::name() const {
-        return _name;
+    StringRef DesktopFile::name() const {
+        return field(NameField);
     }
-    std::string DesktopFile::genericName() const {
-        return _genericName;
+    StringRef DesktopFile::genericName() const {
+        return field(GenericNameField);
     }
-    std::string DesktopFile::comment() const {
-        return _comment;
+    StringRef DesktopFile::comment() const {
+        return field(CommentField);
     }
-    std::string DesktopFile::icon() const {
-        return _icon;
+    StringRef DesktopFile::icon() const {
+        return field(IconField);
     }
-    std::string DesktopFile::workingDirectory() const {
-        return _workingDirectory;
+    StringRef DesktopFile::workingDirectory() const {
+        return field(PathField);
     }
     bool DesktopFile::terminal() const {
         return _terminal;
     }
-    std::string DesktopFile::fileName() const {
-        return _fileName;
+    StringRef DesktopFile::mimeTypeValue() const {
+        return field(MimeTypeField);
+    }
+    StringRef DesktopFile::keywordsValue() const {
+        return field(KeywordsField);
+    }
+    StringRef DesktopFile::tryExecValue() const {
+        return field(TryExecField);
+    }
+    bool DesktopFile::hidden() const {
+        return _hidden;
+    }
+    bool DesktopFile::noDisplay() const {
+        return _noDisplay;
+    }
+    StringRef DesktopFile::onlyShowInValue() const {
+        return field(OnlyShowInField);
+    }
+    StringRef DesktopFile::notShowInValue() const {
+        return field(NotShowInField);
+    }
+
+    static bool listContains(const StringRef& list, const char* first, const char* last)
+    {
+        Splitter<const char*> splitter(list.begin(), list.end(), ';');
+        for (Splitter<const char*>::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+            if (it->second - it->first == last - first && std::equal(first, last, it->first)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool DesktopFile::isShownIn(const StringRef& desktops) const {
+        const StringRef onlyShowIn = onlyShowInValue();
+        const StringRef notShowIn = notShowInValue();
+        if (desktops.empty() || (onlyShowIn.empty() && notShowIn.empty())) {
+            return true;
+        }
+        Splitter<const char*> splitter(desktops.begin(), desktops.end(), ':');
+        for (Splitter<const char*>::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+            if (it->first == it->second) {
+                continue;
+            }
+            if (listContains(notShowIn, it->first, it->second)) {
+                return false;
+            }
+            if (listContains(onlyShowIn, it->first, it->second)) {
+                return true;
+            }
+        }
+        return onlyShowIn.empty();
+    }
+
+    StringRef DesktopFile::fileName() const {
+        return field(FileNameField);
     }
 
     void DesktopFile::spawnApplication(const std::string& toOpen) const {
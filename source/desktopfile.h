@@ -18,19 +18,15 @@
 #include <vector>
 
 #include "inilike.h"
+#include "splitter.h"
+#include "stringref.h"
 
 namespace mimeapps
 {
     namespace details {
         template<typename Iterator>
         std::string unescapeQuotedArgument(const Iterator& first, const Iterator& last) {
-            const std::pair<char, char> pairs[] = {
-                std::make_pair('`', '`'),
-                std::make_pair('$', '$'),
-                std::make_pair('"', '"'),
-                std::make_pair('\\', '\\')
-            };
-            return doUnescape(first, last, &pairs[0], pairs + 4);
+            return doUnescape(first, last, QuotedArgumentEscapeTable::values);
         }
 
         template<typename Iterator>
@@ -61,7 +57,55 @@ namespace mimeapps
             return unescapeQuotedArgument(start, it);
         }
 
-        void expand(const std::string& token, std::string& expanded, std::string::size_type& restPos, std::string::size_type& i, const std::string& insert);
+        void expand(const std::string& token, std::string& expanded, std::string::size_type& restPos, std::string::size_type& i, const StringRef& insert);
+
+        /// Implementation of unquoteExec(). Arguments are accumulated in append, which allows to choose allocator.
+        template<typename Iterator, typename OutputIterator, typename String>
+        void doUnquoteExec(Iterator first, Iterator last, OutputIterator out, String append)
+        {
+            bool isNull = true;
+            bool wasInQuotes = false;
+
+            Iterator it = first;
+
+            while(it != last) {
+                const unsigned char type = charClassOf(*it);
+                if (type & ArgumentSeparatorChar) {
+                    if (!wasInQuotes && append.size() >= 1 && append[append.size()-1] == '\\') {
+                        append[append.size()-1] = *it;
+                        isNull = false;
+                    } else {
+                        if (!isNull) {
+                            *out = append;
+                            append.clear();
+                            isNull = true;
+                        }
+                    }
+                    wasInQuotes = false;
+                    ++it;
+                } else if (type & QuoteChar) {
+                    const std::string part = parseQuotedPart(it, *it, last);
+                    append.append(part.data(), part.size());
+                    wasInQuotes = true;
+                    isNull = false;
+                    ++it;
+                } else {
+                    // Copy run of ordinary characters at once.
+                    Iterator runEnd = it;
+                    while(runEnd != last && !(charClassOf(*runEnd) & (ArgumentSeparatorChar | QuoteChar))) {
+                        ++runEnd;
+                    }
+                    details::appendRange(append, it, runEnd);
+                    wasInQuotes = false;
+                    isNull = false;
+                    it = runEnd;
+                }
+            }
+
+            if (!isNull) {
+                *out = append;
+            }
+        }
     }
 
     /**
@@ -74,40 +118,7 @@ namespace mimeapps
     template<typename Iterator, typename OutputIterator>
     void unquoteExec(Iterator first, Iterator last, OutputIterator out)
     {
-        std::string append;
-        bool isNull = true;
-        bool wasInQuotes = false;
-
-        Iterator it = first;
-
-        while(it != last) {
-            if (*it == ' ' || *it == '\t') {
-                if (!wasInQuotes && append.size() >= 1 && append[append.size()-1] == '\\') {
-                    append[append.size()-1] = *it;
-                    isNull = false;
-                } else {
-                    if (!isNull) {
-                        *out = append;
-                        append.clear();
-                        isNull = true;
-                    }
-                }
-                wasInQuotes = false;
-            } else if (*it == '"' || *it == '\'') {
-                append += details::parseQuotedPart(it, *it, last);
-                wasInQuotes = true;
-                isNull = false;
-            } else {
-                append.push_back(*it);
-                wasInQuotes = false;
-                isNull = false;
-            }
-            ++it;
-        }
-
-        if (!isNull) {
-            *out = append;
-        }
+        details::doUnquoteExec(first, last, out, std::string());
     }
 
     /// ditto
@@ -125,8 +136,7 @@ namespace mimeapps
             return false;
         }
         for (Iterator it = first; it != last; ++it) {
-            typename Iterator::value_type c = *it;
-            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-')) {
+            if (!details::hasCharClass(*it, details::KeyChar)) {
                 return false;
             }
         }
@@ -137,8 +147,8 @@ namespace mimeapps
 
     template<typename Iterator, typename OutputIterator>
     void expandExecArgs(const Iterator& first, const Iterator& last, const std::string& toOpen,
-                        const std::string& iconName, const std::string& displayName,
-                        const std::string& desktopFileName, OutputIterator out)
+                        const StringRef& iconName, const StringRef& displayName,
+                        const StringRef& desktopFileName, OutputIterator out)
     {
         for(Iterator it = first; it != last; ++it) {
             const std::string token = *it;
@@ -149,7 +159,7 @@ namespace mimeapps
             } else if (token == "%i") {
                 if (iconName.size()) {
                     *out = "--icon";
-                    *out = iconName;
+                    *out = iconName.str();
                 }
             } else {
                 std::string expanded;
@@ -204,6 +214,13 @@ namespace mimeapps
     }
 
 
+    /**
+     * \brief Parsed desktop entry.
+     *
+     * All string fields are stored in a single reference-counted immutable block,
+     * so copying DesktopFile does not allocate and accessors return views into the block.
+     * Views are valid while any DesktopFile sharing the block is alive.
+     */
     struct DesktopFile
     {
         enum Type {
@@ -215,44 +232,101 @@ namespace mimeapps
         };
 
         DesktopFile();
-        DesktopFile(const std::string& fileName);
-        DesktopFile(std::istream& stream, const std::string& fileName);
+        /// \param arena if not NULL, temporary parsing data is allocated from it. Parsed fields never refer to it.
+        DesktopFile(const std::string& fileName, Arena* arena = NULL);
+        /// ditto, but read already opened stream.
+        DesktopFile(std::istream& stream, const std::string& fileName, Arena* arena = NULL);
+
+        DesktopFile(const DesktopFile& other);
+        DesktopFile(DesktopFile&& other);
+        DesktopFile& operator=(DesktopFile other);
+        ~DesktopFile();
+
+        void swap(DesktopFile& other);
 
         bool isValid() const;
 
         Type type() const;
-        std::string execValue() const;
-        std::string name() const;
-        std::string genericName() const;
-        std::string comment() const;
-        std::string icon() const;
-        std::string workingDirectory() const;
+        StringRef execValue() const;
+        StringRef name() const;
+        StringRef genericName() const;
+        StringRef comment() const;
+        StringRef icon() const;
+        StringRef workingDirectory() const;
         bool terminal() const;
+        /// Raw value of MimeType key, i.e. list of MIME types separated by semicolons.
+        StringRef mimeTypeValue() const;
+        /// Raw value of Keywords key, i.e. list of words separated by semicolons.
+        StringRef keywordsValue() const;
+        /// Program used to check if application is actually installed.
+        StringRef tryExecValue() const;
+        /// Whether entry is considered deleted.
+        bool hidden() const;
+        /// Whether entry should not be shown in menus. Such entries still can be used to open files.
+        bool noDisplay() const;
+        /// Raw value of OnlyShowIn key, i.e. list of desktop environments separated by semicolons.
+        StringRef onlyShowInValue() const;
+        /// Raw value of NotShowIn key.
+        StringRef notShowInValue() const;
+
+        /**
+         * \brief Check OnlyShowIn and NotShowIn against current desktop environments.
+         * \param desktops list of desktop environment names separated by colons, in format of XDG_CURRENT_DESKTOP.
+         * If it's empty, desktop environment is unknown and entry is considered shown.
+         */
+        bool isShownIn(const StringRef& desktops) const;
+
+        /// Get MIME types from MimeType key, skipping empty items.
+        template<typename OutputIterator>
+        void mimeTypes(OutputIterator out) const {
+            const StringRef value = mimeTypeValue();
+            Splitter<const char*> splitter(value.begin(), value.end(), ';');
+            for (Splitter<const char*>::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+                if (it->first != it->second) {
+                    *out = std::string(it->first, it->second);
+                }
+            }
+        }
 
-        std::string fileName() const;
+        StringRef fileName() const;
 
         template<typename OutputIterator>
         void expandExecValue(const std::string& toOpen, OutputIterator out) const {
+            const StringRef exec = execValue();
             std::vector<std::string> unquoted;
-            unquoteExec(execValue(), std::back_inserter(unquoted));
+            unquoteExec(exec.begin(), exec.end(), std::back_inserter(unquoted));
             expandExecArgs(unquoted.begin(), unquoted.end(), toOpen, icon(), name(), fileName(), out);
         }
 
         void spawnApplication(const std::string& toOpen) const;
 
     private:
-        void init();
-        void init(std::istream& stream);
+        enum Field {
+            ExecField,
+            NameField,
+            GenericNameField,
+            CommentField,
+            IconField,
+            PathField,
+            MimeTypeField,
+            TryExecField,
+            OnlyShowInField,
+            NotShowInField,
+            KeywordsField,
+            FileNameField,
+            FieldCount
+        };
+        struct Storage;
+
+        void init(std::istream& stream, const std::string& fileName, Arena* arena);
+        void setFields(const std::string* fields);
+        StringRef field(Field f) const;
 
+        Storage* _storage;
         Type _type;
-        std::string _execValue;
-        std::string _name;
-        std::string _genericName;
-        std::string _comment;
-        std::string _icon;
-        std::string _workingDirectory;
-        std::string _fileName;
         bool _terminal;
+        bool _hidden;
+        bool _noDisplay;
     };
 
 }
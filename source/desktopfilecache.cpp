@@ -0,0 +1,99 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/stat.h>
+
+#include "desktopfilecache.h"
+#include "stats.h"
+
+namespace mimeapps
+{
+    DesktopFileCache::DesktopFileCache(std::size_t capacity) : _capacity(capacity), _hits(0), _misses(0) {}
+
+    DesktopFile DesktopFileCache::get(const std::string& path)
+    {
+        struct stat st;
+        MIMEAPPS_STAT_ADD(StatCalls, 1);
+        if (::stat(path.c_str(), &st) != 0) {
+            return DesktopFile(path);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::unordered_map<std::string, Entries::iterator>::iterator found = _index.find(path);
+            if (found != _index.end()) {
+                const Entry& entry = *found->second;
+                if (entry.device == st.st_dev && entry.inode == st.st_ino && entry.mtime == st.st_mtim.tv_sec &&
+                    entry.mtimeNsec == st.st_mtim.tv_nsec && entry.size == st.st_size) {
+                    _entries.splice(_entries.begin(), _entries, found->second);
+                    ++_hits;
+                    MIMEAPPS_STAT_ADD(CacheHits, 1);
+                    return entry.file;
+                }
+            }
+            ++_misses;
+        }
+        MIMEAPPS_STAT_ADD(CacheMisses, 1);
+
+        // Parse without holding the lock, so other threads are not blocked by I/O.
+        Entry entry;
+        entry.path = path;
+        entry.device = st.st_dev;
+        entry.inode = st.st_ino;
+        entry.mtime = st.st_mtim.tv_sec;
+        entry.mtimeNsec = st.st_mtim.tv_nsec;
+        entry.size = st.st_size;
+        entry.file = DesktopFile(path);
+
+        if (_capacity == 0) {
+            return entry.file;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::unordered_map<std::string, Entries::iterator>::iterator found = _index.find(path);
+        if (found != _index.end()) {
+            _entries.erase(found->second);
+            _index.erase(found);
+        }
+        _entries.push_front(entry);
+        _index[path] = _entries.begin();
+        while(_entries.size() > _capacity) {
+            _index.erase(_entries.back().path);
+            _entries.pop_back();
+        }
+        return entry.file;
+    }
+
+    void DesktopFileCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _index.clear();
+        _hits = 0;
+        _misses = 0;
+    }
+
+    std::size_t DesktopFileCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    std::size_t DesktopFileCache::capacity() const
+    {
+        return _capacity;
+    }
+
+    std::size_t DesktopFileCache::hits() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+    std::size_t DesktopFileCache::misses() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _misses;
+    }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Cache of parsed desktop files.
+ */
+
+#ifndef MIMEAPPS_DESKTOPFILECACHE_H
+#define MIMEAPPS_DESKTOPFILECACHE_H
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "desktopfile.h"
+
+namespace mimeapps
+{
+    /**
+     * \brief Bounded LRU cache of parsed desktop files.
+     *
+     * Entries are keyed by path and revalidated by inode, modification time and size on every access,
+     * so changed or replaced files are parsed again. Cache hit costs one stat call and no reading.
+     * Cache can be shared between threads.
+     */
+    struct DesktopFileCache
+    {
+        /// Create cache holding at most capacity desktop files.
+        explicit DesktopFileCache(std::size_t capacity = 256);
+
+        /**
+         * \brief Get parsed desktop file at path.
+         * If file does not exist, returns DesktopFile constructed from path, which is invalid.
+         */
+        DesktopFile get(const std::string& path);
+
+        void clear();
+
+        std::size_t size() const;
+        std::size_t capacity() const;
+
+        /// Number of get() calls served from cache.
+        std::size_t hits() const;
+        /// Number of get() calls that required parsing file.
+        std::size_t misses() const;
+
+    private:
+        DesktopFileCache(const DesktopFileCache&);
+        DesktopFileCache& operator=(const DesktopFileCache&);
+
+        struct Entry
+        {
+            std::string path;
+            dev_t device;
+            ino_t inode;
+            time_t mtime;
+            long mtimeNsec;
+            off_t size;
+            DesktopFile file;
+        };
+        typedef std::list<Entry> Entries;
+
+        // Most recently used entries go first.
+        Entries _entries;
+        std::unordered_map<std::string, Entries::iterator> _index;
+        std::size_t _capacity;
+        std::size_t _hits;
+        std::size_t _misses;
+        mutable std::mutex _mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,652 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "icontheme.h"
+#include "inilike.h"
+#include "splitter.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        enum {
+            HasXpm = 1,
+            HasSvg = 2,
+            HasPng = 4
+        };
+
+        enum {
+            CacheHeaderSize = 12,
+            HashOffset = 4,
+            DirectoryListOffset = 8,
+            NoOffset = 0xffffffff
+        };
+
+        enum DirectoryType
+        {
+            FixedDirectory,
+            ScalableDirectory,
+            ThresholdDirectory
+        };
+
+        /// Subdirectory of theme described in index.theme.
+        struct Subdirectory
+        {
+            std::string path;
+            DirectoryType type;
+            unsigned int size;
+            unsigned int scale;
+            unsigned int minSize;
+            unsigned int maxSize;
+            unsigned int threshold;
+        };
+
+        /// Icon files of the same name in subdirectory. Flags tell which extensions are present.
+        struct Image
+        {
+            std::size_t subdirectory;
+            unsigned int flags;
+        };
+
+        unsigned int extensionFlag(const std::string& fileName, std::string::size_type& dotPos)
+        {
+            dotPos = fileName.rfind('.');
+            if (dotPos == std::string::npos || dotPos == 0) {
+                return 0;
+            }
+            const char* extension = fileName.c_str() + dotPos + 1;
+            if (std::strcmp(extension, "png") == 0) {
+                return HasPng;
+            } else if (std::strcmp(extension, "svg") == 0) {
+                return HasSvg;
+            } else if (std::strcmp(extension, "xpm") == 0) {
+                return HasXpm;
+            }
+            return 0;
+        }
+
+        /// Extension of the most preferred format among flags.
+        const char* bestExtension(unsigned int flags)
+        {
+            if (flags & HasPng) {
+                return ".png";
+            } else if (flags & HasSvg) {
+                return ".svg";
+            } else if (flags & HasXpm) {
+                return ".xpm";
+            }
+            return NULL;
+        }
+
+        bool directoryMatchesSize(const Subdirectory& subdir, unsigned int size, unsigned int scale)
+        {
+            if (subdir.scale != scale) {
+                return false;
+            }
+            switch(subdir.type) {
+                case FixedDirectory:
+                    return subdir.size == size;
+                case ScalableDirectory:
+                    return subdir.minSize <= size && size <= subdir.maxSize;
+                case ThresholdDirectory:
+                    return subdir.size <= size + subdir.threshold && size <= subdir.size + subdir.threshold;
+            }
+            return false;
+        }
+
+        unsigned int directorySizeDistance(const Subdirectory& subdir, unsigned int size, unsigned int scale)
+        {
+            const long requested = static_cast<long>(size) * scale;
+            long low = 0, high = 0;
+            switch(subdir.type) {
+                case FixedDirectory:
+                    low = high = static_cast<long>(subdir.size) * subdir.scale;
+                    break;
+                case ScalableDirectory:
+                    low = static_cast<long>(subdir.minSize) * subdir.scale;
+                    high = static_cast<long>(subdir.maxSize) * subdir.scale;
+                    break;
+                case ThresholdDirectory:
+                    low = (static_cast<long>(subdir.size) - subdir.threshold) * subdir.scale;
+                    high = (static_cast<long>(subdir.size) + subdir.threshold) * subdir.scale;
+                    break;
+            }
+            if (requested < low) {
+                return static_cast<unsigned int>(low - requested);
+            } else if (requested > high) {
+                return static_cast<unsigned int>(requested - high);
+            }
+            return 0;
+        }
+
+        bool isModifiedBefore(const struct stat& a, const struct stat& b)
+        {
+            return a.st_mtim.tv_sec < b.st_mtim.tv_sec || (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec < b.st_mtim.tv_nsec);
+        }
+
+        void splitList(const std::string& value, std::vector<std::string>& items)
+        {
+            typedef Splitter<std::string::const_iterator> SplitterType;
+            SplitterType splitter(value.begin(), value.end(), ',');
+            for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+                if (it->first != it->second) {
+                    items.push_back(std::string(it->first, it->second));
+                }
+            }
+        }
+
+        unsigned int toUnsigned(const std::string& value, unsigned int defaultValue)
+        {
+            std::istringstream stream(value);
+            unsigned int result;
+            if (stream >> result) {
+                return result;
+            }
+            return defaultValue;
+        }
+
+        typedef std::map<std::string, std::map<std::string, std::string> > IniGroups;
+
+        struct IniReader
+        {
+            IniReader(IniGroups& groups) : _groups(groups) {}
+
+            void operator()(const std::string& group, const std::string& key, const std::string& value) {
+                _groups[group][key] = value;
+            }
+        private:
+            IniGroups& _groups;
+        };
+
+        std::string groupValue(const IniGroups& groups, const std::string& group, const std::string& key)
+        {
+            IniGroups::const_iterator groupIt = groups.find(group);
+            if (groupIt != groups.end()) {
+                std::map<std::string, std::string>::const_iterator keyIt = groupIt->second.find(key);
+                if (keyIt != groupIt->second.end()) {
+                    return keyIt->second;
+                }
+            }
+            return std::string();
+        }
+
+        /// Read-only memory mapping of GTK icon-theme.cache. Offsets are checked against mapping size like in MimeCache.
+        struct IconThemeCache
+        {
+            /// \throws std::runtime_error if file can't be mapped or has unsupported format.
+            explicit IconThemeCache(const std::string& fileName) : _data(NULL), _size(0)
+            {
+                int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1) {
+                    throw std::runtime_error("Could not open icon theme cache " + fileName);
+                }
+                MIMEAPPS_STAT_ADD(FilesOpened, 1);
+                struct stat st;
+                if (::fstat(fd, &st) != 0 || st.st_size < CacheHeaderSize) {
+                    ::close(fd);
+                    throw std::runtime_error("Icon theme cache is too small: " + fileName);
+                }
+                void* data = ::mmap(NULL, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (data == MAP_FAILED) {
+                    throw std::runtime_error("Could not map icon theme cache " + fileName);
+                }
+                _data = static_cast<const unsigned char*>(data);
+                _size = static_cast<std::size_t>(st.st_size);
+
+                unsigned int major = 0, minor = 0;
+                card16(0, major);
+                card16(2, minor);
+                if (major != 1 || minor != 0) {
+                    ::munmap(const_cast<unsigned char*>(_data), _size);
+                    throw std::runtime_error("Unsupported icon theme cache version: " + fileName);
+                }
+            }
+
+            ~IconThemeCache()
+            {
+                ::munmap(const_cast<unsigned char*>(_data), _size);
+            }
+
+            /// Get names of directories listed in cache. Images refer to them by index.
+            void directories(std::vector<std::string>& names) const
+            {
+                unsigned int listOffset = 0, count = 0;
+                if (!card32(DirectoryListOffset, listOffset) || !card32(listOffset, count) || !hasRange(listOffset + 4, count, 4)) {
+                    return;
+                }
+                for (unsigned int i=0; i<count; ++i) {
+                    unsigned int nameOffset = 0;
+                    card32(listOffset + 4 + i * 4, nameOffset);
+                    const char* name = string(nameOffset);
+                    names.push_back(name ? name : "");
+                }
+            }
+
+            /// Get indices of directories containing icon and extension flags.
+            void images(const std::string& iconName, std::vector<std::pair<unsigned int, unsigned int> >& found) const
+            {
+                unsigned int hashOffset = 0, bucketCount = 0;
+                if (!card32(HashOffset, hashOffset) || !card32(hashOffset, bucketCount) || bucketCount == 0 || !hasRange(hashOffset + 4, bucketCount, 4)) {
+                    return;
+                }
+                unsigned int iconOffset = NoOffset;
+                card32(hashOffset + 4 + (hash(iconName.c_str()) % bucketCount) * 4, iconOffset);
+                // Chain can't be longer than number of icon records fitting into file, so corrupted loop ends.
+                for (std::size_t steps = 0; iconOffset != NoOffset && steps < _size / 12; ++steps) {
+                    unsigned int chainOffset = NoOffset, nameOffset = 0, listOffset = 0;
+                    if (!card32(iconOffset, chainOffset) || !card32(iconOffset + 4, nameOffset) || !card32(iconOffset + 8, listOffset)) {
+                        return;
+                    }
+                    const char* name = string(nameOffset);
+                    if (name && iconName == name) {
+                        unsigned int count = 0;
+                        if (!card32(listOffset, count) || !hasRange(listOffset + 4, count, 8)) {
+                            return;
+                        }
+                        for (unsigned int i=0; i<count; ++i) {
+                            unsigned int directoryIndex = 0, flags = 0;
+                            card16(listOffset + 4 + i * 8, directoryIndex);
+                            card16(listOffset + 4 + i * 8 + 2, flags);
+                            found.push_back(std::make_pair(directoryIndex, flags));
+                        }
+                        return;
+                    }
+                    iconOffset = chainOffset;
+                }
+            }
+
+            /// Hash function of GTK, which treats characters as signed.
+            static unsigned int hash(const char* name)
+            {
+                const signed char* p = reinterpret_cast<const signed char*>(name);
+                std::uint32_t h = static_cast<std::uint32_t>(*p);
+                if (h) {
+                    for (++p; *p != '\0'; ++p) {
+                        h = (h << 5) - h + static_cast<std::uint32_t>(*p);
+                    }
+                }
+                return h;
+            }
+
+        private:
+            IconThemeCache(const IconThemeCache&);
+            IconThemeCache& operator=(const IconThemeCache&);
+
+            bool card16(std::size_t offset, unsigned int& value) const
+            {
+                if (offset > _size || _size - offset < 2) {
+                    return false;
+                }
+                value = (static_cast<unsigned int>(_data[offset]) << 8) | _data[offset+1];
+                return true;
+            }
+
+            bool card32(std::size_t offset, unsigned int& value) const
+            {
+                if (offset > _size || _size - offset < 4) {
+                    return false;
+                }
+                value = (static_cast<unsigned int>(_data[offset]) << 24) | (static_cast<unsigned int>(_data[offset+1]) << 16) |
+                        (static_cast<unsigned int>(_data[offset+2]) << 8) | _data[offset+3];
+                return true;
+            }
+
+            const char* string(std::size_t offset) const
+            {
+                if (offset >= _size || std::memchr(_data + offset, '\0', _size - offset) == NULL) {
+                    return NULL;
+                }
+                return reinterpret_cast<const char*>(_data + offset);
+            }
+
+            bool hasRange(std::size_t offset, std::size_t count, std::size_t entrySize) const
+            {
+                return offset <= _size && count <= (_size - offset) / entrySize;
+            }
+
+            const unsigned char* _data;
+            std::size_t _size;
+        };
+    }
+
+    struct IconLookup::Theme
+    {
+        /// Directory of theme in one of base directories.
+        struct Root
+        {
+            std::string path;
+            /// Mapped cache or NULL if directory was scanned.
+            std::unique_ptr<IconThemeCache> cache;
+            /// Index of theme subdirectory for each cache directory or -1 if it's not in index.theme.
+            std::vector<long> cacheSubdirectories;
+            std::unordered_map<std::string, std::vector<Image> > scanned;
+        };
+
+        std::vector<std::string> parents;
+        std::vector<Subdirectory> subdirectories;
+        std::vector<std::unique_ptr<Root> > roots;
+
+        void images(const Root& root, const std::string& iconName, std::vector<Image>& found) const
+        {
+            if (root.cache) {
+                std::vector<std::pair<unsigned int, unsigned int> > cached;
+                root.cache->images(iconName, cached);
+                for (std::size_t i=0; i<cached.size(); ++i) {
+                    if (cached[i].first < root.cacheSubdirectories.size() && root.cacheSubdirectories[cached[i].first] >= 0) {
+                        Image image = {static_cast<std::size_t>(root.cacheSubdirectories[cached[i].first]), cached[i].second};
+                        found.push_back(image);
+                    }
+                }
+            } else {
+                std::unordered_map<std::string, std::vector<Image> >::const_iterator it = root.scanned.find(iconName);
+                if (it != root.scanned.end()) {
+                    found.insert(found.end(), it->second.begin(), it->second.end());
+                }
+            }
+        }
+
+        void scan(Root& root) const
+        {
+            for (std::size_t i=0; i<subdirectories.size(); ++i) {
+                DIR* dir = ::opendir(buildPath(root.path, subdirectories[i].path).c_str());
+                if (!dir) {
+                    continue;
+                }
+                struct dirent* entry;
+                while((entry = ::readdir(dir)) != NULL) {
+                    const std::string fileName = entry->d_name;
+                    std::string::size_type dotPos;
+                    const unsigned int flag = extensionFlag(fileName, dotPos);
+                    if (!flag) {
+                        continue;
+                    }
+                    std::vector<Image>& images = root.scanned[fileName.substr(0, dotPos)];
+                    if (!images.empty() && images.back().subdirectory == i) {
+                        images.back().flags |= flag;
+                    } else {
+                        Image image = {i, flag};
+                        images.push_back(image);
+                    }
+                }
+                ::closedir(dir);
+            }
+        }
+    };
+
+    IconLookup::IconLookup(const std::string& themeName) : _themeName(themeName), _hits(0), _misses(0)
+    {
+        getIconThemePaths(std::back_inserter(_basePaths));
+    }
+
+    IconLookup::IconLookup(const BaseDirs& baseDirs, const std::string& themeName) : _themeName(themeName), _hits(0), _misses(0)
+    {
+        getIconThemePaths(baseDirs, std::back_inserter(_basePaths));
+    }
+
+    IconLookup::IconLookup(const std::vector<std::string>& basePaths, const std::string& themeName)
+        : _basePaths(basePaths), _themeName(themeName), _hits(0), _misses(0)
+    {
+    }
+
+    IconLookup::~IconLookup()
+    {
+    }
+
+    const std::string& IconLookup::themeName() const
+    {
+        return _themeName;
+    }
+
+    const IconLookup::Theme* IconLookup::theme(const std::string& name)
+    {
+        std::unordered_map<std::string, std::unique_ptr<Theme> >::const_iterator found = _themes.find(name);
+        if (found != _themes.end()) {
+            return found->second.get();
+        }
+        std::unique_ptr<Theme>& slot = _themes[name];
+
+        details::TraceSpan span("load_icon_theme");
+        span.addAttribute("name", name);
+
+        // The first index.theme describes the theme, but icons may be spread over all base directories.
+        IniGroups groups;
+        bool hasIndex = false;
+        std::unique_ptr<Theme> theme(new Theme);
+        for (std::vector<std::string>::const_iterator it = _basePaths.begin(); it != _basePaths.end(); ++it) {
+            const std::string path = buildPath(*it, name);
+            struct stat st;
+            MIMEAPPS_STAT_ADD(StatCalls, 1);
+            if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+            std::unique_ptr<Theme::Root> root(new Theme::Root);
+            root->path = path;
+            theme->roots.push_back(std::move(root));
+            if (!hasIndex) {
+                std::ifstream stream(buildPath(path, "index.theme").c_str());
+                if (stream.is_open()) {
+                    MIMEAPPS_STAT_ADD(FilesOpened, 1);
+                    try {
+                        readKeyValues(stream, IniReader(groups));
+                        hasIndex = true;
+                    } catch(std::exception& e) {
+                        groups.clear();
+                    }
+                }
+            }
+        }
+        if (!hasIndex) {
+            return NULL;
+        }
+
+        splitList(groupValue(groups, "Icon Theme", "Inherits"), theme->parents);
+        std::vector<std::string> directories;
+        splitList(groupValue(groups, "Icon Theme", "Directories"), directories);
+        splitList(groupValue(groups, "Icon Theme", "ScaledDirectories"), directories);
+        for (std::vector<std::string>::const_iterator it = directories.begin(); it != directories.end(); ++it) {
+            const unsigned int size = toUnsigned(groupValue(groups, *it, "Size"), 0);
+            if (size == 0) {
+                continue;
+            }
+            Subdirectory subdir;
+            subdir.path = *it;
+            subdir.size = size;
+            subdir.scale = toUnsigned(groupValue(groups, *it, "Scale"), 1);
+            subdir.minSize = toUnsigned(groupValue(groups, *it, "MinSize"), size);
+            subdir.maxSize = toUnsigned(groupValue(groups, *it, "MaxSize"), size);
+            subdir.threshold = toUnsigned(groupValue(groups, *it, "Threshold"), 2);
+            const std::string type = groupValue(groups, *it, "Type");
+            subdir.type = type == "Fixed" ? FixedDirectory : (type == "Scalable" ? ScalableDirectory : ThresholdDirectory);
+            theme->subdirectories.push_back(subdir);
+        }
+
+        std::size_t cachedRoots = 0;
+        for (std::size_t r=0; r<theme->roots.size(); ++r) {
+            Theme::Root& root = *theme->roots[r];
+            // Like GTK, trust cache only if it's not older than directory.
+            const std::string cachePath = buildPath(root.path, "icon-theme.cache");
+            struct stat cacheStat, dirStat;
+            MIMEAPPS_STAT_ADD(StatCalls, 2);
+            if (::stat(cachePath.c_str(), &cacheStat) == 0 && ::stat(root.path.c_str(), &dirStat) == 0 && !isModifiedBefore(cacheStat, dirStat)) {
+                try {
+                    root.cache.reset(new IconThemeCache(cachePath));
+                    std::vector<std::string> cacheDirectories;
+                    root.cache->directories(cacheDirectories);
+                    for (std::size_t i=0; i<cacheDirectories.size(); ++i) {
+                        long index = -1;
+                        for (std::size_t s=0; s<theme->subdirectories.size() && index < 0; ++s) {
+                            if (theme->subdirectories[s].path == cacheDirectories[i]) {
+                                index = static_cast<long>(s);
+                            }
+                        }
+                        root.cacheSubdirectories.push_back(index);
+                    }
+                    ++cachedRoots;
+                    continue;
+                } catch(std::exception& e) {
+                    root.cache.reset();
+                }
+            }
+            theme->scan(root);
+        }
+
+        span.addAttribute("cached_dirs", cachedRoots);
+        span.addAttribute("scanned_dirs", theme->roots.size() - cachedRoots);
+        slot = std::move(theme);
+        return slot.get();
+    }
+
+    std::string IconLookup::lookupIcon(const Theme& theme, const std::string& iconName, unsigned int size, unsigned int scale) const
+    {
+        // Order of preference is subdirectory, then base directory, then extension, like in Icon Theme Specification.
+        const Image* exact = NULL;
+        const Image* closest = NULL;
+        std::size_t exactRoot = 0, closestRoot = 0;
+        unsigned int minimalDistance = UINT_MAX;
+
+        std::vector<std::vector<Image> > images(theme.roots.size());
+        for (std::size_t r=0; r<theme.roots.size(); ++r) {
+            theme.images(*theme.roots[r], iconName, images[r]);
+            for (std::vector<Image>::const_iterator it = images[r].begin(); it != images[r].end(); ++it) {
+                if (!bestExtension(it->flags) || it->subdirectory >= theme.subdirectories.size()) {
+                    continue;
+                }
+                const Subdirectory& subdir = theme.subdirectories[it->subdirectory];
+                if (directoryMatchesSize(subdir, size, scale)) {
+                    if (!exact || it->subdirectory < exact->subdirectory) {
+                        exact = &*it;
+                        exactRoot = r;
+                    }
+                }
+                const unsigned int distance = directorySizeDistance(subdir, size, scale);
+                if (!closest || distance < minimalDistance || (distance == minimalDistance && it->subdirectory < closest->subdirectory)) {
+                    minimalDistance = distance;
+                    closest = &*it;
+                    closestRoot = r;
+                }
+            }
+        }
+
+        const Image* best = exact ? exact : closest;
+        const std::size_t bestRoot = exact ? exactRoot : closestRoot;
+        if (!best) {
+            return std::string();
+        }
+        return buildPath(buildPath(theme.roots[bestRoot]->path, theme.subdirectories[best->subdirectory].path), iconName + bestExtension(best->flags));
+    }
+
+    std::string IconLookup::findIconHelper(const std::string& themeName, const std::string& iconName, unsigned int size, unsigned int scale,
+                                           std::vector<std::string>& visited)
+    {
+        if (std::find(visited.begin(), visited.end(), themeName) != visited.end()) {
+            return std::string();
+        }
+        visited.push_back(themeName);
+        const Theme* found = theme(themeName);
+        if (!found) {
+            return std::string();
+        }
+        std::string path = lookupIcon(*found, iconName, size, scale);
+        for (std::size_t i=0; path.empty() && i<found->parents.size(); ++i) {
+            path = findIconHelper(found->parents[i], iconName, size, scale, visited);
+        }
+        return path;
+    }
+
+    std::string IconLookup::lookupFallbackIcon(const std::string& iconName) const
+    {
+        const char* const extensions[] = {".png", ".svg", ".xpm"};
+        for (std::vector<std::string>::const_iterator it = _basePaths.begin(); it != _basePaths.end(); ++it) {
+            for (std::size_t i=0; i<sizeof(extensions)/sizeof(extensions[0]); ++i) {
+                const std::string path = buildPath(*it, iconName + extensions[i]);
+                MIMEAPPS_STAT_ADD(AccessCalls, 1);
+                if (::access(path.c_str(), F_OK) == 0) {
+                    return path;
+                }
+            }
+        }
+        return std::string();
+    }
+
+    std::string IconLookup::findIcon(const std::string& iconName, unsigned int size, unsigned int scale)
+    {
+        if (iconName.empty()) {
+            return std::string();
+        }
+        if (isAbsolutePath(iconName)) {
+            MIMEAPPS_STAT_ADD(AccessCalls, 1);
+            return ::access(iconName.c_str(), F_OK) == 0 ? iconName : std::string();
+        }
+
+        std::ostringstream keyStream;
+        keyStream << iconName << '\n' << size << '@' << scale;
+        const std::string key = keyStream.str();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::unordered_map<std::string, std::string>::const_iterator cached = _results.find(key);
+        if (cached != _results.end()) {
+            ++_hits;
+            return cached->second;
+        }
+        ++_misses;
+
+        // Many desktop files give icon name with extension, though specification does not allow it.
+        std::string name = iconName;
+        std::string::size_type dotPos;
+        if (extensionFlag(name, dotPos)) {
+            name.erase(dotPos);
+        }
+
+        std::vector<std::string> visited;
+        std::string path = findIconHelper(_themeName, name, size, scale, visited);
+        if (path.empty()) {
+            path = findIconHelper("hicolor", name, size, scale, visited);
+        }
+        if (path.empty()) {
+            path = lookupFallbackIcon(name);
+        }
+        _results[key] = path;
+        return path;
+    }
+
+    void IconLookup::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _themes.clear();
+        _results.clear();
+        _hits = 0;
+        _misses = 0;
+    }
+
+    std::size_t IconLookup::hits() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+    std::size_t IconLookup::misses() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _misses;
+    }
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Looking up icons in icon themes.
+ */
+
+#ifndef MIMEAPPS_ICONTHEME_H
+#define MIMEAPPS_ICONTHEME_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "basedir.h"
+#include "path.h"
+
+namespace mimeapps
+{
+    /// \brief Base directories of icon themes in order of precedence, as defined by Icon Theme Specification.
+    template<typename OutputIterator>
+    void getIconThemePaths(OutputIterator out)
+    {
+        const char* home = std::getenv("HOME");
+        if (home && *home) {
+            *out = buildPath(home, ".icons");
+        }
+        *out = buildPath(dataHome(), "icons");
+        dataDirs(out, "icons");
+        *out = "/usr/share/pixmaps";
+    }
+
+    /// \brief ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void getIconThemePaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        const char* home = std::getenv("HOME");
+        if (home && *home) {
+            *out = buildPath(home, ".icons");
+        }
+        *out = buildPath(baseDirs.dataHome(), "icons");
+        baseDirs.dataDirs(out, "icons");
+        *out = "/usr/share/pixmaps";
+    }
+
+    /**
+     * \brief Resolves icon names, e.g. from DesktopFile::icon(), to files according to Icon Theme Specification.
+     *
+     * Theme directories are not probed with stat on every lookup. Each theme directory is either served by its
+     * icon-theme.cache mapped into memory, if cache is not older than directory, or scanned once.
+     * Themes are loaded on first use and Inherits chains are followed, with hicolor as the last resort.
+     * Results are cached per icon name and size, so repeated lookups are a single hash probe.
+     * Object can be shared between threads.
+     */
+    struct IconLookup
+    {
+        /// Look up icons in theme from standard locations.
+        explicit IconLookup(const std::string& themeName = "hicolor");
+        /// ditto, but use snapshot of base directories.
+        explicit IconLookup(const BaseDirs& baseDirs, const std::string& themeName = "hicolor");
+        /// Look up icons in theme using given base directories in order of precedence.
+        IconLookup(const std::vector<std::string>& basePaths, const std::string& themeName);
+        ~IconLookup();
+
+        const std::string& themeName() const;
+
+        /**
+         * \brief Find file of icon that fits size best.
+         *
+         * Icon of matching size is preferred, otherwise the closest one is taken. Themes are searched in order:
+         * the selected theme, its parents, hicolor, then unthemed icons in base directories.
+         * Absolute path is returned as is if file exists.
+         * \return path to icon or empty string if icon is not found.
+         */
+        std::string findIcon(const std::string& iconName, unsigned int size, unsigned int scale = 1);
+
+        /// Drop cached themes and lookup results, e.g. after icons were installed.
+        void clear();
+
+        /// Number of findIcon() calls served from cache.
+        std::size_t hits() const;
+        /// Number of findIcon() calls that required lookup in themes.
+        std::size_t misses() const;
+
+    private:
+        IconLookup(const IconLookup&);
+        IconLookup& operator=(const IconLookup&);
+
+        struct Theme;
+
+        const Theme* theme(const std::string& name);
+        std::string lookupIcon(const Theme& theme, const std::string& iconName, unsigned int size, unsigned int scale) const;
+        std::string findIconHelper(const std::string& themeName, const std::string& iconName, unsigned int size, unsigned int scale,
+                                   std::vector<std::string>& visited);
+        std::string lookupFallbackIcon(const std::string& iconName) const;
+
+        std::vector<std::string> _basePaths;
+        std::string _themeName;
+        std::unordered_map<std::string, std::unique_ptr<Theme> > _themes;
+        std::unordered_map<std::string, std::string> _results;
+        std::size_t _hits;
+        std::size_t _misses;
+        mutable std::mutex _mutex;
+    };
+}
+
+#endif
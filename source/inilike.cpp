@@ -7,6 +7,8 @@
 #include <cstddef>
 
 #include "inilike.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace mimeapps
 {
@@ -18,6 +20,11 @@ namespace mimeapps
         return str == "true" || str == "1";
     }
 
+    SearchRequest::SearchRequest(Arena* arena) : _impl(ImplAllocator(ArenaAllocator<char>(arena))),
+        _group(ArenaAllocator<char>(arena)), _key(ArenaAllocator<char>(arena))
+    {
+    }
+
     SearchRequest::Value::Value() : _found(false) {}
 
     bool SearchRequest::Value::found() const {
@@ -35,24 +42,27 @@ namespace mimeapps
 
     static void trimRight(std::string& str)
     {
-        std::string::size_type found = str.find_last_not_of(" \t\n\r\v\f");
-        if (found == std::string::npos) {
-            str.clear();
-        } else {
-            str.erase(found+1);
+        std::string::size_type size = str.size();
+        while(size && details::hasCharClass(str[size-1], details::SpaceChar)) {
+            --size;
         }
+        str.resize(size);
     }
 
     void SearchRequest::addRequest(const std::string& group, const std::string& key)
     {
-        _impl[group][key] = Value();
+        _group.assign(group.data(), group.size());
+        _key.assign(key.data(), key.size());
+        _impl[_group][_key] = Value();
     }
 
     SearchRequest::Value SearchRequest::getValue(const std::string& group, const std::string& key)
     {
-        SearchRequest::Impl::iterator groupIt = _impl.find(group);
+        _group.assign(group.data(), group.size());
+        SearchRequest::Impl::iterator groupIt = _impl.find(_group);
         if (groupIt != _impl.end()) {
-            std::map<std::string, Value>::iterator searchIt = groupIt->second.find(key);
+            _key.assign(key.data(), key.size());
+            Keys::iterator searchIt = groupIt->second.find(_key);
             if (searchIt != groupIt->second.end()) {
                 return searchIt->second;
             }
@@ -60,42 +70,60 @@ namespace mimeapps
         return Value();
     }
 
+    details::LineType details::parseLine(std::string& line, std::string& currentGroup, std::string::size_type& equalPos)
+    {
+        MIMEAPPS_STAT_ADD(LinesParsed, 1);
+        MIMEAPPS_STAT_ADD(BytesRead, line.size() + 1);
+        trimRight(line);
+        if (line.empty() || line[0] == '#') {
+            return SkipLine;
+        }
+
+        if (line[0] == '[') {
+            std::string::iterator closeBracketIt = std::find(line.begin(), line.end(), ']');
+            if (closeBracketIt == line.end()) {
+                throw std::runtime_error("No closing ']' found");
+            }
+            currentGroup = std::string(line.begin() + 1, closeBracketIt);
+            if (currentGroup.empty()) {
+                throw std::runtime_error("Empty group name");
+            }
+            return GroupLine;
+        } else {
+            equalPos = line.find('=');
+            if (equalPos == std::string::npos) {
+                throw std::runtime_error("No '=' found");
+            }
+            if (currentGroup.empty()) {
+                throw std::runtime_error("Key-value pair outside of group");
+            }
+            return KeyValueLine;
+        }
+    }
+
     void SearchRequest::searchKeyValues(std::istream& stream)
     {
+        details::TraceSpan span("search_key_values");
+        unsigned long long lines = 0, bytes = 0;
         std::string line;
         std::string currentGroup;
+        std::string::size_type equalPos;
         while(getline(stream, line)) {
-            trimRight(line);
-            if (line.empty() || line[0] == '#') {
-                continue;
-            }
-
-            if (line[0] == '[') {
-                std::string::iterator closeBracketIt = std::find(line.begin(), line.end(), ']');
-                if (closeBracketIt == line.end()) {
-                    throw std::runtime_error("No closing ']' found");
-                }
-                currentGroup = std::string(line.begin() + 1, closeBracketIt);
-                if (currentGroup.empty()) {
-                    throw std::runtime_error("Empty group name");
-                }
-            } else {
-                std::string::iterator equalIt = std::find(line.begin(), line.end(), '=');
-                if (equalIt == line.end()) {
-                    throw std::runtime_error("No '=' found");
-                }
-                if (currentGroup.empty()) {
-                    throw std::runtime_error("Key-value pair outside of group");
-                }
-                SearchRequest::Impl::iterator groupIt = _impl.find(currentGroup);
+            ++lines;
+            bytes += line.size() + 1;
+            if (details::parseLine(line, currentGroup, equalPos) == details::KeyValueLine) {
+                _group.assign(currentGroup.data(), currentGroup.size());
+                SearchRequest::Impl::iterator groupIt = _impl.find(_group);
                 if (groupIt != _impl.end()) {
-                    std::string key(line.begin(), equalIt);
-                    std::map<std::string, Value>::iterator searchIt = groupIt->second.find(key);
+                    _key.assign(line.data(), equalPos);
+                    Keys::iterator searchIt = groupIt->second.find(_key);
                     if (searchIt != groupIt->second.end()) {
-                        searchIt->second.setValue(unescapeValue(equalIt+1, line.end()));
+                        searchIt->second.setValue(unescapeValue(line.begin() + equalPos + 1, line.end()));
                     }
                 }
             }
         }
+        span.addAttribute("lines", lines);
+        span.addAttribute("bytes", bytes);
     }
 }
@@ -10,16 +10,56 @@
 #ifndef MIMEAPPS_INILIKE_H
 #define MIMEAPPS_INILIKE_H
 
+#include <algorithm>
 #include <string>
 #include <map>
 #include <istream>
 #include <stdexcept>
 
+#include "arena.h"
+#include "chartable.h"
+
 namespace mimeapps
 {
     namespace details {
-        template<typename Iterator, typename PairIterator>
-        std::string doUnescape(const Iterator& first, const Iterator& last, const PairIterator& firstPair, const PairIterator& lastPair)
+        /// Append characters of range to string one by one.
+        template<typename String, typename Iterator>
+        void appendRange(String& str, Iterator first, Iterator last)
+        {
+            for (; first != last; ++first) {
+                str.push_back(*first);
+            }
+        }
+
+        /// Append characters of contiguous range at once.
+        template<typename String>
+        void appendRange(String& str, const char* first, const char* last)
+        {
+            str.append(first, last - first);
+        }
+
+        /// ditto
+        template<typename String>
+        void appendRange(String& str, std::string::const_iterator first, std::string::const_iterator last)
+        {
+            if (first != last) {
+                str.append(&*first, last - first);
+            }
+        }
+
+        /// ditto
+        template<typename String>
+        void appendRange(String& str, std::string::iterator first, std::string::iterator last)
+        {
+            appendRange(str, std::string::const_iterator(first), std::string::const_iterator(last));
+        }
+
+        /**
+         * \brief Replace escape sequences using table of 256 characters that escaped characters stand for.
+         * Backslash followed by character that maps to 0 is left as is.
+         */
+        template<typename Iterator>
+        std::string doUnescape(const Iterator& first, const Iterator& last, const char* escapes)
         {
             //little optimization to avoid executing the algorithm.
             Iterator it = std::find(first, last, '\\');
@@ -28,41 +68,54 @@ namespace mimeapps
             }
 
             std::string toReturn(first, it);
+            toReturn.reserve(last - first);
 
-            for (; it != last; ++it) {
-                if (*it == '\\' && (it+1) != last) {
-                    const char c = *(it+1);
-
-                    bool shouldContinue;
-                    for (PairIterator itPair = firstPair; itPair != lastPair; ++itPair) {
-                        if (c == itPair->first) {
-                            toReturn.push_back(itPair->second);
-                            ++it;
-                            shouldContinue = true;
-                            break;
-                        }
+            while(it != last) {
+                if (*it == '\\') {
+                    const char unescaped = (it+1) != last ? escapes[static_cast<unsigned char>(*(it+1))] : '\0';
+                    if (unescaped) {
+                        toReturn.push_back(unescaped);
+                        it += 2;
+                    } else {
+                        toReturn.push_back(*it);
+                        ++it;
                     }
-                    if (shouldContinue) {
-                        continue;
+                } else {
+                    toReturn.push_back(*it);
+                    ++it;
+                    // Copy the rest of run of ordinary characters at once, unless it's a single character between escapes.
+                    if (it != last && *it != '\\') {
+                        const Iterator next = std::find(it, last, '\\');
+                        appendRange(toReturn, it, next);
+                        it = next;
                     }
                 }
-                toReturn.push_back(*it);
             }
             return toReturn;
         }
+
+        enum LineType
+        {
+            SkipLine,
+            GroupLine,
+            KeyValueLine
+        };
+
+        /**
+         * \brief Parse single line of ini-like file.
+         *
+         * Trailing whitespace is removed from line.
+         * On GroupLine currentGroup is set to the new group name.
+         * On KeyValueLine equalPos is set to position of '=' in line.
+         * \throws std::runtime_error on malformed line.
+         */
+        LineType parseLine(std::string& line, std::string& currentGroup, std::string::size_type& equalPos);
     }
 
     /// Get string value in unescaped form.
     template<typename Iterator>
     std::string unescapeValue(const Iterator& first, const Iterator& last) {
-        const std::pair<char, char> pairs[] = {
-            std::make_pair('s', ' '),
-            std::make_pair('n', '\n'),
-            std::make_pair('r', '\r'),
-            std::make_pair('t', '\t'),
-            std::make_pair('\\', '\\')
-        };
-        return details::doUnescape(first, last, &pairs[0], pairs + 5);
+        return details::doUnescape(first, last, details::ValueEscapeTable::values);
     }
     /// ditto
     std::string unescapeValue(const std::string& str);
@@ -75,6 +128,9 @@ namespace mimeapps
      */
     struct SearchRequest
     {
+        /// \param arena if not NULL, requested groups and keys are allocated from it. It must outlive the request.
+        explicit SearchRequest(Arena* arena = NULL);
+
         struct Value
         {
             Value();
@@ -102,9 +158,36 @@ namespace mimeapps
          */
         void searchKeyValues(std::istream& stream);
     private:
-        typedef std::map<std::string, std::map<std::string, Value> > Impl;
+        typedef std::scoped_allocator_adaptor<ArenaAllocator<std::pair<const ArenaString, Value> > > KeysAllocator;
+        typedef std::map<ArenaString, Value, std::less<ArenaString>, KeysAllocator> Keys;
+        typedef std::scoped_allocator_adaptor<ArenaAllocator<std::pair<const ArenaString, Keys> > > ImplAllocator;
+        typedef std::map<ArenaString, Keys, std::less<ArenaString>, ImplAllocator> Impl;
         Impl _impl;
+        // Reused for lookups, so reading lines does not allocate keys.
+        ArenaString _group;
+        ArenaString _key;
     };
+
+    /**
+     * \brief Read all key-value pairs from stream.
+     *
+     * Unlike SearchRequest it does not filter keys in advance and is suited for reading whole file.
+     * \param handler functor called as handler(group, key, value) for every key-value pair. Value is unescaped.
+     * \throws std::runtime_error on parse error.
+     */
+    template<typename Handler>
+    void readKeyValues(std::istream& stream, Handler handler)
+    {
+        std::string line;
+        std::string currentGroup;
+        std::string::size_type equalPos;
+        while(getline(stream, line)) {
+            if (details::parseLine(line, currentGroup, equalPos) == details::KeyValueLine) {
+                const std::string key(line, 0, equalPos);
+                handler(currentGroup, key, unescapeValue(line.begin() + equalPos + 1, line.end()));
+            }
+        }
+    }
 }
 
 #endif
@@ -0,0 +1,661 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "lookupdaemon.h"
+#include "path.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        /// How long a connected peer may take to send or receive a whole frame.
+        const int ioTimeoutMilliseconds = 1000;
+        /// Bytes read from one connection per poll round, so busy client can't starve others.
+        const std::size_t readChunkSize = 65536;
+
+        void appendCard16(std::string& data, std::size_t value)
+        {
+            data += static_cast<char>((value >> 8) & 0xff);
+            data += static_cast<char>(value & 0xff);
+        }
+
+        void appendCard32(std::string& data, std::size_t value)
+        {
+            appendCard16(data, (value >> 16) & 0xffff);
+            appendCard16(data, value & 0xffff);
+        }
+
+        bool readCard16(const std::string& data, std::size_t& pos, std::size_t& value)
+        {
+            if (data.size() - pos < 2 || pos > data.size()) {
+                return false;
+            }
+            value = (static_cast<std::size_t>(static_cast<unsigned char>(data[pos])) << 8) | static_cast<unsigned char>(data[pos+1]);
+            pos += 2;
+            return true;
+        }
+
+        bool readCard32(const std::string& data, std::size_t& pos, std::size_t& value)
+        {
+            std::size_t high, low;
+            if (!readCard16(data, pos, high) || !readCard16(data, pos, low)) {
+                return false;
+            }
+            value = (high << 16) | low;
+            return true;
+        }
+
+        /// Strings longer than 65535 bytes are not valid MIME types, desktop ids or paths, so they are cut.
+        void appendString(std::string& data, const std::string& str)
+        {
+            const std::size_t length = str.size() < 0xffff ? str.size() : 0xffff;
+            appendCard16(data, length);
+            data.append(str, 0, length);
+        }
+
+        bool readString(const std::string& data, std::size_t& pos, std::string& str)
+        {
+            std::size_t length;
+            if (!readCard16(data, pos, length) || data.size() - pos < length) {
+                return false;
+            }
+            str.assign(data, pos, length);
+            pos += length;
+            return true;
+        }
+
+        bool writeAll(int fd, const char* data, std::size_t size)
+        {
+            while(size) {
+                const ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                data += written;
+                size -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+
+        bool readAll(int fd, char* data, std::size_t size)
+        {
+            while(size) {
+                const ssize_t got = ::recv(fd, data, size, 0);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    return false;
+                }
+                data += got;
+                size -= static_cast<std::size_t>(got);
+            }
+            return true;
+        }
+
+        bool writeFrame(int fd, const std::string& payload)
+        {
+            std::string frame;
+            frame.reserve(payload.size() + 4);
+            appendCard32(frame, payload.size());
+            frame += payload;
+            return writeAll(fd, frame.data(), frame.size());
+        }
+
+        bool readFrame(int fd, std::string& payload)
+        {
+            char header[4];
+            if (!readAll(fd, header, sizeof(header))) {
+                return false;
+            }
+            std::size_t pos = 0, size = 0;
+            readCard32(std::string(header, sizeof(header)), pos, size);
+            if (size > details::MaxLookupFrameSize) {
+                return false;
+            }
+            payload.resize(size);
+            return size == 0 || readAll(fd, &payload[0], size);
+        }
+
+        /// Client connection of daemon. Sockets are non-blocking, frames are assembled from whatever recv() gives.
+        struct Connection
+        {
+            Connection() : fd(-1), pending(false), closeAfterWrite(false) {}
+
+            int fd;
+            std::string input;
+            std::string output;
+            // Whether deadline applies, i.e. request is partially read or response is partially written.
+            bool pending;
+            std::chrono::steady_clock::time_point deadline;
+            // Malformed request was answered, connection is closed once response is sent.
+            bool closeAfterWrite;
+        };
+
+        /// Read what's available without blocking. Returns false if peer closed connection or error occurred.
+        bool readAvailable(Connection& connection)
+        {
+            std::size_t total = 0;
+            while(total < readChunkSize) {
+                const std::size_t oldSize = connection.input.size();
+                connection.input.resize(oldSize + 4096);
+                const ssize_t got = ::recv(connection.fd, &connection.input[oldSize], 4096, 0);
+                connection.input.resize(oldSize + (got > 0 ? static_cast<std::size_t>(got) : 0));
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return true;
+                }
+                if (got <= 0) {
+                    return false;
+                }
+                total += static_cast<std::size_t>(got);
+            }
+            return true;
+        }
+
+        /// Write what socket accepts without blocking. Returns false on error.
+        bool writeAvailable(Connection& connection)
+        {
+            while(!connection.output.empty()) {
+                const ssize_t written = ::send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written < 0) {
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                connection.output.erase(0, static_cast<std::size_t>(written));
+            }
+            return true;
+        }
+
+        /**
+         * \brief Take complete frame from the start of buffer.
+         * \return false if buffer does not contain complete frame yet.
+         * \param tooBig set to true if frame size exceeds the limit, it will never be complete then.
+         */
+        bool takeFrame(std::string& buffer, std::string& payload, bool& tooBig)
+        {
+            std::size_t pos = 0, size = 0;
+            if (!readCard32(buffer, pos, size)) {
+                return false;
+            }
+            tooBig = size > details::MaxLookupFrameSize;
+            if (tooBig || buffer.size() - pos < size) {
+                return false;
+            }
+            payload.assign(buffer, pos, size);
+            buffer.erase(0, pos + size);
+            return true;
+        }
+
+        void setTimeouts(int fd)
+        {
+            struct timeval timeout;
+            timeout.tv_sec = ioTimeoutMilliseconds / 1000;
+            timeout.tv_usec = (ioTimeoutMilliseconds % 1000) * 1000;
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+
+        bool makeAddress(const std::string& socketPath, struct sockaddr_un& address)
+        {
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (socketPath.size() >= sizeof(address.sun_path)) {
+                return false;
+            }
+            std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+            return true;
+        }
+
+        /// Whether process on the other end of connected socket runs as the same user.
+        bool isPeerTrusted(int fd)
+        {
+            struct ucred credentials;
+            socklen_t length = sizeof(credentials);
+            return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && length == sizeof(credentials) &&
+                credentials.uid == ::geteuid();
+        }
+
+        /// Connect to daemon socket. Returns -1 on failure or if daemon runs as another user.
+        int connectTo(const std::string& socketPath)
+        {
+            struct sockaddr_un address;
+            if (!makeAddress(socketPath, address)) {
+                return -1;
+            }
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd == -1) {
+                return -1;
+            }
+            // Socket path may be predictable, e.g. in /tmp, so answers of other users' processes are not trusted.
+            if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || !isPeerTrusted(fd)) {
+                ::close(fd);
+                return -1;
+            }
+            setTimeouts(fd);
+            return fd;
+        }
+
+        long long modificationTime(const std::string& path)
+        {
+            struct stat st;
+            MIMEAPPS_STAT_ADD(StatCalls, 1);
+            if (::stat(path.c_str(), &st) != 0) {
+                return -1;
+            }
+            return static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        }
+    }
+
+    std::string lookupSocketPath()
+    {
+        const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+        if (runtimeDir && isAbsolutePath(runtimeDir)) {
+            return buildPath(runtimeDir, "mimeapps.socket");
+        }
+        std::ostringstream stream;
+        stream << "/tmp/mimeapps-" << ::getuid() << ".socket";
+        return stream.str();
+    }
+
+    std::string details::encodeLookupRequest(LookupRequestType type, const std::string& mimeType)
+    {
+        std::string payload;
+        payload += static_cast<char>(LookupProtocolVersion);
+        payload += static_cast<char>(type);
+        appendString(payload, mimeType);
+        return payload;
+    }
+
+    bool details::decodeLookupRequest(const std::string& payload, LookupRequestType& type, std::string& mimeType)
+    {
+        if (payload.size() < 2 || static_cast<unsigned char>(payload[0]) != LookupProtocolVersion) {
+            return false;
+        }
+        const unsigned char typeByte = static_cast<unsigned char>(payload[1]);
+        if (typeByte < FindDefaultApplicationRequest || typeByte > FindAssociatedApplicationsRequest) {
+            return false;
+        }
+        type = static_cast<LookupRequestType>(typeByte);
+        std::size_t pos = 2;
+        return readString(payload, pos, mimeType) && pos == payload.size();
+    }
+
+    std::string details::encodeLookupResponse(bool success, const std::vector<LookupItem>& items)
+    {
+        std::string payload;
+        payload += static_cast<char>(success ? 0 : 1);
+        appendCard32(payload, success ? items.size() : 0);
+        if (success) {
+            for (std::vector<LookupItem>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                appendString(payload, it->first);
+                appendString(payload, it->second);
+            }
+        }
+        return payload;
+    }
+
+    bool details::decodeLookupResponse(const std::string& payload, std::vector<LookupItem>& items)
+    {
+        items.clear();
+        std::size_t pos = 1, count = 0;
+        if (payload.empty() || payload[0] != 0 || !readCard32(payload, pos, count)) {
+            return false;
+        }
+        // Each item takes at least 4 bytes, so bogus count does not make us allocate much.
+        if (count > (payload.size() - pos) / 4) {
+            return false;
+        }
+        items.resize(count);
+        for (std::size_t i=0; i<count; ++i) {
+            if (!readString(payload, pos, items[i].first) || !readString(payload, pos, items[i].second)) {
+                items.clear();
+                return false;
+            }
+        }
+        return pos == payload.size();
+    }
+
+    LookupServer::LookupServer(const std::string& socketPath) : _socketPath(socketPath), _fd(-1), _lastCheck(0), _requestCount(0)
+    {
+        _stopPipe[0] = _stopPipe[1] = -1;
+
+        struct sockaddr_un address;
+        if (!makeAddress(_socketPath, address)) {
+            throw std::runtime_error("Socket path is too long: " + _socketPath);
+        }
+        struct stat st;
+        if (::lstat(_socketPath.c_str(), &st) == 0 && st.st_uid != ::geteuid()) {
+            throw std::runtime_error("Socket path is owned by another user: " + _socketPath);
+        }
+        // Socket file may be left by daemon that was killed. Remove it only if nobody is listening.
+        int existing = connectTo(_socketPath);
+        if (existing != -1) {
+            ::close(existing);
+            throw std::runtime_error("Lookup daemon is already running on " + _socketPath);
+        }
+        ::unlink(_socketPath.c_str());
+
+        _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_fd == -1) {
+            throw std::runtime_error(std::string("Could not create socket: ") + std::strerror(errno));
+        }
+        const mode_t oldMask = ::umask(0077);
+        const int bound = ::bind(_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        ::umask(oldMask);
+        if (bound != 0 || ::listen(_fd, 64) != 0 || ::pipe2(_stopPipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+            const std::string error = std::strerror(errno);
+            ::close(_fd);
+            if (_stopPipe[0] != -1) {
+                ::close(_stopPipe[0]);
+                ::close(_stopPipe[1]);
+            }
+            throw std::runtime_error("Could not listen on " + _socketPath + ": " + error);
+        }
+
+        details::AssociationPaths paths;
+        _watchedPaths = paths.mimeAppsList;
+        _watchedPaths.insert(_watchedPaths.end(), paths.mimeInfoCache.begin(), paths.mimeInfoCache.end());
+        std::vector<std::string> mimePaths;
+        getMimePaths(std::back_inserter(mimePaths));
+        for (std::vector<std::string>::const_iterator it = mimePaths.begin(); it != mimePaths.end(); ++it) {
+            _watchedPaths.push_back(buildPath(*it, "aliases"));
+            _watchedPaths.push_back(buildPath(*it, "subclasses"));
+        }
+        load();
+    }
+
+    LookupServer::~LookupServer()
+    {
+        ::close(_fd);
+        ::close(_stopPipe[0]);
+        ::close(_stopPipe[1]);
+        ::unlink(_socketPath.c_str());
+    }
+
+    const std::string& LookupServer::socketPath() const
+    {
+        return _socketPath;
+    }
+
+    std::size_t LookupServer::requestCount() const
+    {
+        return _requestCount;
+    }
+
+    void LookupServer::stop()
+    {
+        const char byte = 0;
+        // Only write is used, so it's safe to call from signal handler.
+        ssize_t result = ::write(_stopPipe[1], &byte, 1);
+        (void)result;
+    }
+
+    void LookupServer::load()
+    {
+        _watchedTimes.clear();
+        for (std::vector<std::string>::const_iterator it = _watchedPaths.begin(); it != _watchedPaths.end(); ++it) {
+            _watchedTimes.push_back(modificationTime(*it));
+        }
+        _index.clear();
+        _index.load();
+        _hierarchy.clear();
+        _hierarchy.load();
+        _lastCheck = std::time(NULL);
+    }
+
+    void LookupServer::reloadIfChanged()
+    {
+        const std::time_t now = std::time(NULL);
+        if (now == _lastCheck) {
+            return;
+        }
+        _lastCheck = now;
+        for (std::size_t i=0; i<_watchedPaths.size(); ++i) {
+            if (modificationTime(_watchedPaths[i]) != _watchedTimes[i]) {
+                load();
+                return;
+            }
+        }
+    }
+
+    void LookupServer::answer(details::LookupRequestType type, const std::string& mimeType, std::vector<details::LookupItem>& items)
+    {
+        details::AssociationMerger merger;
+        std::vector<std::string> desktopIds;
+        switch(type) {
+            case details::FindDefaultApplicationRequest:
+            {
+                std::string desktopId;
+                DesktopFile file = findDefaultApplication(_index, _hierarchy, mimeType, &desktopId, &_cache);
+                if (file.isValid()) {
+                    items.push_back(details::LookupItem(desktopId, file.fileName().str()));
+                }
+                break;
+            }
+            case details::ListAssociatedApplicationsRequest:
+                _index.associatedApplications(mimeType, merger, std::back_inserter(desktopIds));
+                break;
+            case details::ListDefaultApplicationsRequest:
+                _index.defaultApplications(mimeType, merger, std::back_inserter(desktopIds));
+                break;
+            case details::FindAssociatedApplicationsRequest:
+            {
+                std::vector<DesktopFile> files;
+                findAssociatedApplications(_index, _hierarchy, mimeType, std::back_inserter(files), &_cache);
+                for (std::vector<DesktopFile>::const_iterator it = files.begin(); it != files.end(); ++it) {
+                    items.push_back(details::LookupItem(std::string(), it->fileName().str()));
+                }
+                break;
+            }
+        }
+        for (std::vector<std::string>::const_iterator it = desktopIds.begin(); it != desktopIds.end(); ++it) {
+            items.push_back(details::LookupItem(*it, std::string()));
+        }
+    }
+
+    bool LookupServer::serve(const std::string& payload, std::string& response)
+    {
+        details::TraceSpan span("serve_lookup");
+        details::LookupRequestType type;
+        std::string mimeType;
+        std::vector<details::LookupItem> items;
+        bool success = details::decodeLookupRequest(payload, type, mimeType);
+        if (success) {
+            span.addAttribute("mime_type", mimeType);
+            try {
+                reloadIfChanged();
+                answer(type, mimeType, items);
+            } catch(std::exception& e) {
+                success = false;
+            }
+        }
+        span.addAttribute("items", items.size());
+        ++_requestCount;
+        const std::string responsePayload = details::encodeLookupResponse(success, items);
+        appendCard32(response, responsePayload.size());
+        response += responsePayload;
+        return success;
+    }
+
+    void LookupServer::run()
+    {
+        typedef std::chrono::steady_clock Clock;
+        std::vector<Connection> connections;
+        std::vector<struct pollfd> fds;
+
+        while(true) {
+            // Wake up in time to drop connections that don't finish their frames.
+            int timeout = -1;
+            const Clock::time_point now = Clock::now();
+            fds.resize(2 + connections.size());
+            fds[0].fd = _stopPipe[0];
+            fds[0].events = POLLIN;
+            fds[1].fd = _fd;
+            fds[1].events = POLLIN;
+            for (std::size_t i=0; i<connections.size(); ++i) {
+                fds[i+2].fd = connections[i].fd;
+                // Next request is not read until response to previous one is sent.
+                fds[i+2].events = connections[i].output.empty() ? POLLIN : POLLOUT;
+                if (connections[i].pending) {
+                    const long long left = std::chrono::duration_cast<std::chrono::milliseconds>(connections[i].deadline - now).count() + 1;
+                    const int leftMilliseconds = left < 0 ? 0 : static_cast<int>(left);
+                    timeout = timeout < 0 || leftMilliseconds < timeout ? leftMilliseconds : timeout;
+                }
+            }
+            for (std::size_t i=0; i<fds.size(); ++i) {
+                fds[i].revents = 0;
+            }
+            if (::poll(&fds[0], fds.size(), timeout) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[0].revents) {
+                char buffer[16];
+                while(::read(_stopPipe[0], buffer, sizeof(buffer)) > 0) {}
+                break;
+            }
+
+            const Clock::time_point current = Clock::now();
+            // Backwards, so erasing connection does not shift ones not yet visited.
+            for (std::size_t i=connections.size(); i-- > 0;) {
+                Connection& connection = connections[i];
+                const short revents = fds[i+2].revents;
+                bool keep = true;
+                bool progress = false;
+                if (revents & POLLOUT) {
+                    keep = writeAvailable(connection);
+                    progress = connection.output.empty();
+                } else if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                    keep = readAvailable(connection);
+                    std::string payload;
+                    bool tooBig = false;
+                    while(keep && takeFrame(connection.input, payload, tooBig)) {
+                        progress = true;
+                        if (!serve(payload, connection.output)) {
+                            connection.closeAfterWrite = true;
+                            connection.input.clear();
+                            break;
+                        }
+                    }
+                    keep = keep && !tooBig && writeAvailable(connection);
+                } else if (revents) {
+                    keep = false;
+                }
+
+                if (progress) {
+                    connection.pending = false;
+                }
+                if (!connection.input.empty() || !connection.output.empty()) {
+                    if (!connection.pending) {
+                        connection.pending = true;
+                        connection.deadline = current + std::chrono::milliseconds(ioTimeoutMilliseconds);
+                    } else if (current >= connection.deadline) {
+                        keep = false;
+                    }
+                } else {
+                    connection.pending = false;
+                    keep = keep && !connection.closeAfterWrite;
+                }
+
+                if (!keep) {
+                    ::close(connection.fd);
+                    connections.erase(connections.begin() + i);
+                }
+            }
+
+            if (fds[1].revents & POLLIN) {
+                int client = ::accept4(_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+                if (client != -1) {
+                    Connection connection;
+                    connection.fd = client;
+                    connections.push_back(connection);
+                }
+            }
+        }
+
+        for (std::size_t i=0; i<connections.size(); ++i) {
+            ::close(connections[i].fd);
+        }
+    }
+
+    LookupClient::LookupClient(const std::string& socketPath) : _socketPath(socketPath), _fd(-1), _usedDaemon(false)
+    {
+    }
+
+    LookupClient::~LookupClient()
+    {
+        disconnect();
+    }
+
+    bool LookupClient::usedDaemon() const
+    {
+        return _usedDaemon;
+    }
+
+    void LookupClient::disconnect()
+    {
+        if (_fd != -1) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    bool LookupClient::request(details::LookupRequestType type, const std::string& mimeType, std::vector<details::LookupItem>& items)
+    {
+        _usedDaemon = false;
+        const std::string request = details::encodeLookupRequest(type, mimeType);
+        // Daemon may have closed idle connection or restarted, so retry once with new connection.
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (_fd == -1) {
+                _fd = connectTo(_socketPath);
+                if (_fd == -1) {
+                    return false;
+                }
+            }
+            std::string response;
+            if (writeFrame(_fd, request) && readFrame(_fd, response)) {
+                _usedDaemon = details::decodeLookupResponse(response, items);
+                return _usedDaemon;
+            }
+            disconnect();
+        }
+        return false;
+    }
+
+    DesktopFile LookupClient::findDefaultApplication(const std::string& mimeType)
+    {
+        std::vector<details::LookupItem> items;
+        if (request(details::FindDefaultApplicationRequest, mimeType, items)) {
+            return items.empty() ? DesktopFile() : DesktopFile(items[0].second);
+        }
+        return mimeapps::findDefaultApplication(mimeType);
+    }
+}
@@ -0,0 +1,191 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Lookup daemon keeping association index warm and its client.
+ */
+
+#ifndef MIMEAPPS_LOOKUPDAEMON_H
+#define MIMEAPPS_LOOKUPDAEMON_H
+
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "associationindex.h"
+#include "desktopfilecache.h"
+#include "mimeapps.h"
+#include "mimehierarchy.h"
+
+namespace mimeapps
+{
+    /// Default path of lookup daemon socket: $XDG_RUNTIME_DIR/mimeapps.socket or /tmp/mimeapps-<uid>.socket if runtime directory is not set.
+    std::string lookupSocketPath();
+
+    namespace details {
+        /// Kinds of lookup daemon requests.
+        enum LookupRequestType
+        {
+            FindDefaultApplicationRequest = 1,
+            ListAssociatedApplicationsRequest,
+            ListDefaultApplicationsRequest,
+            FindAssociatedApplicationsRequest
+        };
+
+        /// Found application: desktop id and path of desktop file. Either may be empty depending on request.
+        typedef std::pair<std::string, std::string> LookupItem;
+
+        /**
+         * Protocol is a sequence of frames, each is big-endian 32-bit payload size followed by payload.
+         * Request payload is version byte, request type byte and MIME type.
+         * Response payload is status byte (0 on success), 32-bit item count and items.
+         * Strings are encoded as big-endian 16-bit length followed by characters.
+         */
+        const unsigned char LookupProtocolVersion = 1;
+        /// Frames bigger than this are considered garbage.
+        const std::size_t MaxLookupFrameSize = 1 << 20;
+
+        std::string encodeLookupRequest(LookupRequestType type, const std::string& mimeType);
+        /// Returns false if payload is malformed.
+        bool decodeLookupRequest(const std::string& payload, LookupRequestType& type, std::string& mimeType);
+        std::string encodeLookupResponse(bool success, const std::vector<LookupItem>& items);
+        /// Returns false if payload is malformed or daemon reported failure.
+        bool decodeLookupResponse(const std::string& payload, std::vector<LookupItem>& items);
+    }
+
+    /**
+     * \brief Daemon answering lookups over AF_UNIX socket from warm association index and desktop file cache.
+     *
+     * Association files are checked for changes at most once per second and reloaded when needed,
+     * so short-lived clients get fresh results without parsing anything themselves.
+     * Requests are served one at a time by the thread calling run(). Sockets are never read or written in blocking mode,
+     * so slow client does not delay others. Client that does not send whole request or read whole response
+     * within a second is disconnected.
+     *
+     * Lookups use environment of the daemon: its XDG base directories and XDG_CURRENT_DESKTOP.
+     */
+    struct LookupServer
+    {
+        /**
+         * \brief Bind socket and load index from standard locations.
+         * Stale socket file left by crashed daemon is replaced.
+         * \throws std::runtime_error if socket can't be created, another daemon is listening on it
+         * or socket path is owned by another user.
+         */
+        explicit LookupServer(const std::string& socketPath = lookupSocketPath());
+        /// Close and remove socket.
+        ~LookupServer();
+
+        const std::string& socketPath() const;
+
+        /// Serve requests until stop() is called.
+        void run();
+
+        /// Make run() return. Can be called from another thread or signal handler.
+        void stop();
+
+        /// Number of requests answered so far.
+        std::size_t requestCount() const;
+
+    private:
+        LookupServer(const LookupServer&);
+        LookupServer& operator=(const LookupServer&);
+
+        void load();
+        void reloadIfChanged();
+        /// Append response frame for request payload. Returns false if request is malformed or lookup failed.
+        bool serve(const std::string& payload, std::string& response);
+        void answer(details::LookupRequestType type, const std::string& mimeType, std::vector<details::LookupItem>& items);
+
+        std::string _socketPath;
+        int _fd;
+        int _stopPipe[2];
+        AssociationIndex _index;
+        MimeHierarchy _hierarchy;
+        DesktopFileCache _cache;
+        // Modification times of association files, to notice changes.
+        std::vector<std::string> _watchedPaths;
+        std::vector<long long> _watchedTimes;
+        std::time_t _lastCheck;
+        std::atomic<std::size_t> _requestCount;
+    };
+
+    /**
+     * \brief Client of LookupServer with the same lookups as free functions.
+     *
+     * If daemon is not running or fails to answer, lookup is done in-process, so results are available either way.
+     * Connection is opened on first request and reused. Client is not thread-safe.
+     * Daemon is used only if it runs as the same user, since its answers name desktop files to launch.
+     * \note Daemon answers using its own environment, not the client's one. Results differ from in-process lookups
+     * if client has different XDG_CONFIG_HOME, XDG_DATA_HOME, XDG_CONFIG_DIRS, XDG_DATA_DIRS or XDG_CURRENT_DESKTOP,
+     * so such clients should use separate daemon (e.g. started with the same environment on its own socket).
+     */
+    struct LookupClient
+    {
+        explicit LookupClient(const std::string& socketPath = lookupSocketPath());
+        ~LookupClient();
+
+        /// Whether the last lookup was answered by daemon.
+        bool usedDaemon() const;
+
+        /// \sa mimeapps::findDefaultApplication()
+        DesktopFile findDefaultApplication(const std::string& mimeType);
+
+        /// \sa mimeapps::listAssociatedApplications()
+        template<typename OutputIterator>
+        void listAssociatedApplications(const std::string& mimeType, OutputIterator out) {
+            std::vector<details::LookupItem> items;
+            if (request(details::ListAssociatedApplicationsRequest, mimeType, items)) {
+                for (std::vector<details::LookupItem>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                    *out = it->first;
+                }
+            } else {
+                mimeapps::listAssociatedApplications(mimeType, out);
+            }
+        }
+
+        /// \sa mimeapps::listDefaultApplications()
+        template<typename OutputIterator>
+        void listDefaultApplications(const std::string& mimeType, OutputIterator out) {
+            std::vector<details::LookupItem> items;
+            if (request(details::ListDefaultApplicationsRequest, mimeType, items)) {
+                for (std::vector<details::LookupItem>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                    *out = it->first;
+                }
+            } else {
+                mimeapps::listDefaultApplications(mimeType, out);
+            }
+        }
+
+        /// \sa mimeapps::findAssociatedApplications()
+        template<typename OutputIterator>
+        void findAssociatedApplications(const std::string& mimeType, OutputIterator out) {
+            std::vector<details::LookupItem> items;
+            if (request(details::FindAssociatedApplicationsRequest, mimeType, items)) {
+                for (std::vector<details::LookupItem>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                    *out = DesktopFile(it->second);
+                }
+            } else {
+                mimeapps::findAssociatedApplications(mimeType, out);
+            }
+        }
+
+    private:
+        LookupClient(const LookupClient&);
+        LookupClient& operator=(const LookupClient&);
+
+        bool request(details::LookupRequestType type, const std::string& mimeType, std::vector<details::LookupItem>& items);
+        void disconnect();
+
+        std::string _socketPath;
+        int _fd;
+        bool _usedDaemon;
+    };
+}
+
+#endif
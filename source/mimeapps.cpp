@@ -0,0 +1,336 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <cstdlib>
+#include <cstring>
+
+#include "mimeapps.h"
+
+namespace mimeapps
+{
+    details::AssociationPaths::AssociationPaths()
+    {
+        getMimeAppsListPaths(std::back_inserter(mimeAppsList));
+        getMimeInfoCachePaths(std::back_inserter(mimeInfoCache));
+        getApplicationsPaths(std::back_inserter(applications));
+    }
+
+    details::AssociationPaths::AssociationPaths(const BaseDirs& baseDirs)
+    {
+        getMimeAppsListPaths(baseDirs, std::back_inserter(mimeAppsList));
+        getMimeInfoCachePaths(baseDirs, std::back_inserter(mimeInfoCache));
+        getApplicationsPaths(baseDirs, std::back_inserter(applications));
+    }
+
+    void details::removeDesktopIds(const std::string& value, AssociationMerger& merger)
+    {
+        typedef Splitter<std::string::const_iterator> SplitterType;
+        SplitterType splitter(value.begin(), value.end(), ';');
+        std::string desktopId;
+        for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+            desktopId.assign(it->first, it->second);
+            merger.remove(desktopId);
+        }
+    }
+
+    std::vector<std::string> details::readMimeTypeValues(const std::vector<std::string>& paths, const char* group, const std::vector<std::string>& mimeTypes,
+                                                         Arena* arena)
+    {
+        std::vector<std::string> values(paths.size() * mimeTypes.size());
+        for (std::size_t f = 0; f < paths.size(); ++f) {
+            try {
+                details::TraceSpan span(std::strcmp(group, "MIME Cache") == 0 ? "parse_mimeinfo_cache" : "parse_mimeapps_list");
+                span.addAttribute("path", paths[f]);
+                std::ifstream stream(paths[f].c_str());
+                if (stream.is_open()) {
+                    MIMEAPPS_STAT_ADD(FilesOpened, 1);
+                    SearchRequest request(arena);
+                    for (std::size_t t = 0; t < mimeTypes.size(); ++t) {
+                        request.addRequest(group, mimeTypes[t]);
+                    }
+                    request.searchKeyValues(stream);
+                    for (std::size_t t = 0; t < mimeTypes.size(); ++t) {
+                        values[f * mimeTypes.size() + t] = request.getValue(group, mimeTypes[t]).value();
+                    }
+                }
+            } catch(std::exception& e) {
+
+            }
+        }
+        return values;
+    }
+
+    bool details::isDesktopFileOk(const DesktopFile& file, Arena* arena) {
+        if (file.isValid() && !file.hidden()) {
+            // Cheap checks go first, so rejected entries don't cost Exec parsing and PATH probing.
+            const char* desktops = std::getenv("XDG_CURRENT_DESKTOP");
+            if (!file.isShownIn(desktops ? StringRef(desktops) : StringRef())) {
+                return false;
+            }
+            const StringRef tryExec = file.tryExecValue();
+            if (!tryExec.empty() && ExecutableCache::global().find(tryExec.str()).empty()) {
+                return false;
+            }
+            Arena localArena;
+            Arena& usedArena = arena ? *arena : localArena;
+            const ArenaAllocator<char> allocator(&usedArena);
+            ArenaStringVector args(allocator);
+            const StringRef exec = file.execValue();
+            doUnquoteExec(exec.begin(), exec.end(), std::back_inserter(args), ArenaString(allocator));
+            if (!args.empty() && !findExecutable(StringRef(args[0].c_str(), args[0].size()), usedArena).empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void details::splitDesktopIds(const std::string& value, std::vector<std::string>& desktopIds)
+    {
+        typedef Splitter<std::string::const_iterator> SplitterType;
+        desktopIds.clear();
+        SplitterType splitter(value.begin(), value.end(), ';');
+        for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+            if (it->first != it->second) {
+                desktopIds.push_back(std::string(it->first, it->second));
+            }
+        }
+    }
+
+    DesktopFile details::loadDesktopFile(const std::string& path, DesktopFileCache* cache, Arena* arena)
+    {
+        return cache ? cache->get(path) : DesktopFile(path, arena);
+    }
+
+    DesktopFile details::findFirstDesktopFile(const std::vector<std::string>& applicationsPaths, const std::vector<std::string>& desktopIds,
+                                              std::string* desktopId, DesktopFileCache* cache, Arena* arena)
+    {
+        for (std::vector<std::string>::const_iterator it = desktopIds.begin(); it != desktopIds.end(); ++it) {
+            try {
+                std::string desktopFilePath = findDesktopFile(applicationsPaths.begin(), applicationsPaths.end(), *it, arena);
+                if (!desktopFilePath.empty()) {
+                    DesktopFile file = loadDesktopFile(desktopFilePath, cache, arena);
+                    if (isDesktopFileOk(file, arena)) {
+                        if (desktopId) {
+                            *desktopId = *it;
+                        }
+                        return file;
+                    }
+                }
+            } catch(std::exception& e) {
+
+            }
+        }
+        return DesktopFile();
+    }
+
+    DesktopFile details::findFirstDefaultApplication(const AssociationPaths& paths, const std::vector<std::string>& mimeTypes,
+                                                     std::string* desktopId, Arena* arena)
+    {
+        const std::vector<std::string>& mimeAppsListPaths = paths.mimeAppsList;
+
+        // Values of each file for all MIME types, filled as files are read.
+        std::vector<std::vector<std::string> > defaults;
+        AssociationMerger merger(arena);
+        std::vector<std::string> candidates;
+        for (std::size_t t = 0; t < mimeTypes.size(); ++t) {
+            for (std::size_t f = 0; f < mimeAppsListPaths.size(); ++f) {
+                if (f == defaults.size()) {
+                    defaults.push_back(readMimeTypeValues(std::vector<std::string>(1, mimeAppsListPaths[f]), "Default Applications", mimeTypes, arena));
+                }
+                candidates.clear();
+                mergeDesktopIds(defaults[f][t], merger, std::back_inserter(candidates));
+                DesktopFile file = findFirstDesktopFile(paths.applications, candidates, desktopId, NULL, arena);
+                if (file.isValid()) {
+                    return file;
+                }
+            }
+        }
+        return DesktopFile();
+    }
+
+    DesktopFile details::findDefaultApplication(const AssociationPaths& paths, const MimeHierarchy& hierarchy, const std::string& mimeType)
+    {
+        std::vector<std::string> mimeTypes, desktopIds;
+        hierarchy.ancestors(mimeType, std::back_inserter(mimeTypes));
+
+        Arena arena;
+        DesktopFile file = findFirstDefaultApplication(paths, mimeTypes, NULL, &arena);
+        if (file.isValid()) {
+            return file;
+        }
+
+        AssociationMerger merger(&arena);
+        listAssociatedApplications(paths, mimeTypes.begin(), mimeTypes.end(), merger, std::back_inserter(desktopIds));
+        return findFirstDesktopFile(paths.applications, desktopIds, NULL, NULL, &arena);
+    }
+
+    DesktopFile findDefaultApplication(const std::string& mimeType)
+    {
+        MIMEAPPS_STAT_TIMER(FindDefaultApplicationCall);
+        const details::AssociationPaths paths;
+        // Exact type usually has default of its own, then MIME hierarchy is not read at all.
+        DesktopFile file = details::findFirstDefaultApplication(paths, std::vector<std::string>(1, mimeType));
+        if (file.isValid()) {
+            return file;
+        }
+        MimeHierarchy hierarchy;
+        hierarchy.load();
+        return details::findDefaultApplication(paths, hierarchy, mimeType);
+    }
+
+    DesktopFile findDefaultApplication(const BaseDirs& baseDirs, const std::string& mimeType)
+    {
+        MIMEAPPS_STAT_TIMER(FindDefaultApplicationCall);
+        const details::AssociationPaths paths(baseDirs);
+        DesktopFile file = details::findFirstDefaultApplication(paths, std::vector<std::string>(1, mimeType));
+        if (file.isValid()) {
+            return file;
+        }
+        MimeHierarchy hierarchy;
+        hierarchy.load(baseDirs);
+        return details::findDefaultApplication(paths, hierarchy, mimeType);
+    }
+
+    DesktopFile findDefaultApplication(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType,
+                                       std::string* desktopId, DesktopFileCache* cache, const BaseDirs* baseDirs)
+    {
+        MIMEAPPS_STAT_TIMER(FindDefaultApplicationCall);
+        std::vector<std::string> applicationsPaths, mimeTypes, candidates, desktopIds;
+        if (baseDirs) {
+            getApplicationsPaths(*baseDirs, std::back_inserter(applicationsPaths));
+        } else {
+            getApplicationsPaths(std::back_inserter(applicationsPaths));
+        }
+
+        // Check defaults type by type, so candidates of less specific types are not collected if more specific type has one.
+        hierarchy.ancestors(mimeType, std::back_inserter(mimeTypes));
+        Arena arena;
+        details::AssociationMerger merger(&arena);
+        for (std::vector<std::string>::const_iterator it = mimeTypes.begin(); it != mimeTypes.end(); ++it) {
+            candidates.clear();
+            index.defaultApplications(*it, merger, std::back_inserter(candidates));
+            DesktopFile file = details::findFirstDesktopFile(applicationsPaths, candidates, desktopId, cache, &arena);
+            if (file.isValid()) {
+                return file;
+            }
+        }
+
+        listAssociatedApplications(index, hierarchy, mimeType, std::back_inserter(desktopIds));
+        return details::findFirstDesktopFile(applicationsPaths, desktopIds, desktopId, cache, &arena);
+    }
+
+    AssociatedApplications::AssociatedApplications(const std::string& mimeType) : _position(0), _index(NULL), _cache(NULL), _typePosition(0)
+    {
+        MimeHierarchy hierarchy;
+        hierarchy.load();
+        init(details::AssociationPaths(), hierarchy, mimeType);
+    }
+
+    AssociatedApplications::AssociatedApplications(const BaseDirs& baseDirs, const std::string& mimeType) : _position(0), _index(NULL), _cache(NULL), _typePosition(0)
+    {
+        MimeHierarchy hierarchy;
+        hierarchy.load(baseDirs);
+        init(details::AssociationPaths(baseDirs), hierarchy, mimeType);
+    }
+
+    AssociatedApplications::AssociatedApplications(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType, DesktopFileCache* cache,
+                                                   const BaseDirs* baseDirs)
+        : _position(0), _index(&index), _cache(cache), _typePosition(0)
+    {
+        if (baseDirs) {
+            getApplicationsPaths(*baseDirs, std::back_inserter(_applicationsPaths));
+        } else {
+            getApplicationsPaths(std::back_inserter(_applicationsPaths));
+        }
+        hierarchy.ancestors(mimeType, std::back_inserter(_mimeTypes));
+    }
+
+    void AssociatedApplications::init(const details::AssociationPaths& paths, const MimeHierarchy& hierarchy, const std::string& mimeType)
+    {
+        _applicationsPaths = paths.applications;
+        hierarchy.ancestors(mimeType, std::back_inserter(_mimeTypes));
+        details::listAssociatedApplications(paths, _mimeTypes.begin(), _mimeTypes.end(), _merger, std::back_inserter(_desktopIds));
+    }
+
+    bool AssociatedApplications::nextDesktopId(std::string& desktopId)
+    {
+        while(_position == _desktopIds.size()) {
+            if (!_index || _typePosition == _mimeTypes.size()) {
+                return false;
+            }
+            _desktopIds.clear();
+            _position = 0;
+            _index->associatedApplications(_mimeTypes[_typePosition++], _merger, std::back_inserter(_desktopIds));
+        }
+        desktopId = _desktopIds[_position++];
+        return true;
+    }
+
+    bool AssociatedApplications::next(DesktopFile& file)
+    {
+        Arena arena;
+        std::string desktopId;
+        while(nextDesktopId(desktopId)) {
+            try {
+                const std::string desktopFilePath = findDesktopFile(_applicationsPaths.begin(), _applicationsPaths.end(), desktopId, &arena);
+                if (!desktopFilePath.empty()) {
+                    DesktopFile candidate = details::loadDesktopFile(desktopFilePath, _cache);
+                    if (details::isDesktopFileOk(candidate, &arena)) {
+                        file = candidate;
+                        return true;
+                    }
+                }
+            } catch(std::exception& e) {
+
+            }
+        }
+        return false;
+    }
+
+    AssociatedApplications::iterator AssociatedApplications::begin()
+    {
+        return iterator(this);
+    }
+
+    AssociatedApplications::iterator AssociatedApplications::end()
+    {
+        return iterator();
+    }
+
+    AssociatedApplications::iterator::iterator() : _range(NULL) {}
+
+    AssociatedApplications::iterator::iterator(AssociatedApplications* range) : _range(range)
+    {
+        ++*this;
+    }
+
+    AssociatedApplications::iterator::reference AssociatedApplications::iterator::operator*() const
+    {
+        return _file;
+    }
+
+    AssociatedApplications::iterator::pointer AssociatedApplications::iterator::operator->() const
+    {
+        return &_file;
+    }
+
+    AssociatedApplications::iterator& AssociatedApplications::iterator::operator++()
+    {
+        if (_range && !_range->next(_file)) {
+            _range = NULL;
+            _file = DesktopFile();
+        }
+        return *this;
+    }
+
+    bool AssociatedApplications::iterator::operator==(const iterator& other) const
+    {
+        return _range == other._range;
+    }
+
+    bool AssociatedApplications::iterator::operator!=(const iterator& other) const
+    {
+        return !(*this == other);
+    }
+}
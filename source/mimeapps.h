@@ -13,12 +13,18 @@
 
 #include <sys/stat.h>
 
+#include "arena.h"
+#include "associationindex.h"
 #include "basedir.h"
 #include "inilike.h"
 #include "desktopfile.h"
+#include "desktopfilecache.h"
+#include "mimehierarchy.h"
 #include "path.h"
 #include "splitter.h"
+#include "stats.h"
 #include "system.h"
+#include "trace.h"
 
 namespace mimeapps
 {
@@ -45,205 +51,409 @@ namespace mimeapps
         dataDirs(out, "applications");
     }
 
-    template<typename Iterator>
-    std::string findDesktopFile(const Iterator& first, const Iterator& last, const std::string& desktopId) {
-        if (!isBaseName(desktopId)) {
-            return std::string();
-        }
+    /// ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void getMimeAppsListPaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        *out = buildPath(baseDirs.configHome(), "mimeapps.list");
+        *out = buildPath(baseDirs.dataHome(), "applications/mimeapps.list");
+        baseDirs.configDirs(out, "mimeapps.list");
+        baseDirs.dataDirs(out, "applications/mimeapps.list");
+    }
 
-        struct stat st;
-        for (Iterator it = first; it != last; ++it) {
-            std::string appPath = buildPath(*it, desktopId);
-            if (::stat(appPath.c_str(), &st) == 0) {
-                return appPath;
+    /// ditto
+    template<typename OutputIterator>
+    void getMimeInfoCachePaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        *out = buildPath(baseDirs.dataHome(), "applications/mimeinfo.cache");
+        baseDirs.dataDirs(out, "applications/mimeinfo.cache");
+    }
+
+    /// ditto
+    template<typename OutputIterator>
+    void getApplicationsPaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        *out = buildPath(baseDirs.dataHome(), "applications");
+        baseDirs.dataDirs(out, "applications");
+    }
+
+    namespace details {
+        /// Paths of all files and directories involved in association lookup.
+        struct AssociationPaths
+        {
+            /// Build paths from environment.
+            AssociationPaths();
+            /// Build paths from snapshot of base directories.
+            explicit AssociationPaths(const BaseDirs& baseDirs);
+
+            std::vector<std::string> mimeAppsList;
+            std::vector<std::string> mimeInfoCache;
+            std::vector<std::string> applications;
+        };
+    }
+
+    namespace details {
+        template<typename Iterator>
+        ArenaString lookupDesktopFile(const Iterator& first, const Iterator& last, const std::string& desktopId, Arena& arena) {
+            const ArenaAllocator<char> allocator(&arena);
+            if (!isBaseName(desktopId)) {
+                return ArenaString(allocator);
             }
-        }
 
-        std::string::size_type i = desktopId.rfind('-');
-        if (i != std::string::npos) {
-            std::string copy = desktopId;
-            copy[i] = '/';
+            struct stat st;
             for (Iterator it = first; it != last; ++it) {
-                std::string appPath = buildPath(*it, copy);
+                ArenaString appPath = buildPath(*it, desktopId, arena);
+                MIMEAPPS_STAT_ADD(StatCalls, 1);
                 if (::stat(appPath.c_str(), &st) == 0) {
                     return appPath;
                 }
             }
+
+            std::string::size_type i = desktopId.rfind('-');
+            if (i != std::string::npos) {
+                ArenaString copy(desktopId.data(), desktopId.size(), allocator);
+                copy[i] = '/';
+                for (Iterator it = first; it != last; ++it) {
+                    ArenaString appPath = buildPath(*it, StringRef(copy.c_str(), copy.size()), arena);
+                    MIMEAPPS_STAT_ADD(StatCalls, 1);
+                    if (::stat(appPath.c_str(), &st) == 0) {
+                        return appPath;
+                    }
+                }
+            }
+            return ArenaString(allocator);
         }
-        return std::string();
     }
 
-    template<typename OutputIterator>
-    void listAssociatedApplications(const std::string& mimeType, OutputIterator out)
-    {
-        std::vector<std::string> removed, mimeAppsListPaths, mimeInfoCachePaths, desktopIds;
-        getMimeAppsListPaths(std::back_inserter(mimeAppsListPaths));
-        getMimeInfoCachePaths(std::back_inserter(mimeInfoCachePaths));
-
-        typedef Splitter<std::string::const_iterator> SplitterType;
-
-        for (std::vector<std::string>::iterator it = mimeAppsListPaths.begin(); it != mimeAppsListPaths.end(); ++it) {
-            const std::string mimeApps = *it;
-            try {
-                std::ifstream stream(mimeApps.c_str());
-                if (stream.is_open()) {
-                    SearchRequest request;
-                    request.addRequest("Added Associations", mimeType);
-                    request.addRequest("Removed Associations", mimeType);
-                    request.searchKeyValues(stream);
-
-                    const std::string removedAppsStr = request.getValue("Removed Associations", mimeType).value();
-                    SplitterType removedAppsSplitter(removedAppsStr.begin(), removedAppsStr.end(), ';');
-                    for (SplitterType::iterator it = removedAppsSplitter.begin(); it != removedAppsSplitter.end(); ++it) {
-                        removed.push_back(std::string(it->first, it->second));
-                    }
+    /**
+     * \brief Find path of desktop file by desktop id in applications directories.
+     * \param arena if not NULL, temporary paths are allocated from it.
+     * \return Empty string if there's no such desktop file.
+     */
+    template<typename Iterator>
+    std::string findDesktopFile(const Iterator& first, const Iterator& last, const std::string& desktopId, Arena* arena = NULL) {
+        MIMEAPPS_STAT_TIMER(FindDesktopFileCall);
+        details::TraceSpan span("resolve_desktop_id");
+        Arena localArena;
+        const ArenaString found = details::lookupDesktopFile(first, last, desktopId, arena ? *arena : localArena);
+        const std::string path(found.data(), found.size());
+        if (span.active()) {
+            span.addAttribute("desktop_id", desktopId);
+            span.addAttribute("path", path);
+        }
+        return path;
+    }
 
-                    const std::string addedAppsStr = request.getValue("Added Associations", mimeType).value();
-                    SplitterType addedAppsSplitter(addedAppsStr.begin(), addedAppsStr.end(), ';');
-                    for (SplitterType::iterator it = addedAppsSplitter.begin(); it != addedAppsSplitter.end(); ++it) {
-                        const std::string desktopId(it->first, it->second);
-                        if (!desktopId.empty() && std::find(removed.begin(), removed.end(), desktopId) == removed.end() &&
-                            std::find(desktopIds.begin(), desktopIds.end(), desktopId) == desktopIds.end()) {
-                            desktopIds.push_back(desktopId);
-                            *out = desktopId;
-                        }
-                    }
+    namespace details {
+        /// Replace contents of desktopIds with non-empty desktop ids from semicolon-separated list.
+        void splitDesktopIds(const std::string& value, std::vector<std::string>& desktopIds);
+
+        template<typename OutputIterator>
+        void mergeDesktopIds(const std::string& value, AssociationMerger& merger, OutputIterator out)
+        {
+            typedef Splitter<std::string::const_iterator> SplitterType;
+            SplitterType splitter(value.begin(), value.end(), ';');
+            std::string desktopId;
+            for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+                desktopId.assign(it->first, it->second);
+                if (merger.add(desktopId)) {
+                    *out = desktopId;
                 }
-            } catch(std::exception& e) {
-
             }
         }
 
-        for (std::vector<std::string>::iterator it = mimeInfoCachePaths.begin(); it != mimeInfoCachePaths.end(); ++it) {
-            const std::string mimeCache = *it;
-            try {
-                std::ifstream stream(mimeCache.c_str());
-                if (stream.is_open()) {
-                    SearchRequest request;
-                    request.addRequest("MIME Cache", mimeType);
-                    request.searchKeyValues(stream);
-
-                    const std::string mimeAppsStr = request.getValue("MIME Cache", mimeType).value();
-                    SplitterType splitter(mimeAppsStr.begin(), mimeAppsStr.end(), ';');
-                    for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
-                        const std::string desktopId(it->first, it->second);
-                        if (!desktopId.empty() && std::find(removed.begin(), removed.end(), desktopId) == removed.end() &&
-                            std::find(desktopIds.begin(), desktopIds.end(), desktopId) == desktopIds.end()) {
-                            desktopIds.push_back(desktopId);
-                            *out = desktopId;
-                        }
-                    }
+        void removeDesktopIds(const std::string& value, AssociationMerger& merger);
+
+        /**
+         * \brief Read values of key for each of MIME types from every file of the group.
+         * \param arena if not NULL, temporary data of parsing is allocated from it.
+         * \return vector of size (number of paths) * (number of MIME types), values of one file go in row.
+         */
+        std::vector<std::string> readMimeTypeValues(const std::vector<std::string>& paths, const char* group, const std::vector<std::string>& mimeTypes,
+                                                    Arena* arena = NULL);
+
+        /**
+         * \brief List associations of several MIME types reading each file only once.
+         * Associations of MIME types that come first take precedence.
+         */
+        template<typename TypeIterator, typename OutputIterator>
+        void listAssociatedApplications(const AssociationPaths& paths, TypeIterator typesFirst, TypeIterator typesLast, AssociationMerger& merger, OutputIterator out)
+        {
+            const std::vector<std::string> mimeTypes(typesFirst, typesLast);
+            const std::vector<std::string>& mimeAppsListPaths = paths.mimeAppsList;
+            const std::vector<std::string>& mimeInfoCachePaths = paths.mimeInfoCache;
+
+            Arena arena;
+            const std::vector<std::string> removed = readMimeTypeValues(mimeAppsListPaths, "Removed Associations", mimeTypes, &arena);
+            const std::vector<std::string> added = readMimeTypeValues(mimeAppsListPaths, "Added Associations", mimeTypes, &arena);
+            const std::vector<std::string> cached = readMimeTypeValues(mimeInfoCachePaths, "MIME Cache", mimeTypes, &arena);
+
+            const std::size_t typeCount = mimeTypes.size();
+            for (std::size_t t = 0; t < typeCount; ++t) {
+                for (std::size_t f = 0; f < mimeAppsListPaths.size(); ++f) {
+                    removeDesktopIds(removed[f * typeCount + t], merger);
+                    mergeDesktopIds(added[f * typeCount + t], merger, out);
+                }
+                for (std::size_t f = 0; f < mimeInfoCachePaths.size(); ++f) {
+                    mergeDesktopIds(cached[f * typeCount + t], merger, out);
                 }
+            }
+        }
+
+        /// ditto, but for default applications.
+        template<typename TypeIterator, typename OutputIterator>
+        void listDefaultApplications(const AssociationPaths& paths, TypeIterator typesFirst, TypeIterator typesLast, AssociationMerger& merger, OutputIterator out)
+        {
+            const std::vector<std::string> mimeTypes(typesFirst, typesLast);
+            const std::vector<std::string>& mimeAppsListPaths = paths.mimeAppsList;
 
-            } catch(std::exception& e) {
+            Arena arena;
+            const std::vector<std::string> defaults = readMimeTypeValues(mimeAppsListPaths, "Default Applications", mimeTypes, &arena);
 
+            const std::size_t typeCount = mimeTypes.size();
+            for (std::size_t t = 0; t < typeCount; ++t) {
+                for (std::size_t f = 0; f < mimeAppsListPaths.size(); ++f) {
+                    mergeDesktopIds(defaults[f * typeCount + t], merger, out);
+                }
             }
         }
+
+        /**
+         * \brief Check that desktop file is valid and its executable exists. Temporary data is allocated from arena if it's not NULL.
+         *
+         * Hidden entries, entries not shown in XDG_CURRENT_DESKTOP and entries whose TryExec program is missing are rejected
+         * before Exec is parsed. NoDisplay entries are accepted, since they're meant to open files without appearing in menus.
+         */
+        bool isDesktopFileOk(const DesktopFile& file, Arena* arena = NULL);
+
+        /// Parse desktop file or get it from cache if cache is not NULL. Temporary parsing data is allocated from arena if it's not NULL.
+        DesktopFile loadDesktopFile(const std::string& path, DesktopFileCache* cache, Arena* arena = NULL);
+
+        /**
+         * \brief Get first valid desktop file among desktop ids or invalid DesktopFile if there's none.
+         * \param desktopId if not NULL, receives desktop id of found file.
+         * \param cache if not NULL, desktop files are taken from it.
+         * \param arena if not NULL, temporary data is allocated from it.
+         */
+        DesktopFile findFirstDesktopFile(const std::vector<std::string>& applicationsPaths, const std::vector<std::string>& desktopIds,
+                                         std::string* desktopId = NULL, DesktopFileCache* cache = NULL, Arena* arena = NULL);
+
+        /**
+         * \brief Get first valid default application for the first of MIME types that has one.
+         *
+         * mimeapps.list files are read one by one in order of precedence and only while no valid default is found,
+         * so in common case only the first file is read.
+         * \param desktopId if not NULL, receives desktop id of found file.
+         * \param arena if not NULL, temporary data is allocated from it.
+         */
+        DesktopFile findFirstDefaultApplication(const AssociationPaths& paths, const std::vector<std::string>& mimeTypes,
+                                                std::string* desktopId = NULL, Arena* arena = NULL);
+
+        /// Implementation of findDefaultApplication() that does not use index.
+        DesktopFile findDefaultApplication(const AssociationPaths& paths, const MimeHierarchy& hierarchy, const std::string& mimeType);
     }
 
+    /**
+     * \brief List desktop ids associated with mimeType in order of preference.
+     * Only exact match of MIME type is considered.
+     */
     template<typename OutputIterator>
-    void listDefaultApplications(const std::string& mimeType, OutputIterator out)
+    void listAssociatedApplications(const std::string& mimeType, OutputIterator out)
     {
-        std::vector<std::string> mimeAppsListPaths, desktopIds;
-        getMimeAppsListPaths(std::back_inserter(mimeAppsListPaths));
-
-        typedef Splitter<std::string::const_iterator> SplitterType;
-
-        for (std::vector<std::string>::iterator it = mimeAppsListPaths.begin(); it != mimeAppsListPaths.end(); ++it) {
-            const std::string mimeApps = *it;
-            try {
-                std::ifstream stream(mimeApps.c_str());
-                if (stream.is_open()) {
-                    SearchRequest request;
-                    request.addRequest("Default Applications", mimeType);
-                    request.searchKeyValues(stream);
-
-                    std::string appsStr = request.getValue("Default Applications", mimeType).value();
-                    SplitterType splitter(appsStr.begin(), appsStr.end(), ';');
-                    for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
-                        const std::string desktopId(it->first, it->second);
-                        if (!desktopId.empty() && std::find(desktopIds.begin(), desktopIds.end(), desktopId) == desktopIds.end()) {
-                            desktopIds.push_back(desktopId);
-                            *out = desktopId;
-                        }
-                    }
-                }
-            } catch(std::exception& e) {
-
-            }
-        }
+        MIMEAPPS_STAT_TIMER(ListAssociatedApplicationsCall);
+        details::AssociationMerger merger;
+        details::listAssociatedApplications(details::AssociationPaths(), &mimeType, &mimeType + 1, merger, out);
     }
 
-    namespace details {
-        bool isDesktopFileOk(const DesktopFile& file) {
-            if (file.isValid()) {
-                std::vector<std::string> args;
-                unquoteExec(file.execValue(), std::back_inserter(args));
-                if (!args.empty() && !findExecutable(args[0]).empty()) {
-                    return true;
-                }
-            }
-            return false;
-        }
+    /// ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void listAssociatedApplications(const BaseDirs& baseDirs, const std::string& mimeType, OutputIterator out)
+    {
+        MIMEAPPS_STAT_TIMER(ListAssociatedApplicationsCall);
+        details::AssociationMerger merger;
+        details::listAssociatedApplications(details::AssociationPaths(baseDirs), &mimeType, &mimeType + 1, merger, out);
     }
 
+    /**
+     * \brief List desktop ids associated with mimeType or any of its ancestors using preloaded index.
+     * \sa MimeHierarchy::ancestors()
+     */
     template<typename OutputIterator>
-    void findAssociatedApplications(const std::string& mimeType, OutputIterator out) {
-        std::vector<std::string> applicationsPaths, desktopIds;
-        getApplicationsPaths(std::back_inserter(applicationsPaths));
-        listAssociatedApplications(mimeType, std::back_inserter(desktopIds));
-
-        for (std::vector<std::string>::const_iterator it = desktopIds.begin(); it != desktopIds.end(); ++it) {
-            try {
-                std::string desktopFilePath = findDesktopFile(applicationsPaths.begin(), applicationsPaths.end(), *it);
-                if (!desktopFilePath.empty()) {
-                    DesktopFile file(desktopFilePath);
-                    if (details::isDesktopFileOk(file)) {
-                        *out = file;
-                    }
-                }
-            } catch(std::exception& e) {
-
-            }
+    void listAssociatedApplications(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType, OutputIterator out)
+    {
+        MIMEAPPS_STAT_TIMER(ListAssociatedApplicationsCall);
+        std::vector<std::string> mimeTypes;
+        hierarchy.ancestors(mimeType, std::back_inserter(mimeTypes));
+        details::AssociationMerger merger;
+        for (std::vector<std::string>::const_iterator it = mimeTypes.begin(); it != mimeTypes.end(); ++it) {
+            index.associatedApplications(*it, merger, out);
         }
     }
 
-    DesktopFile findDefaultApplication(const std::string& mimeType) {
-        std::vector<std::string> applicationsPaths, defaultDesktopIds, desktopIds;
-        getApplicationsPaths(std::back_inserter(applicationsPaths));
-        listDefaultApplications(mimeType, std::back_inserter(defaultDesktopIds));
+    /**
+     * \brief List desktop ids of default applications for mimeType in order of preference.
+     * Only exact match of MIME type is considered.
+     */
+    template<typename OutputIterator>
+    void listDefaultApplications(const std::string& mimeType, OutputIterator out)
+    {
+        MIMEAPPS_STAT_TIMER(ListDefaultApplicationsCall);
+        details::AssociationMerger merger;
+        details::listDefaultApplications(details::AssociationPaths(), &mimeType, &mimeType + 1, merger, out);
+    }
 
-        for (std::vector<std::string>::const_iterator it = defaultDesktopIds.begin(); it != defaultDesktopIds.end(); ++it) {
-            try {
-                std::string desktopFilePath = findDesktopFile(applicationsPaths.begin(), applicationsPaths.end(), *it);
-                if (!desktopFilePath.empty()) {
-                    DesktopFile file(desktopFilePath);
-                    if (details::isDesktopFileOk(file)) {
-                        return file;
-                    }
-                }
-            } catch(std::exception& e) {
+    /// ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void listDefaultApplications(const BaseDirs& baseDirs, const std::string& mimeType, OutputIterator out)
+    {
+        MIMEAPPS_STAT_TIMER(ListDefaultApplicationsCall);
+        details::AssociationMerger merger;
+        details::listDefaultApplications(details::AssociationPaths(baseDirs), &mimeType, &mimeType + 1, merger, out);
+    }
 
-            }
+    /**
+     * \brief List desktop ids of default applications for mimeType or any of its ancestors using preloaded index.
+     */
+    template<typename OutputIterator>
+    void listDefaultApplications(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType, OutputIterator out)
+    {
+        MIMEAPPS_STAT_TIMER(ListDefaultApplicationsCall);
+        std::vector<std::string> mimeTypes;
+        hierarchy.ancestors(mimeType, std::back_inserter(mimeTypes));
+        details::AssociationMerger merger;
+        for (std::vector<std::string>::const_iterator it = mimeTypes.begin(); it != mimeTypes.end(); ++it) {
+            index.defaultApplications(*it, merger, out);
         }
+    }
 
-        listAssociatedApplications(mimeType, std::back_inserter(desktopIds));
+    /**
+     * \brief Lazy range of valid applications associated with MIME type or its ancestors.
+     *
+     * Desktop ids are listed on construction, but desktop files are found, parsed and validated
+     * only when iteration reaches them, so the first result is available after a single desktop file is read.
+     * Applications go in the same order as findAssociatedApplications() gives.
+     * Range is single-pass: iterators share position of the range.
+     * Temporary data of each step is allocated from arena on stack and freed at once when step is done.
+     */
+    struct AssociatedApplications
+    {
+        /// Read MIME hierarchy and association files to list applications for mimeType.
+        explicit AssociatedApplications(const std::string& mimeType);
+        /// ditto, but use snapshot of base directories.
+        AssociatedApplications(const BaseDirs& baseDirs, const std::string& mimeType);
+        /**
+         * \brief Use preloaded index and MIME hierarchy. They must outlive the range.
+         * \param cache if not NULL, desktop files are taken from it. It must outlive the range.
+         * \param baseDirs if not NULL, applications directories are taken from it instead of environment.
+         */
+        AssociatedApplications(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType, DesktopFileCache* cache = NULL,
+                               const BaseDirs* baseDirs = NULL);
+
+        struct iterator
+        {
+            typedef std::input_iterator_tag iterator_category;
+            typedef DesktopFile value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const DesktopFile* pointer;
+            typedef const DesktopFile& reference;
+
+            /// End iterator.
+            iterator();
+
+            reference operator*() const;
+            pointer operator->() const;
+            iterator& operator++();
+
+            bool operator==(const iterator& other) const;
+            bool operator!=(const iterator& other) const;
+
+        private:
+            friend struct AssociatedApplications;
+            explicit iterator(AssociatedApplications* range);
+
+            AssociatedApplications* _range;
+            DesktopFile _file;
+        };
+
+        iterator begin();
+        iterator end();
+
+        /// Find next valid application. Returns false if there're no more applications.
+        bool next(DesktopFile& file);
+
+    private:
+        void init(const details::AssociationPaths& paths, const MimeHierarchy& hierarchy, const std::string& mimeType);
+        bool nextDesktopId(std::string& desktopId);
+
+        std::vector<std::string> _applicationsPaths;
+        std::vector<std::string> _desktopIds;
+        std::size_t _position;
+
+        // Used for lazy listing of desktop ids from preloaded index, NULL otherwise.
+        const AssociationIndex* _index;
+        DesktopFileCache* _cache;
+        std::vector<std::string> _mimeTypes;
+        std::size_t _typePosition;
+        details::AssociationMerger _merger;
+    };
+
+    /**
+     * \brief Find valid applications that can open files of mimeType.
+     *
+     * Applications associated with ancestors of mimeType are always listed after its own ones
+     * in the order of MimeHierarchy::ancestors(), e.g. text/plain applications are offered for application/x-shellscript.
+     * For streamable types this includes applications associated with application/octet-stream.
+     * This function reads MIME hierarchy and association files on each call.
+     * Use overload that takes AssociationIndex and MimeHierarchy for repeated lookups.
+     */
+    template<typename OutputIterator>
+    void findAssociatedApplications(const std::string& mimeType, OutputIterator out) {
+        MIMEAPPS_STAT_TIMER(FindAssociatedApplicationsCall);
+        AssociatedApplications applications(mimeType);
+        std::copy(applications.begin(), applications.end(), out);
+    }
 
-        for (std::vector<std::string>::const_iterator it = desktopIds.begin(); it != desktopIds.end(); ++it) {
-            try {
-                std::string desktopFilePath = findDesktopFile(applicationsPaths.begin(), applicationsPaths.end(), *it);
-                if (!desktopFilePath.empty()) {
-                    DesktopFile file(desktopFilePath);
-                    if (details::isDesktopFileOk(file)) {
-                        return file;
-                    }
-                }
-            } catch(std::exception& e) {
+    /// ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void findAssociatedApplications(const BaseDirs& baseDirs, const std::string& mimeType, OutputIterator out) {
+        MIMEAPPS_STAT_TIMER(FindAssociatedApplicationsCall);
+        AssociatedApplications applications(baseDirs, mimeType);
+        std::copy(applications.begin(), applications.end(), out);
+    }
 
-            }
-        }
-        return DesktopFile();
+    /**
+     * \brief ditto, but use preloaded index and MIME hierarchy.
+     * \param cache if not NULL, desktop files are taken from it, so repeated lookups don't parse the same files again.
+     * \param baseDirs if not NULL, applications directories are taken from it instead of environment.
+     */
+    template<typename OutputIterator>
+    void findAssociatedApplications(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType, OutputIterator out,
+                                    DesktopFileCache* cache = NULL, const BaseDirs* baseDirs = NULL) {
+        MIMEAPPS_STAT_TIMER(FindAssociatedApplicationsCall);
+        AssociatedApplications applications(index, hierarchy, mimeType, cache, baseDirs);
+        std::copy(applications.begin(), applications.end(), out);
     }
+
+    /**
+     * \brief Find default application for mimeType.
+     *
+     * Default applications of mimeType and its ancestors are tried first, then associated applications.
+     * MIME hierarchy is read only if mimeType has no valid default application of its own.
+     * \return Invalid DesktopFile if no valid application was found.
+     */
+    DesktopFile findDefaultApplication(const std::string& mimeType);
+
+    /// ditto, but use snapshot of base directories.
+    DesktopFile findDefaultApplication(const BaseDirs& baseDirs, const std::string& mimeType);
+
+    /**
+     * \brief ditto, but use preloaded index and MIME hierarchy.
+     * \param desktopId if not NULL, receives desktop id of found application.
+     * \param cache if not NULL, desktop files are taken from it.
+     * \param baseDirs if not NULL, applications directories are taken from it instead of environment.
+     */
+    DesktopFile findDefaultApplication(const AssociationIndex& index, const MimeHierarchy& hierarchy, const std::string& mimeType,
+                                       std::string* desktopId = NULL, DesktopFileCache* cache = NULL, const BaseDirs* baseDirs = NULL);
 }
 
 #endif
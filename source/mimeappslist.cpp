@@ -0,0 +1,294 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include "mimeappslist.h"
+#include "mimeapps.h"
+#include "inilike.h"
+#include "path.h"
+#include "splitter.h"
+#include "stats.h"
+#include "system.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        const char* const defaultGroup = "Default Applications";
+        const char* const addedGroup = "Added Associations";
+        const char* const removedGroup = "Removed Associations";
+
+        typedef std::pair<std::string, std::string> GroupKey;
+        typedef std::map<GroupKey, std::vector<std::string> > Lists;
+
+        void removeId(std::vector<std::string>& desktopIds, const std::string& desktopId)
+        {
+            desktopIds.erase(std::remove(desktopIds.begin(), desktopIds.end(), desktopId), desktopIds.end());
+        }
+
+        void prependId(std::vector<std::string>& desktopIds, const std::string& desktopId)
+        {
+            removeId(desktopIds, desktopId);
+            desktopIds.insert(desktopIds.begin(), desktopId);
+        }
+
+        void appendId(std::vector<std::string>& desktopIds, const std::string& desktopId)
+        {
+            if (std::find(desktopIds.begin(), desktopIds.end(), desktopId) == desktopIds.end()) {
+                desktopIds.push_back(desktopId);
+            }
+        }
+
+        std::string formatLine(const std::string& mimeType, const std::vector<std::string>& desktopIds)
+        {
+            std::string line = mimeType + '=';
+            for (std::vector<std::string>::const_iterator it = desktopIds.begin(); it != desktopIds.end(); ++it) {
+                line += *it;
+                line += ';';
+            }
+            return line;
+        }
+
+        /// Line of file with group and key it belongs to. Key is empty for group headers, comments and malformed lines.
+        struct Line
+        {
+            std::string text;
+            std::string group;
+            std::string key;
+            std::string value;
+            bool isGroup;
+        };
+
+        void readLines(std::istream& stream, std::vector<Line>& lines)
+        {
+            std::string currentGroup;
+            Line line;
+            while(getline(stream, line.text)) {
+                std::string parsed = line.text;
+                std::string::size_type equalPos;
+                details::LineType type = details::SkipLine;
+                try {
+                    type = details::parseLine(parsed, currentGroup, equalPos);
+                } catch(std::exception& e) {
+                    // Keep malformed line as is.
+                }
+                line.group = currentGroup;
+                line.isGroup = type == details::GroupLine;
+                if (type == details::KeyValueLine) {
+                    line.key.assign(parsed, 0, equalPos);
+                    line.value = unescapeValue(parsed.begin() + equalPos + 1, parsed.end());
+                } else {
+                    line.key.clear();
+                    line.value.clear();
+                }
+                lines.push_back(line);
+            }
+        }
+
+        void flushPending(std::string& contents, std::vector<const Line*>& pending)
+        {
+            for (std::size_t i=0; i<pending.size(); ++i) {
+                contents += pending[i]->text;
+                contents += '\n';
+            }
+            pending.clear();
+        }
+
+        void addMissingKeys(std::string& contents, const std::string& group, const Lists& lists, const std::vector<GroupKey>& written)
+        {
+            for (Lists::const_iterator it = lists.begin(); it != lists.end(); ++it) {
+                if (it->first.first == group && !it->second.empty() && std::find(written.begin(), written.end(), it->first) == written.end()) {
+                    contents += formatLine(it->first.second, it->second);
+                    contents += '\n';
+                }
+            }
+        }
+
+        /// Write lines replacing values of keys in lists. Keys that are not in file are added at the end of their groups.
+        std::string formatLines(const std::vector<Line>& lines, const Lists& lists)
+        {
+            std::string contents;
+            std::vector<GroupKey> written;
+            std::vector<std::string> seenGroups;
+            // Blank lines and comments at the end of group go after added keys.
+            std::vector<const Line*> pending;
+            std::string currentGroup;
+
+            for (std::vector<Line>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+                if (it->isGroup) {
+                    if (!currentGroup.empty()) {
+                        addMissingKeys(contents, currentGroup, lists, written);
+                    }
+                    flushPending(contents, pending);
+                    currentGroup = it->group;
+                    seenGroups.push_back(currentGroup);
+                    contents += it->text;
+                    contents += '\n';
+                } else if (it->key.empty()) {
+                    pending.push_back(&*it);
+                } else {
+                    flushPending(contents, pending);
+                    const GroupKey groupKey(it->group, it->key);
+                    Lists::const_iterator found = lists.find(groupKey);
+                    if (found == lists.end()) {
+                        contents += it->text;
+                        contents += '\n';
+                    } else if (std::find(written.begin(), written.end(), groupKey) == written.end()) {
+                        written.push_back(groupKey);
+                        if (!found->second.empty()) {
+                            contents += formatLine(it->key, found->second);
+                            contents += '\n';
+                        }
+                    }
+                }
+            }
+            if (!currentGroup.empty()) {
+                addMissingKeys(contents, currentGroup, lists, written);
+            }
+            flushPending(contents, pending);
+
+            const char* const groups[] = {defaultGroup, addedGroup, removedGroup};
+            for (std::size_t i=0; i<sizeof(groups)/sizeof(groups[0]); ++i) {
+                if (std::find(seenGroups.begin(), seenGroups.end(), groups[i]) != seenGroups.end()) {
+                    continue;
+                }
+                std::string groupContents;
+                addMissingKeys(groupContents, groups[i], lists, written);
+                if (!groupContents.empty()) {
+                    if (!contents.empty() && (contents.size() < 2 || contents.compare(contents.size() - 2, 2, "\n\n") != 0)) {
+                        contents += '\n';
+                    }
+                    contents += '[';
+                    contents += groups[i];
+                    contents += "]\n";
+                    contents += groupContents;
+                }
+            }
+            return contents;
+        }
+    }
+
+    MimeAppsListEditor::MimeAppsListEditor() : _path(buildPath(configHome(), "mimeapps.list"))
+    {
+    }
+
+    MimeAppsListEditor::MimeAppsListEditor(const BaseDirs& baseDirs) : _path(buildPath(baseDirs.configHome(), "mimeapps.list"))
+    {
+    }
+
+    MimeAppsListEditor::MimeAppsListEditor(const std::string& path) : _path(path)
+    {
+    }
+
+    const std::string& MimeAppsListEditor::path() const
+    {
+        return _path;
+    }
+
+    void MimeAppsListEditor::setDefaultApplication(const std::string& mimeType, const std::string& desktopId)
+    {
+        Change change = {SetDefault, mimeType, desktopId};
+        _changes.push_back(change);
+    }
+
+    void MimeAppsListEditor::addAssociation(const std::string& mimeType, const std::string& desktopId)
+    {
+        Change change = {AddAssociation, mimeType, desktopId};
+        _changes.push_back(change);
+    }
+
+    void MimeAppsListEditor::removeAssociation(const std::string& mimeType, const std::string& desktopId)
+    {
+        Change change = {RemoveAssociation, mimeType, desktopId};
+        _changes.push_back(change);
+    }
+
+    std::size_t MimeAppsListEditor::changeCount() const
+    {
+        return _changes.size();
+    }
+
+    void MimeAppsListEditor::commit(AssociationIndex* index)
+    {
+        details::TraceSpan span("write_mimeapps_list");
+        span.addAttribute("path", _path);
+
+        std::vector<Line> lines;
+        mode_t mode = 0644;
+        struct stat st;
+        MIMEAPPS_STAT_ADD(StatCalls, 1);
+        if (::stat(_path.c_str(), &st) == 0) {
+            mode = st.st_mode & 07777;
+            std::ifstream stream(_path.c_str());
+            if (!stream.is_open()) {
+                throw details::fileError("Could not read", _path);
+            }
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            readLines(stream, lines);
+        } else if (errno != ENOENT) {
+            throw details::fileError("Could not read", _path);
+        }
+
+        // Current lists of changed MIME types. The last value of duplicated key wins, like in AssociationIndex.
+        Lists lists;
+        const char* const groups[] = {defaultGroup, addedGroup, removedGroup};
+        for (std::vector<Change>::const_iterator it = _changes.begin(); it != _changes.end(); ++it) {
+            for (std::size_t i=0; i<sizeof(groups)/sizeof(groups[0]); ++i) {
+                lists[GroupKey(groups[i], it->mimeType)];
+            }
+        }
+        for (std::vector<Line>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+            if (!it->key.empty()) {
+                Lists::iterator found = lists.find(GroupKey(it->group, it->key));
+                if (found != lists.end()) {
+                    details::splitDesktopIds(it->value, found->second);
+                }
+            }
+        }
+
+        for (std::vector<Change>::const_iterator it = _changes.begin(); it != _changes.end(); ++it) {
+            std::vector<std::string>& defaults = lists[GroupKey(defaultGroup, it->mimeType)];
+            std::vector<std::string>& added = lists[GroupKey(addedGroup, it->mimeType)];
+            std::vector<std::string>& removed = lists[GroupKey(removedGroup, it->mimeType)];
+            switch(it->action) {
+                case SetDefault:
+                    prependId(defaults, it->desktopId);
+                    prependId(added, it->desktopId);
+                    removeId(removed, it->desktopId);
+                    break;
+                case AddAssociation:
+                    prependId(added, it->desktopId);
+                    removeId(removed, it->desktopId);
+                    break;
+                case RemoveAssociation:
+                    removeId(defaults, it->desktopId);
+                    removeId(added, it->desktopId);
+                    appendId(removed, it->desktopId);
+                    break;
+            }
+        }
+
+        details::writeFileAtomically(_path, formatLines(lines, lists), mode);
+
+        if (index) {
+            for (std::vector<Change>::const_iterator it = _changes.begin(); it != _changes.end(); ++it) {
+                index->updateMimeAppsList(_path, it->mimeType,
+                                          lists[GroupKey(addedGroup, it->mimeType)],
+                                          lists[GroupKey(removedGroup, it->mimeType)],
+                                          lists[GroupKey(defaultGroup, it->mimeType)]);
+            }
+        }
+        span.addAttribute("changes", _changes.size());
+        _changes.clear();
+    }
+}
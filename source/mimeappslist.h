@@ -0,0 +1,86 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Editing mimeapps.list files.
+ */
+
+#ifndef MIMEAPPS_MIMEAPPSLIST_H
+#define MIMEAPPS_MIMEAPPSLIST_H
+
+#include <string>
+#include <vector>
+
+#include "associationindex.h"
+#include "basedir.h"
+
+namespace mimeapps
+{
+    /**
+     * \brief Transaction of changes to mimeapps.list file.
+     *
+     * Changes are queued and applied at once by commit(), which reads the current file,
+     * rewrites only lines of changed MIME types and atomically replaces the file.
+     * Comments, unrelated groups and keys are preserved as is.
+     */
+    struct MimeAppsListEditor
+    {
+        /// Edit user mimeapps.list in config home.
+        MimeAppsListEditor();
+        /// ditto, but use snapshot of base directories.
+        explicit MimeAppsListEditor(const BaseDirs& baseDirs);
+        /// Edit mimeapps.list at path. File is created on commit if it does not exist.
+        explicit MimeAppsListEditor(const std::string& path);
+
+        /// Path of edited file.
+        const std::string& path() const;
+
+        /**
+         * \brief Make desktopId the default application for mimeType.
+         * It's also added to associations of mimeType.
+         */
+        void setDefaultApplication(const std::string& mimeType, const std::string& desktopId);
+
+        /// Associate desktopId with mimeType as the most preferred application, cancelling its removal.
+        void addAssociation(const std::string& mimeType, const std::string& desktopId);
+
+        /// Remove association of desktopId with mimeType, including associations from mimeinfo.cache and less important files.
+        void removeAssociation(const std::string& mimeType, const std::string& desktopId);
+
+        /// Number of queued changes.
+        std::size_t changeCount() const;
+
+        /**
+         * \brief Apply queued changes to file.
+         *
+         * New contents are written to temporary file in the same directory, synced to disk and renamed over the file,
+         * so readers see either old or new file. Missing parent directories are created.
+         * Queue is cleared on success.
+         * \param index if not NULL, lists of changed MIME types are updated in it, so it does not need to be reloaded.
+         * \throws std::runtime_error if file could not be read or written. File is not modified in this case.
+         */
+        void commit(AssociationIndex* index = NULL);
+
+    private:
+        enum Action
+        {
+            SetDefault,
+            AddAssociation,
+            RemoveAssociation
+        };
+
+        struct Change
+        {
+            Action action;
+            std::string mimeType;
+            std::string desktopId;
+        };
+
+        std::string _path;
+        std::vector<Change> _changes;
+    };
+}
+
+#endif
@@ -0,0 +1,486 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "mimecache.h"
+
+namespace mimeapps
+{
+    namespace {
+        enum {
+            HeaderSize = 40,
+            AliasListOffset = 4,
+            ParentListOffset = 8,
+            LiteralListOffset = 12,
+            ReverseSuffixTreeOffset = 16,
+            GlobListOffset = 20,
+            CaseSensitiveFlag = 0x100,
+            WeightMask = 0xff
+        };
+
+        unsigned int toLowerAscii(unsigned int c)
+        {
+            return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+
+        std::string toLowerAscii(const std::string& str)
+        {
+            std::string result(str);
+            for (std::string::iterator it = result.begin(); it != result.end(); ++it) {
+                *it = static_cast<char>(toLowerAscii(static_cast<unsigned char>(*it)));
+            }
+            return result;
+        }
+
+        /// Decode UTF-8 into code points. Invalid bytes are taken as is.
+        void decodeUtf8(const std::string& str, std::vector<unsigned int>& characters)
+        {
+            characters.clear();
+            for (std::size_t i=0; i<str.size();) {
+                const unsigned char lead = static_cast<unsigned char>(str[i]);
+                std::size_t length = 1;
+                unsigned int c = lead;
+                if (lead >= 0xF0 && lead < 0xF8) {
+                    length = 4; c = lead & 0x07;
+                } else if (lead >= 0xE0) {
+                    length = 3; c = lead & 0x0F;
+                } else if (lead >= 0xC0) {
+                    length = 2; c = lead & 0x1F;
+                }
+                if (length > 1 && i + length <= str.size()) {
+                    for (std::size_t j=1; j<length; ++j) {
+                        c = (c << 6) | (static_cast<unsigned char>(str[i+j]) & 0x3F);
+                    }
+                } else {
+                    length = 1;
+                    c = lead;
+                }
+                characters.push_back(c);
+                i += length;
+            }
+        }
+    }
+
+    GlobMatch::GlobMatch() : mimeType(NULL), weight(0), patternLength(0) {}
+
+    GlobMatch::GlobMatch(const char* mimeType, unsigned int weight, std::size_t patternLength)
+        : mimeType(mimeType), weight(weight), patternLength(patternLength) {}
+
+    bool isBetterGlobMatch(const GlobMatch& a, const GlobMatch& b)
+    {
+        return a.weight > b.weight || (a.weight == b.weight && a.patternLength > b.patternLength);
+    }
+
+    MimeCache::MimeCache() : _data(NULL), _size(0) {}
+
+    MimeCache::MimeCache(const std::string& fileName) : _data(NULL), _size(0), _fileName(fileName)
+    {
+        int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error("Could not open mime cache " + fileName);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < HeaderSize) {
+            ::close(fd);
+            throw std::runtime_error("Mime cache is too small: " + fileName);
+        }
+        void* data = ::mmap(NULL, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Could not map mime cache " + fileName);
+        }
+        _data = static_cast<const unsigned char*>(data);
+        _size = static_cast<std::size_t>(st.st_size);
+
+        unsigned int major = 0, minor = 0;
+        card16(0, major);
+        card16(2, minor);
+        if (major != 1 || (minor != 1 && minor != 2)) {
+            unmap();
+            throw std::runtime_error("Unsupported mime cache version: " + fileName);
+        }
+    }
+
+    MimeCache::~MimeCache()
+    {
+        unmap();
+    }
+
+    MimeCache::MimeCache(MimeCache&& other) : _data(other._data), _size(other._size), _fileName(other._fileName)
+    {
+        other._data = NULL;
+        other._size = 0;
+    }
+
+    MimeCache& MimeCache::operator=(MimeCache&& other)
+    {
+        if (this != &other) {
+            unmap();
+            _data = other._data;
+            _size = other._size;
+            _fileName = other._fileName;
+            other._data = NULL;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    void MimeCache::unmap()
+    {
+        if (_data) {
+            ::munmap(const_cast<unsigned char*>(_data), _size);
+            _data = NULL;
+            _size = 0;
+        }
+    }
+
+    bool MimeCache::isValid() const
+    {
+        return _data != NULL;
+    }
+
+    std::string MimeCache::fileName() const
+    {
+        return _fileName;
+    }
+
+    bool MimeCache::card16(std::size_t offset, unsigned int& value) const
+    {
+        if (offset > _size || _size - offset < 2) {
+            return false;
+        }
+        value = (static_cast<unsigned int>(_data[offset]) << 8) | _data[offset+1];
+        return true;
+    }
+
+    bool MimeCache::card32(std::size_t offset, unsigned int& value) const
+    {
+        if (offset > _size || _size - offset < 4) {
+            return false;
+        }
+        value = (static_cast<unsigned int>(_data[offset]) << 24) | (static_cast<unsigned int>(_data[offset+1]) << 16) |
+                (static_cast<unsigned int>(_data[offset+2]) << 8) | _data[offset+3];
+        return true;
+    }
+
+    const char* MimeCache::string(std::size_t offset) const
+    {
+        if (offset >= _size || std::memchr(_data + offset, '\0', _size - offset) == NULL) {
+            return NULL;
+        }
+        return reinterpret_cast<const char*>(_data + offset);
+    }
+
+    bool MimeCache::hasRange(std::size_t offset, std::size_t count, std::size_t entrySize) const
+    {
+        return offset <= _size && count <= (_size - offset) / entrySize;
+    }
+
+    const char* MimeCache::unalias(const char* mimeType) const
+    {
+        unsigned int listOffset, count;
+        if (!card32(AliasListOffset, listOffset) || !card32(listOffset, count) || !hasRange(listOffset + 4, count, 8)) {
+            return NULL;
+        }
+        std::size_t low = 0, high = count;
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            const std::size_t entry = listOffset + 4 + middle * 8;
+            unsigned int aliasOffset = 0, mimeOffset = 0;
+            card32(entry, aliasOffset);
+            card32(entry + 4, mimeOffset);
+            const char* alias = string(aliasOffset);
+            if (!alias) {
+                return NULL;
+            }
+            const int cmp = std::strcmp(alias, mimeType);
+            if (cmp < 0) {
+                low = middle + 1;
+            } else if (cmp > 0) {
+                high = middle;
+            } else {
+                return string(mimeOffset);
+            }
+        }
+        return NULL;
+    }
+
+    std::string MimeCache::resolveAlias(const std::string& mimeType) const
+    {
+        const char* canonical = unalias(mimeType.c_str());
+        return canonical ? std::string(canonical) : mimeType;
+    }
+
+    void MimeCache::parentList(const char* mimeType, std::vector<const char*>& parents) const
+    {
+        unsigned int listOffset, count;
+        if (!card32(ParentListOffset, listOffset) || !card32(listOffset, count) || !hasRange(listOffset + 4, count, 8)) {
+            return;
+        }
+        std::size_t low = 0, high = count;
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            const std::size_t entry = listOffset + 4 + middle * 8;
+            unsigned int mimeOffset = 0, parentsOffset = 0;
+            card32(entry, mimeOffset);
+            card32(entry + 4, parentsOffset);
+            const char* name = string(mimeOffset);
+            if (!name) {
+                return;
+            }
+            const int cmp = std::strcmp(name, mimeType);
+            if (cmp < 0) {
+                low = middle + 1;
+            } else if (cmp > 0) {
+                high = middle;
+            } else {
+                unsigned int parentCount;
+                if (!card32(parentsOffset, parentCount) || !hasRange(parentsOffset + 4, parentCount, 4)) {
+                    return;
+                }
+                for (unsigned int i=0; i<parentCount; ++i) {
+                    unsigned int parentOffset = 0;
+                    card32(parentsOffset + 4 + i * 4, parentOffset);
+                    const char* parent = string(parentOffset);
+                    if (parent) {
+                        parents.push_back(parent);
+                    }
+                }
+                return;
+            }
+        }
+    }
+
+    void MimeCache::literalMatches(const std::string& fileName, bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const
+    {
+        unsigned int listOffset, count;
+        if (!card32(LiteralListOffset, listOffset) || !card32(listOffset, count) || !hasRange(listOffset + 4, count, 12)) {
+            return;
+        }
+        std::size_t low = 0, high = count;
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            const std::size_t entry = listOffset + 4 + middle * 12;
+            unsigned int literalOffset = 0, mimeOffset = 0, weight = 0;
+            card32(entry, literalOffset);
+            card32(entry + 4, mimeOffset);
+            card32(entry + 8, weight);
+            const char* literal = string(literalOffset);
+            if (!literal) {
+                return;
+            }
+            const int cmp = std::strcmp(literal, fileName.c_str());
+            if (cmp < 0) {
+                low = middle + 1;
+            } else if (cmp > 0) {
+                high = middle;
+            } else {
+                const char* mimeType = string(mimeOffset);
+                if (mimeType && (caseSensitiveCheck || !(weight & CaseSensitiveFlag))) {
+                    matches.push_back(GlobMatch(mimeType, weight & WeightMask, fileName.size()));
+                }
+                return;
+            }
+        }
+    }
+
+    std::size_t MimeCache::suffixNodeMatches(std::size_t nodeCount, std::size_t nodeOffset, const std::vector<unsigned int>& characters, std::size_t length,
+                                             bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const
+    {
+        if (!hasRange(nodeOffset, nodeCount, 12)) {
+            return 0;
+        }
+        const unsigned int character = characters[length - 1];
+        std::size_t low = 0, high = nodeCount;
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+            const std::size_t node = nodeOffset + middle * 12;
+            unsigned int nodeCharacter = 0;
+            card32(node, nodeCharacter);
+            if (nodeCharacter < character) {
+                low = middle + 1;
+            } else if (nodeCharacter > character) {
+                high = middle;
+            } else {
+                unsigned int childCount = 0, childOffset = 0;
+                card32(node + 4, childCount);
+                card32(node + 8, childOffset);
+                if (!hasRange(childOffset, childCount, 12)) {
+                    return 0;
+                }
+                std::size_t found = 0;
+                if (length > 1) {
+                    found = suffixNodeMatches(childCount, childOffset, characters, length - 1, caseSensitiveCheck, matches);
+                }
+                if (found == 0) {
+                    // leaves have zero character and are sorted before other children
+                    const std::size_t patternLength = characters.size() - length + 1;
+                    for (std::size_t i=0; i<childCount; ++i) {
+                        const std::size_t child = childOffset + i * 12;
+                        unsigned int childCharacter = 0, mimeOffset = 0, weight = 0;
+                        card32(child, childCharacter);
+                        if (childCharacter != 0) {
+                            break;
+                        }
+                        card32(child + 4, mimeOffset);
+                        card32(child + 8, weight);
+                        const char* mimeType = string(mimeOffset);
+                        if (mimeType && (caseSensitiveCheck || !(weight & CaseSensitiveFlag))) {
+                            matches.push_back(GlobMatch(mimeType, weight & WeightMask, patternLength + 1));
+                            ++found;
+                        }
+                    }
+                }
+                return found;
+            }
+        }
+        return 0;
+    }
+
+    void MimeCache::suffixMatches(const std::vector<unsigned int>& characters, bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const
+    {
+        unsigned int treeOffset, rootCount, rootOffset;
+        if (characters.empty() || !card32(ReverseSuffixTreeOffset, treeOffset) || !card32(treeOffset, rootCount) || !card32(treeOffset + 4, rootOffset)) {
+            return;
+        }
+        suffixNodeMatches(rootCount, rootOffset, characters, characters.size(), caseSensitiveCheck, matches);
+    }
+
+    void MimeCache::fullGlobMatches(const std::string& fileName, std::vector<GlobMatch>& matches) const
+    {
+        unsigned int listOffset, count;
+        if (!card32(GlobListOffset, listOffset) || !card32(listOffset, count) || !hasRange(listOffset + 4, count, 12)) {
+            return;
+        }
+        for (std::size_t i=0; i<count; ++i) {
+            const std::size_t entry = listOffset + 4 + i * 12;
+            unsigned int globOffset = 0, mimeOffset = 0, weight = 0;
+            card32(entry, globOffset);
+            card32(entry + 4, mimeOffset);
+            card32(entry + 8, weight);
+            const char* glob = string(globOffset);
+            const char* mimeType = string(mimeOffset);
+            if (glob && mimeType) {
+                if (::fnmatch(glob, fileName.c_str(), (weight & CaseSensitiveFlag) ? 0 : FNM_CASEFOLD) == 0) {
+                    matches.push_back(GlobMatch(mimeType, weight & WeightMask, std::strlen(glob)));
+                }
+            }
+        }
+    }
+
+    void MimeCache::globMatches(const std::string& fileName, std::vector<GlobMatch>& matches) const
+    {
+        if (!isValid() || fileName.empty()) {
+            return;
+        }
+        const std::string lowerFileName = toLowerAscii(fileName);
+
+        literalMatches(fileName, true, matches);
+        if (matches.empty()) {
+            literalMatches(lowerFileName, false, matches);
+        }
+        if (!matches.empty()) {
+            return;
+        }
+
+        std::vector<unsigned int> characters;
+        decodeUtf8(fileName, characters);
+        suffixMatches(characters, true, matches);
+        if (matches.empty()) {
+            for (std::vector<unsigned int>::iterator it = characters.begin(); it != characters.end(); ++it) {
+                *it = toLowerAscii(*it);
+            }
+            suffixMatches(characters, false, matches);
+        }
+        if (!matches.empty()) {
+            return;
+        }
+
+        fullGlobMatches(fileName, matches);
+    }
+
+    const char* MimeCache::mimeTypeForFileName(const std::string& fileName) const
+    {
+        std::vector<GlobMatch> matches;
+        globMatches(fileName, matches);
+        const GlobMatch* best = NULL;
+        for (std::vector<GlobMatch>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+            if (!best || isBetterGlobMatch(*it, *best)) {
+                best = &(*it);
+            }
+        }
+        return best ? best->mimeType : NULL;
+    }
+
+    MimeCaches::MimeCaches() {}
+
+    void MimeCaches::load()
+    {
+        std::vector<std::string> cachePaths;
+        getMimeCachePaths(std::back_inserter(cachePaths));
+        load(cachePaths.begin(), cachePaths.end());
+    }
+
+    void MimeCaches::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> cachePaths;
+        getMimeCachePaths(baseDirs, std::back_inserter(cachePaths));
+        load(cachePaths.begin(), cachePaths.end());
+    }
+
+    bool MimeCaches::add(const std::string& fileName)
+    {
+        try {
+            _caches.push_back(MimeCache(fileName));
+            return true;
+        } catch(std::exception& e) {
+            return false;
+        }
+    }
+
+    std::size_t MimeCaches::size() const
+    {
+        return _caches.size();
+    }
+
+    const MimeCache& MimeCaches::operator[](std::size_t index) const
+    {
+        return _caches[index];
+    }
+
+    std::string MimeCaches::resolveAlias(const std::string& mimeType) const
+    {
+        for (std::vector<MimeCache>::const_iterator it = _caches.begin(); it != _caches.end(); ++it) {
+            const char* canonical = it->unalias(mimeType.c_str());
+            if (canonical) {
+                return canonical;
+            }
+        }
+        return mimeType;
+    }
+
+    const char* MimeCaches::mimeTypeForFileName(const std::string& fileName) const
+    {
+        GlobMatch best;
+        std::vector<GlobMatch> matches;
+        for (std::vector<MimeCache>::const_iterator it = _caches.begin(); it != _caches.end(); ++it) {
+            matches.clear();
+            it->globMatches(fileName, std::back_inserter(matches));
+            for (std::vector<GlobMatch>::const_iterator matchIt = matches.begin(); matchIt != matches.end(); ++matchIt) {
+                if (!best.mimeType || isBetterGlobMatch(*matchIt, best)) {
+                    best = *matchIt;
+                }
+            }
+        }
+        return best.mimeType;
+    }
+}
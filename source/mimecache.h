@@ -0,0 +1,220 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Reading shared-mime-info binary mime.cache files.
+ */
+
+#ifndef MIMEAPPS_MIMECACHE_H
+#define MIMEAPPS_MIMECACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "basedir.h"
+#include "mimehierarchy.h"
+#include "path.h"
+
+namespace mimeapps
+{
+    /// \brief Paths of mime.cache files in order of precedence.
+    template<typename OutputIterator>
+    void getMimeCachePaths(OutputIterator out)
+    {
+        *out = buildPath(dataHome(), "mime/mime.cache");
+        dataDirs(out, "mime/mime.cache");
+    }
+
+    /// \brief ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void getMimeCachePaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        *out = buildPath(baseDirs.dataHome(), "mime/mime.cache");
+        baseDirs.dataDirs(out, "mime/mime.cache");
+    }
+
+    /// \brief MIME type matched by file name pattern.
+    struct GlobMatch
+    {
+        GlobMatch();
+        GlobMatch(const char* mimeType, unsigned int weight, std::size_t patternLength);
+
+        /// Matched MIME type. Points to storage of object that produced the match.
+        const char* mimeType;
+        /// Pattern weight from 0 to 100. Default weight is 50.
+        unsigned int weight;
+        /// Number of characters in pattern. Longer patterns are more specific.
+        std::size_t patternLength;
+    };
+
+    /**
+     * \brief Check if match a is preferred over match b, i.e. it has higher weight or longer pattern.
+     */
+    bool isBetterGlobMatch(const GlobMatch& a, const GlobMatch& b);
+
+    /**
+     * \brief Read-only memory mapping of mime.cache file.
+     *
+     * All queries are served directly from mapped file without copying data.
+     * Every offset read from the file is checked against the mapping size, so corrupted cache can't cause out-of-bounds access.
+     * Returned strings point into the mapping and are valid while MimeCache object is alive.
+     */
+    struct MimeCache
+    {
+        MimeCache();
+        /**
+         * \brief Map mime.cache file.
+         * \throws std::runtime_error if file can't be mapped or has unsupported format.
+         */
+        explicit MimeCache(const std::string& fileName);
+        ~MimeCache();
+
+        MimeCache(MimeCache&& other);
+        MimeCache& operator=(MimeCache&& other);
+
+        bool isValid() const;
+        std::string fileName() const;
+
+        /// Get canonical MIME type for alias. Returns NULL if mimeType is not an alias.
+        const char* unalias(const char* mimeType) const;
+
+        /// Get canonical MIME type for alias or mimeType itself if it's not an alias.
+        std::string resolveAlias(const std::string& mimeType) const;
+
+        /// Get direct parents of MIME type, including implicit text/plain parent of text types.
+        template<typename OutputIterator>
+        void parents(const std::string& mimeType, OutputIterator out) const {
+            const std::string canonical = resolveAlias(mimeType);
+            std::vector<const char*> found;
+            parentList(canonical.c_str(), found);
+            bool hasTextPlain = false;
+            for (std::vector<const char*>::const_iterator it = found.begin(); it != found.end(); ++it) {
+                hasTextPlain = hasTextPlain || std::string(*it) == "text/plain";
+                *out = *it;
+            }
+            if (!hasTextPlain && details::isImplicitTextChild(canonical)) {
+                *out = "text/plain";
+            }
+        }
+
+        /// Get MIME type followed by all its ancestors in breadth-first order. \sa MimeHierarchy::ancestors()
+        template<typename OutputIterator>
+        void ancestors(const std::string& mimeType, OutputIterator out) const {
+            std::vector<std::string> types;
+            details::walkAncestors(*this, mimeType, types);
+            for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+        /**
+         * \brief Match file name against glob tables.
+         *
+         * Literal names are checked first, then the suffix tree and then the rest of globs.
+         * Later tables are consulted only if earlier ones gave no result.
+         * Case-insensitive patterns are matched against lowercased name.
+         * \param out output iterator accepting GlobMatch.
+         */
+        template<typename OutputIterator>
+        void globMatches(const std::string& fileName, OutputIterator out) const {
+            std::vector<GlobMatch> matches;
+            globMatches(fileName, matches);
+            for (std::vector<GlobMatch>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+        /// Get the best MIME type for file name or NULL if no pattern matches.
+        const char* mimeTypeForFileName(const std::string& fileName) const;
+
+    private:
+        MimeCache(const MimeCache&);
+        MimeCache& operator=(const MimeCache&);
+
+        bool card16(std::size_t offset, unsigned int& value) const;
+        bool card32(std::size_t offset, unsigned int& value) const;
+        const char* string(std::size_t offset) const;
+        bool hasRange(std::size_t offset, std::size_t count, std::size_t entrySize) const;
+
+        void parentList(const char* mimeType, std::vector<const char*>& parents) const;
+        void globMatches(const std::string& fileName, std::vector<GlobMatch>& matches) const;
+        void literalMatches(const std::string& fileName, bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const;
+        void suffixMatches(const std::vector<unsigned int>& characters, bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const;
+        std::size_t suffixNodeMatches(std::size_t nodeCount, std::size_t nodeOffset, const std::vector<unsigned int>& characters, std::size_t length,
+                                      bool caseSensitiveCheck, std::vector<GlobMatch>& matches) const;
+        void fullGlobMatches(const std::string& fileName, std::vector<GlobMatch>& matches) const;
+        void unmap();
+
+        const unsigned char* _data;
+        std::size_t _size;
+        std::string _fileName;
+    };
+
+    /**
+     * \brief Set of mime.cache files from shared-mime-info directories.
+     *
+     * Queries consult caches in order of precedence.
+     */
+    struct MimeCaches
+    {
+        MimeCaches();
+
+        /// Map mime.cache files from standard locations. Missing and invalid caches are skipped.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+
+        /// Map given mime.cache files ordered by precedence. Missing and invalid caches are skipped.
+        template<typename Iterator>
+        void load(Iterator first, Iterator last) {
+            for (Iterator it = first; it != last; ++it) {
+                add(*it);
+            }
+        }
+
+        /// Map mime.cache file. Returns false if file is missing or invalid.
+        bool add(const std::string& fileName);
+
+        std::size_t size() const;
+        const MimeCache& operator[](std::size_t index) const;
+
+        std::string resolveAlias(const std::string& mimeType) const;
+
+        /// Get direct parents of MIME type merged from all caches.
+        template<typename OutputIterator>
+        void parents(const std::string& mimeType, OutputIterator out) const {
+            std::vector<std::string> merged, found;
+            for (std::vector<MimeCache>::const_iterator it = _caches.begin(); it != _caches.end(); ++it) {
+                found.clear();
+                it->parents(mimeType, std::back_inserter(found));
+                for (std::vector<std::string>::const_iterator parentIt = found.begin(); parentIt != found.end(); ++parentIt) {
+                    if (std::find(merged.begin(), merged.end(), *parentIt) == merged.end()) {
+                        merged.push_back(*parentIt);
+                        *out = *parentIt;
+                    }
+                }
+            }
+        }
+
+        /// \sa MimeHierarchy::ancestors()
+        template<typename OutputIterator>
+        void ancestors(const std::string& mimeType, OutputIterator out) const {
+            std::vector<std::string> types;
+            details::walkAncestors(*this, mimeType, types);
+            for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+        /// Get the best MIME type for file name among all caches or NULL if no pattern matches.
+        const char* mimeTypeForFileName(const std::string& fileName) const;
+
+    private:
+        std::vector<MimeCache> _caches;
+    };
+}
+
+#endif
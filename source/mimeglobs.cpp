@@ -0,0 +1,287 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+
+#include "mimeglobs.h"
+#include "splitter.h"
+#include "stats.h"
+
+namespace mimeapps
+{
+    namespace {
+        inline char toLowerAscii(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+        }
+
+        std::string toLowerAscii(const char* first, const char* last)
+        {
+            std::string result(first, last);
+            for (std::string::iterator it = result.begin(); it != result.end(); ++it) {
+                *it = toLowerAscii(*it);
+            }
+            return result;
+        }
+
+        bool hasWildcards(const char* first, const char* last)
+        {
+            for (const char* it = first; it != last; ++it) {
+                if (*it == '*' || *it == '?' || *it == '[') {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    MimeGlobs::SuffixTrie::SuffixTrie() : patterns(1) {}
+
+    void MimeGlobs::SuffixTrie::insert(const std::string& suffix, unsigned int pattern)
+    {
+        unsigned long node = 0;
+        for (std::string::const_reverse_iterator it = suffix.rbegin(); it != suffix.rend(); ++it) {
+            const unsigned long key = (node << 8) | static_cast<unsigned char>(*it);
+            std::unordered_map<unsigned long, unsigned int>::const_iterator found = transitions.find(key);
+            if (found == transitions.end()) {
+                const unsigned int child = static_cast<unsigned int>(patterns.size());
+                patterns.push_back(std::vector<unsigned int>());
+                transitions[key] = child;
+                node = child;
+            } else {
+                node = found->second;
+            }
+        }
+        patterns[node].push_back(pattern);
+    }
+
+    void MimeGlobs::SuffixTrie::clear()
+    {
+        transitions.clear();
+        patterns.assign(1, std::vector<unsigned int>());
+    }
+
+    MimeGlobs::MimeGlobs() {}
+
+    void MimeGlobs::load()
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeGlobs::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(baseDirs, std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeGlobs::loadDirectory(const std::string& mimeDir)
+    {
+        std::ifstream globs2(buildPath(mimeDir, "globs2").c_str());
+        if (globs2.is_open()) {
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            addGlobs2(globs2);
+            return;
+        }
+        std::ifstream globs(buildPath(mimeDir, "globs").c_str());
+        if (globs.is_open()) {
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            addGlobs(globs);
+        }
+    }
+
+    void MimeGlobs::addGlobs2(std::istream& stream)
+    {
+        typedef Splitter<std::string::const_iterator> SplitterType;
+
+        std::unordered_set<std::string> noGlobs;
+        std::string line;
+        std::vector<std::string> fields;
+        while(getline(stream, line)) {
+            MIMEAPPS_STAT_ADD(LinesParsed, 1);
+            MIMEAPPS_STAT_ADD(BytesRead, line.size() + 1);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            fields.clear();
+            SplitterType splitter(line.begin(), line.end(), ':');
+            for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+                fields.push_back(std::string(it->first, it->second));
+            }
+            if (fields.size() < 3 || fields[1].empty() || fields[2].empty()) {
+                continue;
+            }
+            const std::string& mimeType = fields[1];
+            const std::string& pattern = fields[2];
+            if (pattern == "__NOGLOBS__") {
+                noGlobs.insert(mimeType);
+                continue;
+            }
+            if (_noGlobs.find(mimeType) != _noGlobs.end()) {
+                continue;
+            }
+            bool caseSensitive = false;
+            if (fields.size() > 3) {
+                SplitterType flagSplitter(fields[3].begin(), fields[3].end(), ',');
+                for (SplitterType::iterator it = flagSplitter.begin(); it != flagSplitter.end(); ++it) {
+                    if (std::string(it->first, it->second) == "cs") {
+                        caseSensitive = true;
+                    }
+                }
+            }
+            const long weight = std::strtol(fields[0].c_str(), NULL, 10);
+            addPattern(mimeType, pattern, static_cast<unsigned int>(std::min(std::max(weight, 0L), 100L)), caseSensitive);
+        }
+        _noGlobs.insert(noGlobs.begin(), noGlobs.end());
+    }
+
+    void MimeGlobs::addGlobs(std::istream& stream)
+    {
+        std::string line;
+        while(getline(stream, line)) {
+            MIMEAPPS_STAT_ADD(LinesParsed, 1);
+            MIMEAPPS_STAT_ADD(BytesRead, line.size() + 1);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            const std::string::size_type colon = line.find(':');
+            if (colon == std::string::npos || colon == 0 || colon + 1 == line.size()) {
+                continue;
+            }
+            const std::string mimeType = line.substr(0, colon);
+            if (_noGlobs.find(mimeType) == _noGlobs.end()) {
+                addPattern(mimeType, line.substr(colon + 1));
+            }
+        }
+    }
+
+    void MimeGlobs::addPattern(const std::string& mimeType, const std::string& pattern, unsigned int weight, bool caseSensitive)
+    {
+        if (mimeType.empty() || pattern.empty()) {
+            return;
+        }
+        const unsigned int index = static_cast<unsigned int>(_patterns.size());
+        Pattern p;
+        p.mimeType = mimeType;
+        p.glob = pattern;
+        p.weight = weight;
+        p.caseSensitive = caseSensitive;
+        _patterns.push_back(p);
+
+        const char* first = pattern.data();
+        const char* last = first + pattern.size();
+        if (!hasWildcards(first, last)) {
+            if (caseSensitive) {
+                _literals[pattern].push_back(index);
+            } else {
+                _lowerLiterals[toLowerAscii(first, last)].push_back(index);
+            }
+        } else if (*first == '*' && last - first > 1 && !hasWildcards(first + 1, last)) {
+            if (caseSensitive) {
+                _suffixes.insert(std::string(first + 1, last), index);
+            } else {
+                _lowerSuffixes.insert(toLowerAscii(first + 1, last), index);
+            }
+        } else {
+            _complex.push_back(index);
+        }
+    }
+
+    void MimeGlobs::clear()
+    {
+        _patterns.clear();
+        _literals.clear();
+        _lowerLiterals.clear();
+        _suffixes.clear();
+        _lowerSuffixes.clear();
+        _complex.clear();
+        _noGlobs.clear();
+    }
+
+    std::size_t MimeGlobs::size() const
+    {
+        return _patterns.size();
+    }
+
+    GlobMatch MimeGlobs::makeMatch(unsigned int pattern) const
+    {
+        const Pattern& p = _patterns[pattern];
+        return GlobMatch(p.mimeType.c_str(), p.weight, p.glob.size());
+    }
+
+    void MimeGlobs::suffixMatches(const SuffixTrie& trie, const char* first, const char* last, bool lowercase, std::vector<GlobMatch>& matches) const
+    {
+        unsigned long node = 0;
+        for (const char* it = last; it != first;) {
+            --it;
+            const char c = lowercase ? toLowerAscii(*it) : *it;
+            std::unordered_map<unsigned long, unsigned int>::const_iterator found = trie.transitions.find((node << 8) | static_cast<unsigned char>(c));
+            if (found == trie.transitions.end()) {
+                break;
+            }
+            node = found->second;
+            const std::vector<unsigned int>& patterns = trie.patterns[node];
+            for (std::vector<unsigned int>::const_iterator patternIt = patterns.begin(); patternIt != patterns.end(); ++patternIt) {
+                matches.push_back(makeMatch(*patternIt));
+            }
+        }
+    }
+
+    void MimeGlobs::globMatches(const std::string& path, std::vector<GlobMatch>& matches) const
+    {
+        const std::string::size_type slash = path.rfind('/');
+        const char* first = path.data() + (slash == std::string::npos ? 0 : slash + 1);
+        const char* last = path.data() + path.size();
+        if (first == last) {
+            return;
+        }
+
+        const std::size_t start = matches.size();
+        LiteralMap::const_iterator found = _literals.find(std::string(first, last));
+        if (found != _literals.end()) {
+            for (std::vector<unsigned int>::const_iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                matches.push_back(makeMatch(*it));
+            }
+        }
+        if (!_lowerLiterals.empty()) {
+            found = _lowerLiterals.find(toLowerAscii(first, last));
+            if (found != _lowerLiterals.end()) {
+                for (std::vector<unsigned int>::const_iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                    matches.push_back(makeMatch(*it));
+                }
+            }
+        }
+
+        if (matches.size() == start) {
+            suffixMatches(_suffixes, first, last, false, matches);
+            suffixMatches(_lowerSuffixes, first, last, true, matches);
+        }
+
+        if (matches.size() == start) {
+            const std::string fileName(first, last);
+            for (std::vector<unsigned int>::const_iterator it = _complex.begin(); it != _complex.end(); ++it) {
+                const Pattern& p = _patterns[*it];
+                if (::fnmatch(p.glob.c_str(), fileName.c_str(), p.caseSensitive ? 0 : FNM_CASEFOLD) == 0) {
+                    matches.push_back(makeMatch(*it));
+                }
+            }
+        }
+
+        std::stable_sort(matches.begin() + start, matches.end(), isBetterGlobMatch);
+    }
+
+    const char* MimeGlobs::mimeTypeForFileName(const std::string& fileName) const
+    {
+        std::vector<GlobMatch> matches;
+        globMatches(fileName, matches);
+        return matches.empty() ? NULL : matches.front().mimeType;
+    }
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Detecting MIME type by file name using shared-mime-info globs2 files.
+ */
+
+#ifndef MIMEAPPS_MIMEGLOBS_H
+#define MIMEAPPS_MIMEGLOBS_H
+
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mimecache.h"
+
+namespace mimeapps
+{
+    /**
+     * \brief File name patterns of all MIME types compiled for fast matching.
+     *
+     * Patterns are split in three groups like shared-mime-info specification suggests:
+     * literal file names (hash lookup), simple suffixes like "*.tar.gz" (reverse trie walked from the end of file name)
+     * and the rest of patterns, which are matched with fnmatch only if the first two groups gave nothing.
+     * Thereby file name is resolved in O(length of name) in common case.
+     *
+     * Case-insensitive patterns are matched against file name with ASCII letters lowercased.
+     */
+    struct MimeGlobs
+    {
+        MimeGlobs();
+
+        /// Load globs2 (or legacy globs) files from standard shared-mime-info directories.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+
+        /// Load globs files from given shared-mime-info directories ordered by precedence.
+        template<typename Iterator>
+        void load(Iterator first, Iterator last) {
+            for (Iterator it = first; it != last; ++it) {
+                loadDirectory(*it);
+            }
+        }
+
+        /// Read globs2 file, or globs file if there's no globs2, from shared-mime-info directory.
+        void loadDirectory(const std::string& mimeDir);
+
+        /**
+         * \brief Read globs2 file contents (lines of form "weight:mimetype:pattern[:flags]").
+         *
+         * Files must be added in order of precedence.
+         * __NOGLOBS__ pattern makes patterns of MIME type from files added later to be ignored.
+         */
+        void addGlobs2(std::istream& stream);
+        /// Read legacy globs file contents (lines of form "mimetype:pattern"). All patterns get default weight.
+        void addGlobs(std::istream& stream);
+
+        /// Add single pattern.
+        void addPattern(const std::string& mimeType, const std::string& pattern, unsigned int weight = 50, bool caseSensitive = false);
+
+        void clear();
+
+        /// Number of added patterns.
+        std::size_t size() const;
+
+        /**
+         * \brief Match file name against patterns.
+         *
+         * Directory part of path is ignored.
+         * Matches of the first group that gave any result are written ordered from best to worst.
+         * \param out output iterator accepting GlobMatch. Pointers in GlobMatch are valid until MimeGlobs is modified.
+         */
+        template<typename OutputIterator>
+        void globMatches(const std::string& fileName, OutputIterator out) const {
+            std::vector<GlobMatch> matches;
+            globMatches(fileName, matches);
+            for (std::vector<GlobMatch>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+        /// Get the best MIME type for file name or NULL if no pattern matches.
+        const char* mimeTypeForFileName(const std::string& fileName) const;
+
+    private:
+        struct Pattern
+        {
+            std::string mimeType;
+            std::string glob;
+            unsigned int weight;
+            bool caseSensitive;
+        };
+
+        typedef std::unordered_map<std::string, std::vector<unsigned int> > LiteralMap;
+
+        /// Reverse trie of pattern suffixes. Node 0 is root.
+        struct SuffixTrie
+        {
+            SuffixTrie();
+            void insert(const std::string& suffix, unsigned int pattern);
+            void clear();
+
+            std::unordered_map<unsigned long, unsigned int> transitions;
+            std::vector<std::vector<unsigned int> > patterns;
+        };
+
+        void globMatches(const std::string& fileName, std::vector<GlobMatch>& matches) const;
+        void suffixMatches(const SuffixTrie& trie, const char* first, const char* last, bool lowercase, std::vector<GlobMatch>& matches) const;
+        GlobMatch makeMatch(unsigned int pattern) const;
+
+        std::vector<Pattern> _patterns;
+        LiteralMap _literals;
+        LiteralMap _lowerLiterals;
+        SuffixTrie _suffixes;
+        SuffixTrie _lowerSuffixes;
+        std::vector<unsigned int> _complex;
+        std::unordered_set<std::string> _noGlobs;
+    };
+}
+
+#endif
@@ -0,0 +1,126 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "mimehierarchy.h"
+#include "stats.h"
+
+namespace mimeapps
+{
+    static bool startsWith(const std::string& str, const char* prefix)
+    {
+        return str.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+    }
+
+    static bool readPair(const std::string& line, std::string& first, std::string& second)
+    {
+        if (line.empty() || line[0] == '#') {
+            return false;
+        }
+        std::istringstream stream(line);
+        return (stream >> first >> second) && !first.empty() && !second.empty();
+    }
+
+    MimeHierarchy::MimeHierarchy() {}
+
+    void MimeHierarchy::load()
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeHierarchy::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(baseDirs, std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeHierarchy::loadDirectory(const std::string& mimeDir)
+    {
+        std::ifstream aliases(buildPath(mimeDir, "aliases").c_str());
+        if (aliases.is_open()) {
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            addAliases(aliases);
+        }
+        std::ifstream subclasses(buildPath(mimeDir, "subclasses").c_str());
+        if (subclasses.is_open()) {
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            addSubclasses(subclasses);
+        }
+    }
+
+    void MimeHierarchy::addAliases(std::istream& stream)
+    {
+        std::string line, alias, canonical;
+        while(getline(stream, line)) {
+            MIMEAPPS_STAT_ADD(LinesParsed, 1);
+            MIMEAPPS_STAT_ADD(BytesRead, line.size() + 1);
+            if (readPair(line, alias, canonical) && _aliases.find(alias) == _aliases.end()) {
+                _aliases[alias] = intern(canonical);
+            }
+        }
+    }
+
+    void MimeHierarchy::addSubclasses(std::istream& stream)
+    {
+        std::string line, mimeType, parent;
+        while(getline(stream, line)) {
+            MIMEAPPS_STAT_ADD(LinesParsed, 1);
+            MIMEAPPS_STAT_ADD(BytesRead, line.size() + 1);
+            if (readPair(line, mimeType, parent)) {
+                const Id childId = intern(mimeType);
+                const Id parentId = intern(parent);
+                std::vector<Id>& parentIds = _parents[childId];
+                if (std::find(parentIds.begin(), parentIds.end(), parentId) == parentIds.end()) {
+                    parentIds.push_back(parentId);
+                }
+            }
+        }
+    }
+
+    void MimeHierarchy::clear()
+    {
+        _ids.clear();
+        _names.clear();
+        _parents.clear();
+        _aliases.clear();
+    }
+
+    std::string MimeHierarchy::resolveAlias(const std::string& mimeType) const
+    {
+        std::unordered_map<std::string, Id>::const_iterator found = _aliases.find(mimeType);
+        if (found != _aliases.end()) {
+            return _names[found->second];
+        }
+        return mimeType;
+    }
+
+    MimeHierarchy::Id MimeHierarchy::intern(const std::string& mimeType)
+    {
+        std::unordered_map<std::string, Id>::iterator found = _ids.find(mimeType);
+        if (found != _ids.end()) {
+            return found->second;
+        }
+        const Id id = static_cast<Id>(_names.size());
+        _ids[mimeType] = id;
+        _names.push_back(mimeType);
+        _parents.push_back(std::vector<Id>());
+        return id;
+    }
+
+    bool details::isImplicitTextChild(const std::string& mimeType)
+    {
+        return startsWith(mimeType, "text/") && mimeType != "text/plain";
+    }
+
+    bool details::isStreamable(const std::string& mimeType)
+    {
+        return !startsWith(mimeType, "inode/") && !startsWith(mimeType, "x-scheme-handler/");
+    }
+}
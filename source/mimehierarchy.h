@@ -0,0 +1,171 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief MIME type aliases and subclasses from shared-mime-info.
+ */
+
+#ifndef MIMEAPPS_MIMEHIERARCHY_H
+#define MIMEAPPS_MIMEHIERARCHY_H
+
+#include <algorithm>
+#include <istream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "basedir.h"
+#include "path.h"
+
+namespace mimeapps
+{
+    namespace details {
+        /// Check if MIME type is text/* other than text/plain, i.e. implicit subclass of text/plain.
+        bool isImplicitTextChild(const std::string& mimeType);
+        /// Check if MIME type is implicit subclass of application/octet-stream.
+        bool isStreamable(const std::string& mimeType);
+
+        /**
+         * \brief Breadth-first walk over MIME type ancestors.
+         * \param hierarchy object providing resolveAlias(mimeType) and parents(mimeType, out).
+         * \sa MimeHierarchy::ancestors()
+         */
+        template<typename Hierarchy>
+        void walkAncestors(const Hierarchy& hierarchy, const std::string& mimeType, std::vector<std::string>& types)
+        {
+            const char* const octetStream = "application/octet-stream";
+            const std::string canonical = hierarchy.resolveAlias(mimeType);
+            if (canonical.empty()) {
+                return;
+            }
+            types.push_back(canonical);
+            std::vector<std::string> direct;
+            for (std::size_t i=0; i<types.size(); ++i) {
+                direct.clear();
+                hierarchy.parents(types[i], std::back_inserter(direct));
+                for (std::vector<std::string>::const_iterator it = direct.begin(); it != direct.end(); ++it) {
+                    const std::string parent = hierarchy.resolveAlias(*it);
+                    if (parent != octetStream && std::find(types.begin(), types.end(), parent) == types.end()) {
+                        types.push_back(parent);
+                    }
+                }
+            }
+            if (isStreamable(canonical) && std::find(types.begin(), types.end(), octetStream) == types.end()) {
+                types.push_back(octetStream);
+            }
+        }
+    }
+
+    /// \brief Paths of shared-mime-info directories in order of precedence.
+    template<typename OutputIterator>
+    void getMimePaths(OutputIterator out)
+    {
+        *out = buildPath(dataHome(), "mime");
+        dataDirs(out, "mime");
+    }
+
+    /// \brief ditto, but use snapshot of base directories.
+    template<typename OutputIterator>
+    void getMimePaths(const BaseDirs& baseDirs, OutputIterator out)
+    {
+        *out = buildPath(baseDirs.dataHome(), "mime");
+        baseDirs.dataDirs(out, "mime");
+    }
+
+    /**
+     * \brief Graph of MIME type parents built from shared-mime-info aliases and subclasses files.
+     *
+     * MIME type names are interned, so each name is stored once no matter how many types it's a parent of.
+     * Walking the ancestors still resolves aliases and copies names into the result list.
+     */
+    struct MimeHierarchy
+    {
+        MimeHierarchy();
+
+        /// Load aliases and subclasses from standard shared-mime-info directories.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+
+        /// Load aliases and subclasses from given shared-mime-info directories ordered by precedence.
+        template<typename Iterator>
+        void load(Iterator first, Iterator last) {
+            for (Iterator it = first; it != last; ++it) {
+                loadDirectory(*it);
+            }
+        }
+
+        /// Read aliases and subclasses files from one shared-mime-info directory.
+        void loadDirectory(const std::string& mimeDir);
+
+        /// Read lines of form "alias canonical". Aliases that are already known are not overridden.
+        void addAliases(std::istream& stream);
+        /// Read lines of form "mimetype parent".
+        void addSubclasses(std::istream& stream);
+
+        void clear();
+
+        /// List canonical MIME types mentioned in aliases and subclasses files. Aliases themselves are not listed.
+        template<typename OutputIterator>
+        void mimeTypes(OutputIterator out) const {
+            for (std::vector<std::string>::const_iterator it = _names.begin(); it != _names.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+        /// Get canonical name for alias or mimeType itself if it's not an alias.
+        std::string resolveAlias(const std::string& mimeType) const;
+
+        /**
+         * \brief Get direct parents of MIME type, including implicit text/plain parent of text types.
+         * \note application/octet-stream is not reported here, see ancestors().
+         */
+        template<typename OutputIterator>
+        void parents(const std::string& mimeType, OutputIterator out) const {
+            const std::string canonical = resolveAlias(mimeType);
+            bool hasTextPlain = false;
+            std::unordered_map<std::string, Id>::const_iterator found = _ids.find(canonical);
+            if (found != _ids.end()) {
+                const std::vector<Id>& ids = _parents[found->second];
+                for (std::vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+                    hasTextPlain = hasTextPlain || _names[*it] == "text/plain";
+                    *out = _names[*it];
+                }
+            }
+            if (!hasTextPlain && details::isImplicitTextChild(canonical)) {
+                *out = "text/plain";
+            }
+        }
+
+        /**
+         * \brief Get MIME type itself followed by all its ancestors in breadth-first order.
+         *
+         * This is the order in which applications associated with MIME type should be looked up.
+         * Per shared-mime-info specification text types fall back to text/plain
+         * and all streamable types fall back to application/octet-stream, which is always last.
+         */
+        template<typename OutputIterator>
+        void ancestors(const std::string& mimeType, OutputIterator out) const {
+            std::vector<std::string> types;
+            details::walkAncestors(*this, mimeType, types);
+            for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+                *out = *it;
+            }
+        }
+
+    private:
+        typedef unsigned int Id;
+
+        Id intern(const std::string& mimeType);
+
+        std::unordered_map<std::string, Id> _ids;
+        std::vector<std::string> _names;
+        std::vector<std::vector<Id> > _parents;
+        std::unordered_map<std::string, Id> _aliases;
+    };
+}
+
+#endif
@@ -0,0 +1,276 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#include "mimeinfocache.h"
+#include "desktopfile.h"
+#include "inilike.h"
+#include "path.h"
+#include "splitter.h"
+#include "stats.h"
+#include "system.h"
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        const char* const cacheGroup = "MIME Cache";
+
+        typedef std::map<std::string, std::vector<std::string> > MimeTypesById;
+
+        long long changeTimeOf(const struct stat& st)
+        {
+            const long long mtime = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+            const long long ctime = static_cast<long long>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+            return std::max(mtime, ctime);
+        }
+
+        bool endsWith(const std::string& str, const char* suffix)
+        {
+            const std::size_t length = std::strlen(suffix);
+            return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+        }
+
+        bool desktopIdLess(const details::DesktopEntryFile& a, const details::DesktopEntryFile& b)
+        {
+            return a.desktopId < b.desktopId || (a.desktopId == b.desktopId && a.path < b.path);
+        }
+
+        bool sameDesktopId(const details::DesktopEntryFile& a, const details::DesktopEntryFile& b)
+        {
+            return a.desktopId == b.desktopId;
+        }
+
+        /**
+         * \param dirChangeTime latest change time of subdirectories on the way from applications directory to dir.
+         * Renaming subdirectory changes desktop ids of files in it without touching the files, so it counts as their change.
+         */
+        void listDirectory(const std::string& dir, const std::string& idPrefix, long long dirChangeTime, std::vector<details::DesktopEntryFile>& files)
+        {
+            DIR* d = ::opendir(dir.c_str());
+            if (!d) {
+                if (idPrefix.empty()) {
+                    throw details::fileError("Could not read directory", dir);
+                }
+                return;
+            }
+            struct dirent* entry;
+            while((entry = ::readdir(d)) != NULL) {
+                const std::string name = entry->d_name;
+                if (name == "." || name == "..") {
+                    continue;
+                }
+                const std::string path = buildPath(dir, name);
+                struct stat st;
+                MIMEAPPS_STAT_ADD(StatCalls, 1);
+                if (::lstat(path.c_str(), &st) != 0) {
+                    continue;
+                }
+                if (S_ISDIR(st.st_mode)) {
+                    listDirectory(path, idPrefix + name + '-', std::max(dirChangeTime, changeTimeOf(st)), files);
+                    continue;
+                }
+                if (S_ISLNK(st.st_mode)) {
+                    // Symlinks to directories are not followed to avoid loops, but symlinks to files are fine.
+                    MIMEAPPS_STAT_ADD(StatCalls, 1);
+                    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                        continue;
+                    }
+                }
+                if (S_ISREG(st.st_mode) && endsWith(name, ".desktop")) {
+                    details::DesktopEntryFile file;
+                    file.desktopId = idPrefix + name;
+                    file.path = path;
+                    file.changeTime = std::max(changeTimeOf(st), dirChangeTime);
+                    files.push_back(file);
+                }
+            }
+            ::closedir(d);
+        }
+
+        struct CacheReader
+        {
+            CacheReader(MimeTypesById& mimeTypesById) : _mimeTypesById(mimeTypesById) {}
+
+            void operator()(const std::string& group, const std::string& mimeType, const std::string& value) {
+                if (group != cacheGroup) {
+                    return;
+                }
+                typedef Splitter<std::string::const_iterator> SplitterType;
+                SplitterType splitter(value.begin(), value.end(), ';');
+                for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
+                    if (it->first != it->second) {
+                        _mimeTypesById[std::string(it->first, it->second)].push_back(mimeType);
+                    }
+                }
+            }
+        private:
+            MimeTypesById& _mimeTypesById;
+        };
+
+        /// Read existing cache. Return false if there's no usable cache.
+        bool readCache(const std::string& path, long long& cacheTime, MimeTypesById& mimeTypesById)
+        {
+            struct stat st;
+            MIMEAPPS_STAT_ADD(StatCalls, 1);
+            if (::stat(path.c_str(), &st) != 0) {
+                return false;
+            }
+            std::ifstream stream(path.c_str());
+            if (!stream.is_open()) {
+                return false;
+            }
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            try {
+                readKeyValues(stream, CacheReader(mimeTypesById));
+            } catch(std::exception& e) {
+                mimeTypesById.clear();
+                return false;
+            }
+            cacheTime = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+            return true;
+        }
+
+        void parseMimeTypes(const std::string& path, std::vector<std::string>& mimeTypes)
+        {
+            try {
+                DesktopFile desktopFile(path);
+                if (desktopFile.isValid() && !desktopFile.hidden()) {
+                    desktopFile.mimeTypes(std::back_inserter(mimeTypes));
+                }
+            } catch(std::exception& e) {
+                // Malformed desktop files don't contribute to cache, as well as hidden ones.
+            }
+        }
+
+        /// Files to parse shared by worker threads. Each result slot is written by exactly one thread.
+        struct ParseQueue
+        {
+            ParseQueue(const std::vector<details::DesktopEntryFile>& files, const std::vector<std::size_t>& toParse,
+                       std::vector<std::vector<std::string> >& results) : _files(files), _toParse(toParse), _results(results), _next(0) {}
+
+            void work() {
+                std::size_t i;
+                while((i = _next++) < _toParse.size()) {
+                    parseMimeTypes(_files[_toParse[i]].path, _results[_toParse[i]]);
+                }
+            }
+        private:
+            const std::vector<details::DesktopEntryFile>& _files;
+            const std::vector<std::size_t>& _toParse;
+            std::vector<std::vector<std::string> >& _results;
+            std::atomic<std::size_t> _next;
+        };
+    }
+
+    MimeInfoCacheStats::MimeInfoCacheStats() : desktopFiles(0), parsed(0), mimeTypes(0), threads(0) {}
+
+    void details::listDesktopEntryFiles(const std::string& applicationsDir, std::vector<DesktopEntryFile>& files)
+    {
+        files.clear();
+        listDirectory(applicationsDir, std::string(), 0, files);
+        std::sort(files.begin(), files.end(), desktopIdLess);
+        files.erase(std::unique(files.begin(), files.end(), sameDesktopId), files.end());
+    }
+
+    std::string details::formatMimeInfoCache(const std::map<std::string, std::vector<std::string> >& associations)
+    {
+        std::string contents = std::string("[") + cacheGroup + "]\n";
+        for (std::map<std::string, std::vector<std::string> >::const_iterator it = associations.begin(); it != associations.end(); ++it) {
+            contents += it->first;
+            contents += '=';
+            for (std::vector<std::string>::const_iterator idIt = it->second.begin(); idIt != it->second.end(); ++idIt) {
+                contents += *idIt;
+                contents += ';';
+            }
+            contents += '\n';
+        }
+        return contents;
+    }
+
+    MimeInfoCacheStats generateMimeInfoCache(const std::string& applicationsDir, bool incremental, unsigned int threadCount)
+    {
+        details::TraceSpan span("generate_mimeinfo_cache");
+        span.addAttribute("path", applicationsDir);
+
+        MimeInfoCacheStats stats;
+        const std::string cachePath = buildPath(applicationsDir, "mimeinfo.cache");
+
+        std::vector<details::DesktopEntryFile> files;
+        details::listDesktopEntryFiles(applicationsDir, files);
+        stats.desktopFiles = files.size();
+
+        MimeTypesById previous;
+        long long cacheTime = 0;
+        const bool usePrevious = incremental && readCache(cachePath, cacheTime, previous);
+
+        std::vector<std::vector<std::string> > results(files.size());
+        std::vector<std::size_t> toParse;
+        for (std::size_t i=0; i<files.size(); ++i) {
+            if (usePrevious && files[i].changeTime < cacheTime) {
+                MimeTypesById::iterator found = previous.find(files[i].desktopId);
+                if (found != previous.end()) {
+                    results[i].swap(found->second);
+                }
+            } else {
+                toParse.push_back(i);
+            }
+        }
+        stats.parsed = toParse.size();
+
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        if (threadCount > toParse.size()) {
+            threadCount = static_cast<unsigned int>(toParse.empty() ? 1 : toParse.size());
+        }
+        stats.threads = threadCount;
+
+        ParseQueue queue(files, toParse, results);
+        if (threadCount == 1) {
+            queue.work();
+        } else {
+            std::vector<std::thread> threads;
+            for (unsigned int i=0; i<threadCount; ++i) {
+                threads.push_back(std::thread(&ParseQueue::work, &queue));
+            }
+            for (std::size_t i=0; i<threads.size(); ++i) {
+                threads[i].join();
+            }
+        }
+
+        // Files are sorted by desktop id, so ids of every MIME type come out sorted regardless of parsing order.
+        std::map<std::string, std::vector<std::string> > associations;
+        for (std::size_t i=0; i<files.size(); ++i) {
+            for (std::vector<std::string>::const_iterator it = results[i].begin(); it != results[i].end(); ++it) {
+                std::vector<std::string>& desktopIds = associations[*it];
+                if (desktopIds.empty() || desktopIds.back() != files[i].desktopId) {
+                    desktopIds.push_back(files[i].desktopId);
+                }
+            }
+        }
+        stats.mimeTypes = associations.size();
+
+        details::writeFileAtomically(cachePath, details::formatMimeInfoCache(associations));
+
+        span.addAttribute("desktop_files", stats.desktopFiles);
+        span.addAttribute("parsed", stats.parsed);
+        return stats;
+    }
+}
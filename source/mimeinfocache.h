@@ -0,0 +1,71 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Generating mimeinfo.cache files.
+ */
+
+#ifndef MIMEAPPS_MIMEINFOCACHE_H
+#define MIMEAPPS_MIMEINFOCACHE_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mimeapps
+{
+    /// \brief Result of generateMimeInfoCache().
+    struct MimeInfoCacheStats
+    {
+        MimeInfoCacheStats();
+
+        /// Number of desktop files found in applications directory.
+        std::size_t desktopFiles;
+        /// Number of desktop files that were parsed. Others were taken from previous cache.
+        std::size_t parsed;
+        /// Number of MIME types written to cache.
+        std::size_t mimeTypes;
+        /// Number of threads used for parsing.
+        unsigned int threads;
+    };
+
+    namespace details {
+        /// Desktop file found in applications directory.
+        struct DesktopEntryFile
+        {
+            std::string desktopId;
+            std::string path;
+            /// Latest of modification and status change times in nanoseconds, including ones of subdirectories file is in.
+            long long changeTime;
+        };
+
+        /**
+         * \brief Find desktop files in applications directory and its subdirectories.
+         * Files are sorted by desktop id. If several files have the same desktop id, only the first one is kept.
+         * \throws std::runtime_error if directory can't be read.
+         */
+        void listDesktopEntryFiles(const std::string& applicationsDir, std::vector<DesktopEntryFile>& files);
+
+        /// Format mimeinfo.cache contents from MIME types mapped to desktop ids.
+        std::string formatMimeInfoCache(const std::map<std::string, std::vector<std::string> >& associations);
+    }
+
+    /**
+     * \brief Generate mimeinfo.cache in applications directory, like update-desktop-database does.
+     *
+     * Desktop files are parsed in parallel. Output does not depend on number of threads or order of files in directory:
+     * MIME types and desktop ids of each MIME type are sorted. Cache file is replaced atomically.
+     * \param incremental if true and cache exists, desktop files whose modification and status change times
+     * are older than cache are not parsed, their MIME types are taken from the existing cache instead.
+     * Status change time is checked too, so files installed with preserved modification time are still parsed.
+     * Files in subdirectories that were renamed or moved since cache was written are parsed too, since their desktop ids changed.
+     * \param threadCount number of parsing threads. 0 means number of hardware threads.
+     * \throws std::runtime_error if directory can't be read or cache can't be written.
+     */
+    MimeInfoCacheStats generateMimeInfoCache(const std::string& applicationsDir, bool incremental = false, unsigned int threadCount = 0);
+}
+
+#endif
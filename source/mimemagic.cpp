@@ -0,0 +1,415 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "mimemagic.h"
+#include "mimehierarchy.h"
+#include "stats.h"
+
+namespace mimeapps
+{
+    namespace {
+        bool isLittleEndian()
+        {
+            const unsigned short value = 1;
+            return *reinterpret_cast<const unsigned char*>(&value) == 1;
+        }
+
+        unsigned int readNumber(std::istream& stream)
+        {
+            unsigned long number = 0;
+            bool hasDigits = false;
+            while (stream.peek() >= '0' && stream.peek() <= '9') {
+                number = number * 10 + static_cast<unsigned long>(stream.get() - '0');
+                if (number > 0xFFFFFFFFUL) {
+                    throw std::runtime_error("Number is too large in magic rule");
+                }
+                hasDigits = true;
+            }
+            if (!hasDigits) {
+                throw std::runtime_error("Expected number in magic rule");
+            }
+            return static_cast<unsigned int>(number);
+        }
+
+        void expect(std::istream& stream, char c)
+        {
+            if (stream.get() != c) {
+                throw std::runtime_error(std::string("Expected '") + c + "' in magic rule");
+            }
+        }
+
+        void readBytes(std::istream& stream, std::size_t count, std::vector<unsigned char>& bytes)
+        {
+            const std::size_t start = bytes.size();
+            bytes.resize(start + count);
+            if (count && !stream.read(reinterpret_cast<char*>(&bytes[start]), static_cast<std::streamsize>(count))) {
+                throw std::runtime_error("Unexpected end of magic rule");
+            }
+        }
+
+        void swapWords(unsigned char* bytes, std::size_t length, unsigned int wordSize)
+        {
+            for (std::size_t i=0; i + wordSize <= length; i += wordSize) {
+                std::reverse(bytes + i, bytes + i + wordSize);
+            }
+        }
+
+        struct PriorityGreater
+        {
+            template<typename Rule>
+            bool operator()(const Rule& a, const Rule& b) const {
+                return a.priority > b.priority;
+            }
+        };
+    }
+
+    MimeMagic::MimeMagic(std::size_t cacheCapacity) : _maxExtent(0), _cacheCapacity(cacheCapacity), _cacheHits(0), _cacheMisses(0) {}
+
+    void MimeMagic::load()
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeMagic::load(const BaseDirs& baseDirs)
+    {
+        std::vector<std::string> mimePaths;
+        getMimePaths(baseDirs, std::back_inserter(mimePaths));
+        load(mimePaths.begin(), mimePaths.end());
+    }
+
+    void MimeMagic::loadDirectory(const std::string& mimeDir)
+    {
+        std::ifstream stream(buildPath(mimeDir, "magic").c_str(), std::ifstream::binary);
+        if (stream.is_open()) {
+            MIMEAPPS_STAT_ADD(FilesOpened, 1);
+            try {
+                addMagic(stream);
+            } catch(std::exception& e) {
+
+            }
+        }
+    }
+
+    void MimeMagic::addMagic(std::istream& stream)
+    {
+        static const char signature[] = "MIME-Magic\0\n";
+        char header[sizeof(signature) - 1];
+        if (!stream.read(header, sizeof(header)) || std::memcmp(header, signature, sizeof(header)) != 0) {
+            throw std::runtime_error("Not a magic file");
+        }
+
+        // Parse into local copies, so index is not modified if file is malformed.
+        std::vector<Rule> rules;
+        std::vector<Matchlet> matchlets = _matchlets;
+        std::vector<unsigned char> bytes = _bytes;
+        std::vector<std::string> mimeTypes = _mimeTypes;
+        std::vector<unsigned int> indents;
+        std::unordered_set<std::string> noMagic;
+        std::size_t maxExtent = _maxExtent;
+        const bool swap = isLittleEndian();
+        if (bytes.empty()) {
+            bytes.push_back(0); // offset 0 means no mask
+        }
+
+        bool skipSection = true;
+        std::string mimeType;
+        int c;
+        while ((c = stream.peek()) != std::char_traits<char>::eof()) {
+            if (c == '[') {
+                stream.get();
+                std::string sectionHeader;
+                if (!getline(stream, sectionHeader, ']') || stream.get() != '\n') {
+                    throw std::runtime_error("Malformed section header in magic file");
+                }
+                const std::string::size_type colon = sectionHeader.find(':');
+                if (colon == std::string::npos || colon + 1 == sectionHeader.size()) {
+                    throw std::runtime_error("Malformed section header in magic file");
+                }
+                mimeType = sectionHeader.substr(colon + 1);
+                skipSection = _noMagic.find(mimeType) != _noMagic.end();
+                if (!skipSection) {
+                    Rule rule;
+                    rule.priority = static_cast<unsigned int>(std::strtoul(sectionHeader.c_str(), NULL, 10));
+                    rule.mimeType = static_cast<unsigned int>(mimeTypes.size());
+                    rule.first = rule.last = static_cast<unsigned int>(matchlets.size());
+                    mimeTypes.push_back(mimeType);
+                    rules.push_back(rule);
+                }
+                continue;
+            }
+            if (mimeType.empty()) {
+                throw std::runtime_error("Magic rule outside of section");
+            }
+            if (c == '_') {
+                std::string line;
+                getline(stream, line);
+                if (line == "__NOMAGIC__") {
+                    noMagic.insert(mimeType);
+                }
+                continue;
+            }
+
+            Matchlet m;
+            const unsigned int indent = (c == '>') ? 0 : readNumber(stream);
+            expect(stream, '>');
+            m.rangeStart = readNumber(stream);
+            expect(stream, '=');
+            unsigned char lengthBytes[2];
+            if (!stream.read(reinterpret_cast<char*>(lengthBytes), 2)) {
+                throw std::runtime_error("Unexpected end of magic rule");
+            }
+            m.valueLength = (static_cast<unsigned int>(lengthBytes[0]) << 8) | lengthBytes[1];
+            m.valueOffset = static_cast<unsigned int>(bytes.size());
+            readBytes(stream, m.valueLength, bytes);
+            m.maskOffset = 0;
+            m.rangeLength = 1;
+            unsigned int wordSize = 1;
+
+            bool unknown = false;
+            while ((c = stream.get()) != '\n') {
+                if (c == '&') {
+                    m.maskOffset = static_cast<unsigned int>(bytes.size());
+                    readBytes(stream, m.valueLength, bytes);
+                } else if (c == '~') {
+                    wordSize = readNumber(stream);
+                } else if (c == '+') {
+                    m.rangeLength = readNumber(stream);
+                } else if (c == std::char_traits<char>::eof()) {
+                    throw std::runtime_error("Unexpected end of magic rule");
+                } else {
+                    // Unknown extension. Spec says to ignore the rest of line.
+                    std::string rest;
+                    getline(stream, rest);
+                    unknown = true;
+                    break;
+                }
+            }
+            if (unknown || skipSection || m.rangeLength == 0) {
+                continue;
+            }
+            if (swap && (wordSize == 2 || wordSize == 4)) {
+                swapWords(&bytes[m.valueOffset], m.valueLength, wordSize);
+                if (m.maskOffset) {
+                    swapWords(&bytes[m.maskOffset], m.valueLength, wordSize);
+                }
+            }
+            maxExtent = std::max(maxExtent, static_cast<std::size_t>(m.rangeStart) + m.rangeLength - 1 + m.valueLength);
+            matchlets.push_back(m);
+            indents.push_back(indent);
+            rules.back().last = static_cast<unsigned int>(matchlets.size());
+        }
+
+        // Children of matchlet are the following matchlets with greater indent.
+        const unsigned int base = static_cast<unsigned int>(_matchlets.size());
+        for (std::vector<Rule>::const_iterator rule = rules.begin(); rule != rules.end(); ++rule) {
+            for (unsigned int i = rule->first; i < rule->last; ++i) {
+                unsigned int end = i + 1;
+                while (end < rule->last && indents[end - base] > indents[i - base]) {
+                    ++end;
+                }
+                matchlets[i].subtreeEnd = end;
+            }
+        }
+
+        _matchlets.swap(matchlets);
+        _bytes.swap(bytes);
+        _mimeTypes.swap(mimeTypes);
+        for (std::vector<Rule>::const_iterator rule = rules.begin(); rule != rules.end(); ++rule) {
+            if (rule->first != rule->last) {
+                _rules.push_back(*rule);
+            }
+        }
+        std::stable_sort(_rules.begin(), _rules.end(), PriorityGreater());
+        _noMagic.insert(noMagic.begin(), noMagic.end());
+        _maxExtent = maxExtent;
+        clearCache();
+    }
+
+    void MimeMagic::clear()
+    {
+        _rules.clear();
+        _matchlets.clear();
+        _bytes.clear();
+        _mimeTypes.clear();
+        _noMagic.clear();
+        _maxExtent = 0;
+        clearCache();
+    }
+
+    std::size_t MimeMagic::size() const
+    {
+        return _rules.size();
+    }
+
+    std::size_t MimeMagic::maxExtent() const
+    {
+        return _maxExtent;
+    }
+
+    bool MimeMagic::matchlet(const Matchlet& m, const unsigned char* data, std::size_t size) const
+    {
+        const unsigned char* value = &_bytes[m.valueOffset];
+        const unsigned char* mask = m.maskOffset ? &_bytes[m.maskOffset] : NULL;
+        for (std::size_t offset = m.rangeStart; offset < static_cast<std::size_t>(m.rangeStart) + m.rangeLength; ++offset) {
+            if (offset > size || size - offset < m.valueLength) {
+                return false;
+            }
+            const unsigned char* candidate = data + offset;
+            if (mask) {
+                std::size_t i = 0;
+                while (i < m.valueLength && (candidate[i] & mask[i]) == (value[i] & mask[i])) {
+                    ++i;
+                }
+                if (i == m.valueLength) {
+                    return true;
+                }
+            } else if (std::memcmp(candidate, value, m.valueLength) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool MimeMagic::matchRange(unsigned int first, unsigned int last, const unsigned char* data, std::size_t size) const
+    {
+        unsigned int i = first;
+        while (i < last) {
+            const Matchlet& m = _matchlets[i];
+            if (matchlet(m, data, size) && (m.subtreeEnd == i + 1 || matchRange(i + 1, m.subtreeEnd, data, size))) {
+                return true;
+            }
+            i = m.subtreeEnd;
+        }
+        return false;
+    }
+
+    int MimeMagic::findMimeType(const char* data, std::size_t size) const
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        for (std::vector<Rule>::const_iterator it = _rules.begin(); it != _rules.end(); ++it) {
+            if (it->first != it->last && matchRange(it->first, it->last, bytes, size)) {
+                return static_cast<int>(it->mimeType);
+            }
+        }
+        return -1;
+    }
+
+    const char* MimeMagic::mimeTypeName(int mimeType) const
+    {
+        return mimeType < 0 ? NULL : _mimeTypes[static_cast<std::size_t>(mimeType)].c_str();
+    }
+
+    const char* MimeMagic::mimeTypeForData(const char* data, std::size_t size) const
+    {
+        return mimeTypeName(findMimeType(data, size));
+    }
+
+    const char* MimeMagic::mimeTypeForFile(const std::string& fileName) const
+    {
+        const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return NULL;
+        }
+        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+        const char* mimeType = mimeTypeForFile(fd);
+        ::close(fd);
+        return mimeType;
+    }
+
+    const char* MimeMagic::mimeTypeForFile(int fd) const
+    {
+        struct stat st;
+        MIMEAPPS_STAT_ADD(StatCalls, 1);
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return NULL;
+        }
+        CacheKey key;
+        key.device = st.st_dev;
+        key.inode = st.st_ino;
+        key.mtime = st.st_mtim.tv_sec;
+        key.mtimeNsec = st.st_mtim.tv_nsec;
+        key.size = st.st_size;
+        {
+            std::lock_guard<std::mutex> lock(_cacheMutex);
+            std::unordered_map<CacheKey, CacheEntries::iterator, CacheKeyHash>::iterator found = _cacheIndex.find(key);
+            if (found != _cacheIndex.end()) {
+                _cacheEntries.splice(_cacheEntries.begin(), _cacheEntries, found->second);
+                ++_cacheHits;
+                MIMEAPPS_STAT_ADD(CacheHits, 1);
+                return mimeTypeName(found->second->mimeType);
+            }
+        }
+
+        static thread_local std::vector<char> buffer;
+        buffer.resize(std::max(_maxExtent, static_cast<std::size_t>(1)));
+        const ssize_t bytesRead = ::pread(fd, &buffer[0], buffer.size(), 0);
+        if (bytesRead < 0) {
+            return NULL;
+        }
+        MIMEAPPS_STAT_ADD(BytesRead, bytesRead);
+        const int mimeType = findMimeType(&buffer[0], static_cast<std::size_t>(bytesRead));
+
+        CacheEntry entry;
+        entry.key = key;
+        entry.mimeType = mimeType;
+        {
+            std::lock_guard<std::mutex> lock(_cacheMutex);
+            ++_cacheMisses;
+            // Another thread could have detected the same file meanwhile.
+            if (_cacheCapacity != 0 && _cacheIndex.find(key) == _cacheIndex.end()) {
+                _cacheEntries.push_front(entry);
+                _cacheIndex[key] = _cacheEntries.begin();
+                while(_cacheEntries.size() > _cacheCapacity) {
+                    _cacheIndex.erase(_cacheEntries.back().key);
+                    _cacheEntries.pop_back();
+                }
+            }
+        }
+        MIMEAPPS_STAT_ADD(CacheMisses, 1);
+        return mimeTypeName(mimeType);
+    }
+
+    void MimeMagic::clearCache()
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        _cacheEntries.clear();
+        _cacheIndex.clear();
+        _cacheHits = 0;
+        _cacheMisses = 0;
+    }
+
+    std::size_t MimeMagic::cacheSize() const
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        return _cacheEntries.size();
+    }
+
+    std::size_t MimeMagic::cacheCapacity() const
+    {
+        return _cacheCapacity;
+    }
+
+    std::size_t MimeMagic::cacheHits() const
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        return _cacheHits;
+    }
+
+    std::size_t MimeMagic::cacheMisses() const
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        return _cacheMisses;
+    }
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Detecting MIME type by file contents using shared-mime-info magic files.
+ */
+
+#ifndef MIMEAPPS_MIMEMAGIC_H
+#define MIMEAPPS_MIMEMAGIC_H
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <istream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "basedir.h"
+
+namespace mimeapps
+{
+    /**
+     * \brief Magic rules of all MIME types compiled into flat match program.
+     *
+     * Rules are sorted by priority, so detection stops at the first matching rule.
+     * Only the first maxExtent() bytes of file are read, with a single pread call.
+     * Results are kept in bounded LRU cache keyed by device, inode, modification time and size,
+     * so changed files and reused inode numbers are never answered from stale entries.
+     * Detection is thread-safe once loading is done.
+     */
+    struct MimeMagic
+    {
+        /// Create detector caching results for at most cacheCapacity files. Zero disables caching.
+        explicit MimeMagic(std::size_t cacheCapacity = 1024);
+
+        /// Load magic files from standard shared-mime-info directories.
+        void load();
+        /// ditto, but use snapshot of base directories.
+        void load(const BaseDirs& baseDirs);
+
+        /// Load magic files from given shared-mime-info directories ordered by precedence.
+        template<typename Iterator>
+        void load(Iterator first, Iterator last) {
+            for (Iterator it = first; it != last; ++it) {
+                loadDirectory(*it);
+            }
+        }
+
+        /// Read magic file from shared-mime-info directory.
+        void loadDirectory(const std::string& mimeDir);
+
+        /**
+         * \brief Read contents of magic file.
+         *
+         * Files must be added in order of precedence.
+         * __NOMAGIC__ rule makes rules of MIME type from files added later to be ignored.
+         * \throws std::runtime_error if stream is not a magic file or rule is malformed.
+         */
+        void addMagic(std::istream& stream);
+
+        void clear();
+
+        /// Number of rules.
+        std::size_t size() const;
+
+        /// Number of leading bytes that can affect detection.
+        std::size_t maxExtent() const;
+
+        /// Get MIME type of data or NULL if no rule matches.
+        const char* mimeTypeForData(const char* data, std::size_t size) const;
+
+        /**
+         * \brief Get MIME type of file contents or NULL if file can't be read or no rule matches.
+         * Returned pointer is valid until MimeMagic is modified.
+         */
+        const char* mimeTypeForFile(const std::string& fileName) const;
+
+        /// ditto, but use already opened file descriptor.
+        const char* mimeTypeForFile(int fd) const;
+
+        /// Drop cached results.
+        void clearCache();
+
+        /// Number of cached results.
+        std::size_t cacheSize() const;
+        std::size_t cacheCapacity() const;
+
+        /// Number of detections served from cache.
+        std::size_t cacheHits() const;
+        /// Number of detections that required reading file.
+        std::size_t cacheMisses() const;
+
+    private:
+        struct Matchlet
+        {
+            unsigned int rangeStart;
+            unsigned int rangeLength;
+            unsigned int valueOffset;
+            unsigned int valueLength;
+            unsigned int maskOffset; // zero if there's no mask
+            unsigned int subtreeEnd; // index of first matchlet past children
+        };
+
+        struct Rule
+        {
+            unsigned int priority;
+            unsigned int mimeType;
+            unsigned int first;
+            unsigned int last;
+        };
+
+        struct CacheKey
+        {
+            dev_t device;
+            ino_t inode;
+            time_t mtime;
+            long mtimeNsec;
+            off_t size;
+
+            bool operator==(const CacheKey& other) const {
+                return device == other.device && inode == other.inode && mtime == other.mtime &&
+                    mtimeNsec == other.mtimeNsec && size == other.size;
+            }
+        };
+
+        struct CacheKeyHash
+        {
+            std::size_t operator()(const CacheKey& key) const {
+                unsigned long long hash = static_cast<unsigned long long>(key.inode);
+                hash = hash * 31 + static_cast<unsigned long long>(key.device);
+                hash = hash * 31 + static_cast<unsigned long long>(key.mtime);
+                hash = hash * 31 + static_cast<unsigned long long>(key.mtimeNsec);
+                hash = hash * 31 + static_cast<unsigned long long>(key.size);
+                return std::hash<unsigned long long>()(hash);
+            }
+        };
+
+        struct CacheEntry
+        {
+            CacheKey key;
+            int mimeType; // -1 if no rule matches
+        };
+        typedef std::list<CacheEntry> CacheEntries;
+
+        bool matchRange(unsigned int first, unsigned int last, const unsigned char* data, std::size_t size) const;
+        bool matchlet(const Matchlet& m, const unsigned char* data, std::size_t size) const;
+        int findMimeType(const char* data, std::size_t size) const;
+        const char* mimeTypeName(int mimeType) const;
+
+        std::vector<Rule> _rules;
+        std::vector<Matchlet> _matchlets;
+        std::vector<unsigned char> _bytes;
+        std::vector<std::string> _mimeTypes;
+        std::unordered_set<std::string> _noMagic;
+        std::size_t _maxExtent;
+
+        mutable std::mutex _cacheMutex;
+        // Most recently used entries go first.
+        mutable CacheEntries _cacheEntries;
+        mutable std::unordered_map<CacheKey, CacheEntries::iterator, CacheKeyHash> _cacheIndex;
+        std::size_t _cacheCapacity;
+        mutable std::size_t _cacheHits;
+        mutable std::size_t _cacheMisses;
+    };
+}
+
+#endif
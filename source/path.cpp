@@ -24,6 +24,24 @@ namespace mimeapps
         }
     }
 
+    ArenaString buildPath(const StringRef& path, const StringRef& append, Arena& arena)
+    {
+        ArenaString result((ArenaAllocator<char>(&arena)));
+        if (isAbsolutePath(append.begin(), append.end()) || path.empty()) {
+            result.assign(append.data(), append.size());
+        } else if (append.empty()) {
+            result.assign(path.data(), path.size());
+        } else {
+            result.reserve(path.size() + append.size() + 1);
+            result.assign(path.data(), path.size());
+            if (path[path.size()-1] != '/') {
+                result.push_back('/');
+            }
+            result.append(append.data(), append.size());
+        }
+        return result;
+    }
+
     bool isBaseName(const std::string& path) {
         return isBaseName(path.begin(), path.end());
     }
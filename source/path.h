@@ -12,12 +12,18 @@
 
 #include <string>
 
+#include "arena.h"
+#include "stringref.h"
+
 namespace mimeapps
 {
     
     /// \brief Concat two paths.
     std::string buildPath(const std::string& path, const std::string& append);
 
+    /// \brief ditto, but result is allocated from arena.
+    ArenaString buildPath(const StringRef& path, const StringRef& append, Arena& arena);
+
     
     /// \brief Check if path is base name, i.e. not absolute, nor relative with dots.
     template<typename Iterator>
@@ -0,0 +1,83 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <atomic>
+
+#include "stats.h"
+
+namespace mimeapps
+{
+    namespace {
+        /// Counter on its own cache line, so threads updating different counters don't contend.
+        struct alignas(64) Counter
+        {
+            std::atomic<unsigned long long> value;
+        };
+
+        Counter counters[details::StatsCounterCount];
+        Counter calls[StatsEntryPointCount];
+        Counter nanoseconds[StatsEntryPointCount];
+
+        unsigned long long load(const Counter& counter)
+        {
+            return counter.value.load(std::memory_order_relaxed);
+        }
+    }
+
+    Stats::Stats() : filesOpened(0), bytesRead(0), statCalls(0), accessCalls(0), linesParsed(0), cacheHits(0), cacheMisses(0)
+    {
+        for (int i=0; i<StatsEntryPointCount; ++i) {
+            entryPoints[i].calls = 0;
+            entryPoints[i].nanoseconds = 0;
+        }
+    }
+
+    bool statsEnabled()
+    {
+#ifdef MIMEAPPS_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    Stats getStats()
+    {
+        Stats stats;
+        stats.filesOpened = load(counters[details::FilesOpened]);
+        stats.bytesRead = load(counters[details::BytesRead]);
+        stats.statCalls = load(counters[details::StatCalls]);
+        stats.accessCalls = load(counters[details::AccessCalls]);
+        stats.linesParsed = load(counters[details::LinesParsed]);
+        stats.cacheHits = load(counters[details::CacheHits]);
+        stats.cacheMisses = load(counters[details::CacheMisses]);
+        for (int i=0; i<StatsEntryPointCount; ++i) {
+            stats.entryPoints[i].calls = load(calls[i]);
+            stats.entryPoints[i].nanoseconds = load(nanoseconds[i]);
+        }
+        return stats;
+    }
+
+    void resetStats()
+    {
+        for (int i=0; i<details::StatsCounterCount; ++i) {
+            counters[i].value.store(0, std::memory_order_relaxed);
+        }
+        for (int i=0; i<StatsEntryPointCount; ++i) {
+            calls[i].value.store(0, std::memory_order_relaxed);
+            nanoseconds[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void details::addStat(StatsCounter counter, unsigned long long value)
+    {
+        counters[counter].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void details::addEntryPointTime(StatsEntryPoint entryPoint, unsigned long long elapsed)
+    {
+        calls[entryPoint].value.fetch_add(1, std::memory_order_relaxed);
+        nanoseconds[entryPoint].value.fetch_add(elapsed, std::memory_order_relaxed);
+    }
+}
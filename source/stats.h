@@ -0,0 +1,114 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Optional I/O and timing statistics of lookups.
+ *
+ * Statistics are collected only if library is compiled with MIMEAPPS_STATS macro defined
+ * (MIMEAPPS_STATS CMake option or stats meson option). Otherwise counting compiles to nothing
+ * and getStats() returns zeros. The macro must be defined the same way for the library and code that includes its headers.
+ */
+
+#ifndef MIMEAPPS_STATS_H
+#define MIMEAPPS_STATS_H
+
+#include <chrono>
+
+namespace mimeapps
+{
+    /// Public functions timed by statistics.
+    enum StatsEntryPoint
+    {
+        ListAssociatedApplicationsCall,
+        ListDefaultApplicationsCall,
+        FindAssociatedApplicationsCall,
+        FindDefaultApplicationCall,
+        FindDesktopFileCall,
+        FindExecutableCall,
+        SpawnDetachedCall,
+        StatsEntryPointCount
+    };
+
+    /// Number of calls and total wall time of entry point. Nested calls are counted in both caller and callee.
+    struct EntryPointStats
+    {
+        unsigned long long calls;
+        unsigned long long nanoseconds;
+    };
+
+    /// Snapshot of statistics counters.
+    struct Stats
+    {
+        Stats();
+
+        /// Files successfully opened for reading.
+        unsigned long long filesOpened;
+        /// Bytes of file contents read.
+        unsigned long long bytesRead;
+        /// stat and fstat calls.
+        unsigned long long statCalls;
+        /// access calls.
+        unsigned long long accessCalls;
+        /// Lines of ini-like, globs and hierarchy files parsed.
+        unsigned long long linesParsed;
+        /// Lookups served by caches.
+        unsigned long long cacheHits;
+        /// Lookups that missed caches.
+        unsigned long long cacheMisses;
+
+        EntryPointStats entryPoints[StatsEntryPointCount];
+    };
+
+    /// Check if library was compiled with statistics support.
+    bool statsEnabled();
+
+    /// Get current values of counters. Counters are process-wide and updated from all threads.
+    Stats getStats();
+
+    /// Reset all counters to zero.
+    void resetStats();
+
+    namespace details {
+        enum StatsCounter
+        {
+            FilesOpened,
+            BytesRead,
+            StatCalls,
+            AccessCalls,
+            LinesParsed,
+            CacheHits,
+            CacheMisses,
+            StatsCounterCount
+        };
+
+        void addStat(StatsCounter counter, unsigned long long value);
+        void addEntryPointTime(StatsEntryPoint entryPoint, unsigned long long nanoseconds);
+
+        /// Add lifetime of object to entry point statistics.
+        struct StatsTimer
+        {
+            explicit StatsTimer(StatsEntryPoint entryPoint) : _entryPoint(entryPoint), _start(std::chrono::steady_clock::now()) {}
+            ~StatsTimer() {
+                addEntryPointTime(_entryPoint, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+            }
+        private:
+            StatsTimer(const StatsTimer&);
+            StatsTimer& operator=(const StatsTimer&);
+
+            StatsEntryPoint _entryPoint;
+            std::chrono::steady_clock::time_point _start;
+        };
+    }
+}
+
+#ifdef MIMEAPPS_STATS
+#define MIMEAPPS_STAT_ADD(counter, value) ::mimeapps::details::addStat(::mimeapps::details::counter, (value))
+#define MIMEAPPS_STAT_TIMER(entryPoint) const ::mimeapps::details::StatsTimer mimeappsStatsTimer(::mimeapps::entryPoint)
+#else
+#define MIMEAPPS_STAT_ADD(counter, value) ((void)0)
+#define MIMEAPPS_STAT_TIMER(entryPoint) ((void)0)
+#endif
+
+#endif
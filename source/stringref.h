@@ -0,0 +1,83 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Non-owning reference to null-terminated string.
+ */
+
+#ifndef MIMEAPPS_STRINGREF_H
+#define MIMEAPPS_STRINGREF_H
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace mimeapps
+{
+    /**
+     * \brief Read-only view of null-terminated character sequence owned by someone else.
+     *
+     * View is valid while the owner is alive. It converts implicitly to std::string, making a copy.
+     */
+    struct StringRef
+    {
+        /// Empty string.
+        StringRef() : _data(""), _size(0) {}
+        StringRef(const char* str) : _data(str), _size(std::strlen(str)) {}
+        StringRef(const std::string& str) : _data(str.c_str()), _size(str.size()) {}
+        /// data[size] must be '\0'.
+        StringRef(const char* data, std::size_t size) : _data(data), _size(size) {}
+
+        const char* c_str() const {
+            return _data;
+        }
+        const char* data() const {
+            return _data;
+        }
+        std::size_t size() const {
+            return _size;
+        }
+        bool empty() const {
+            return _size == 0;
+        }
+
+        const char* begin() const {
+            return _data;
+        }
+        const char* end() const {
+            return _data + _size;
+        }
+
+        char operator[](std::size_t i) const {
+            return _data[i];
+        }
+
+        std::string str() const {
+            return std::string(_data, _size);
+        }
+        operator std::string() const {
+            return str();
+        }
+
+    private:
+        const char* _data;
+        std::size_t _size;
+    };
+
+    inline bool operator==(const StringRef& a, const StringRef& b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+    }
+
+    inline bool operator!=(const StringRef& a, const StringRef& b) {
+        return !(a == b);
+    }
+
+    inline std::ostream& operator<<(std::ostream& stream, const StringRef& str) {
+        return stream.write(str.data(), str.size());
+    }
+}
+
+#endif
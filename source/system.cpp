@@ -3,6 +3,7 @@
 // http://www.boost.org/LICENSE_1_0.txt
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
 #include <unistd.h>
@@ -13,40 +14,188 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <stdexcept>
 
 #include "system.h"
 #include "path.h"
 #include "splitter.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace mimeapps
 {
     std::string findExecutable(const std::string& fileName)
     {
-        if (!isBaseName(fileName)) {
+        Arena arena;
+        const ArenaString found = findExecutable(StringRef(fileName), arena);
+        return std::string(found.data(), found.size());
+    }
+
+    ArenaString findExecutable(const StringRef& fileName, Arena& arena)
+    {
+        MIMEAPPS_STAT_TIMER(FindExecutableCall);
+        const ArenaAllocator<char> allocator(&arena);
+        if (!isBaseName(fileName.begin(), fileName.end())) {
+            MIMEAPPS_STAT_ADD(AccessCalls, 1);
             if (::access(fileName.c_str(), X_OK) == 0) {
-                return fileName;
+                return ArenaString(fileName.data(), fileName.size(), allocator);
             } else {
-                return std::string();
+                return ArenaString(allocator);
             }
         }
 
         const char* envPath = std::getenv("PATH");
         if (!envPath) {
-            return std::string();
+            return ArenaString(allocator);
         }
 
         typedef Splitter<const char*> SplitterType;
         SplitterType splitter(envPath, envPath + std::strlen(envPath), ':');
+        ArenaString basePath(allocator);
         for (SplitterType::iterator it = splitter.begin(); it != splitter.end(); ++it) {
-            std::string basePath(it->first, it->second);
+            basePath.assign(it->first, it->second);
             if (basePath.size()) {
-                std::string filePath = buildPath(basePath, fileName);
+                ArenaString filePath = buildPath(StringRef(basePath.c_str(), basePath.size()), fileName, arena);
+                MIMEAPPS_STAT_ADD(AccessCalls, 1);
                 if (::access(filePath.c_str(), X_OK) == 0) {
                     return filePath;
                 }
             }
         }
-        return std::string();
+        return ArenaString(allocator);
+    }
+
+    ExecutableCache::ExecutableCache(std::chrono::milliseconds negativeTimeout) : _negativeTimeout(negativeTimeout), _hits(0), _misses(0)
+    {
+    }
+
+    std::string ExecutableCache::find(const std::string& baseName)
+    {
+        const char* envPath = std::getenv("PATH");
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_envPath != (envPath ? envPath : "")) {
+                _entries.clear();
+                _envPath = envPath ? envPath : "";
+            }
+            std::unordered_map<std::string, Entry>::iterator found = _entries.find(baseName);
+            if (found != _entries.end()) {
+                if (found->second.path.empty()) {
+                    if (now - found->second.checked < _negativeTimeout) {
+                        ++_hits;
+                        return std::string();
+                    }
+                } else {
+                    MIMEAPPS_STAT_ADD(AccessCalls, 1);
+                    if (::access(found->second.path.c_str(), X_OK) == 0) {
+                        ++_hits;
+                        return found->second.path;
+                    }
+                }
+            }
+            ++_misses;
+        }
+
+        // Lookup is done without lock, so slow probing does not block other threads.
+        Entry entry;
+        entry.path = findExecutable(baseName);
+        entry.checked = now;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries[baseName] = entry;
+        return entry.path;
+    }
+
+    void ExecutableCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _hits = 0;
+        _misses = 0;
+    }
+
+    std::size_t ExecutableCache::hits() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+    std::size_t ExecutableCache::misses() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _misses;
+    }
+
+    ExecutableCache& ExecutableCache::global()
+    {
+        static ExecutableCache cache;
+        return cache;
+    }
+
+    std::runtime_error details::fileError(const std::string& what, const std::string& path)
+    {
+        return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+    }
+
+    void details::makeDirectories(const std::string& dir)
+    {
+        for (std::string::size_type i = 1; i <= dir.size(); ++i) {
+            if (i == dir.size() || dir[i] == '/') {
+                const std::string parent = dir.substr(0, i);
+                if (::mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+                    throw fileError("Could not create directory", parent);
+                }
+            }
+        }
+    }
+
+    void details::writeFileAtomically(const std::string& path, const std::string& contents, unsigned int mode)
+    {
+        const std::string::size_type slash = path.rfind('/');
+        const std::string dir = slash == std::string::npos ? std::string(".") : (slash == 0 ? std::string("/") : path.substr(0, slash));
+        makeDirectories(dir);
+
+        std::string tempPath = path + ".XXXXXX";
+        const int fd = ::mkstemp(&tempPath[0]);
+        if (fd < 0) {
+            throw fileError("Could not create temporary file for", path);
+        }
+        MIMEAPPS_STAT_ADD(FilesOpened, 1);
+
+        const char* data = contents.data();
+        std::size_t left = contents.size();
+        bool ok = true;
+        while(ok && left) {
+            const ssize_t written = ::write(fd, data, left);
+            if (written < 0) {
+                ok = errno == EINTR;
+            } else {
+                data += written;
+                left -= written;
+            }
+        }
+        ok = ok && ::fchmod(fd, mode) == 0 && ::fsync(fd) == 0;
+        if (!ok) {
+            const int error = errno;
+            ::close(fd);
+            ::unlink(tempPath.c_str());
+            errno = error;
+            throw fileError("Could not write temporary file", tempPath);
+        }
+        if (::close(fd) != 0 || ::rename(tempPath.c_str(), path.c_str()) != 0) {
+            const int error = errno;
+            ::unlink(tempPath.c_str());
+            errno = error;
+            throw fileError("Could not replace", path);
+        }
+
+        // Make rename itself durable.
+        const int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            ::fsync(dirFd);
+            ::close(dirFd);
+        }
     }
 
     static std::string getDETerminal(std::string& arg) {
@@ -123,7 +272,7 @@ namespace mimeapps
         ::_exit(1);
     }
 
-    SystemError spawnDetached(char** args, const char* workingDirectory, unsigned int* pid)
+    static SystemError doSpawnDetached(char** args, const char* workingDirectory, unsigned int* pid)
     {
         int execPipe[2];
         int pidPipe[2];
@@ -250,4 +399,21 @@ namespace mimeapps
             }
         }
     }
+
+    SystemError spawnDetached(char** args, const char* workingDirectory, unsigned int* pid)
+    {
+        MIMEAPPS_STAT_TIMER(SpawnDetachedCall);
+        details::TraceSpan span("spawn_detached");
+        unsigned int spawnedPid = 0;
+        const SystemError result = doSpawnDetached(args, workingDirectory, &spawnedPid);
+        if (pid != NULL) {
+            *pid = spawnedPid;
+        }
+        if (span.active()) {
+            span.addAttribute("program", std::string(args[0] ? args[0] : ""));
+            span.addAttribute("pid", static_cast<unsigned long long>(spawnedPid));
+            span.addAttribute("error", static_cast<unsigned long long>(result.status));
+        }
+        return result;
+    }
 }
@@ -15,11 +15,80 @@
 #include <cstddef>
 #include <cstdio>
 
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "arena.h"
+#include "stringref.h"
+
 namespace mimeapps
 {
+    namespace details {
+        /// Build exception describing failed file operation from errno, e.g. "Could not read /path: No such file or directory".
+        std::runtime_error fileError(const std::string& what, const std::string& path);
+
+        /// Create directory and its missing parents. \throws std::runtime_error on failure.
+        void makeDirectories(const std::string& dir);
+
+        /**
+         * \brief Replace file with contents atomically.
+         *
+         * Contents are written to temporary file in the same directory, synced to disk and renamed over path.
+         * Missing parent directories are created.
+         * \throws std::runtime_error on failure. File at path is not modified in this case.
+         */
+        void writeFileAtomically(const std::string& path, const std::string& contents, unsigned int mode = 0644);
+    }
+
     std::string findExecutable(const std::string& baseName);
+    /// ditto, but candidate paths are allocated from arena.
+    ArenaString findExecutable(const StringRef& baseName, Arena& arena);
     std::string getTerminal(std::string& arg);
 
+    /**
+     * \brief Cache of findExecutable() results.
+     *
+     * Found paths are revalidated by single access call instead of probing every PATH directory.
+     * Executables that were not found are remembered for negativeTimeout, so newly installed programs are noticed eventually.
+     * Change of PATH drops all entries. Cache can be shared between threads.
+     */
+    struct ExecutableCache
+    {
+        explicit ExecutableCache(std::chrono::milliseconds negativeTimeout = std::chrono::milliseconds(5000));
+
+        /// Same as findExecutable(), but uses cached result if it's still valid.
+        std::string find(const std::string& baseName);
+
+        void clear();
+
+        /// Number of find() calls served from cache.
+        std::size_t hits() const;
+        /// Number of find() calls that required lookup.
+        std::size_t misses() const;
+
+        /// Cache used by library for TryExec checks.
+        static ExecutableCache& global();
+
+    private:
+        ExecutableCache(const ExecutableCache&);
+        ExecutableCache& operator=(const ExecutableCache&);
+
+        struct Entry
+        {
+            std::string path;
+            std::chrono::steady_clock::time_point checked;
+        };
+
+        std::unordered_map<std::string, Entry> _entries;
+        std::string _envPath;
+        std::chrono::milliseconds _negativeTimeout;
+        std::size_t _hits;
+        std::size_t _misses;
+        mutable std::mutex _mutex;
+    };
+
     struct SystemError
     {
         SystemError(int code, const char* msg) : errorMsg(msg), status(code) {}
@@ -0,0 +1,61 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+#include <atomic>
+
+#include "trace.h"
+
+namespace mimeapps
+{
+    namespace {
+        std::atomic<TraceSink*> currentSink(NULL);
+    }
+
+    TraceAttribute::TraceAttribute(const char* name, const std::string& value) : name(name), stringValue(value), numberValue(0), isNumber(false) {}
+    TraceAttribute::TraceAttribute(const char* name, unsigned long long value) : name(name), numberValue(value), isNumber(true) {}
+
+    TraceSink::~TraceSink() {}
+
+    void setTraceSink(TraceSink* sink)
+    {
+        currentSink.store(sink, std::memory_order_release);
+    }
+
+    TraceSink* traceSink()
+    {
+        return currentSink.load(std::memory_order_acquire);
+    }
+
+    details::TraceSpan::TraceSpan(const char* name) : _name(name), _sink(traceSink())
+    {
+        if (_sink) {
+            _sink->beginSpan(_name);
+        }
+    }
+
+    details::TraceSpan::~TraceSpan()
+    {
+        if (_sink) {
+            try {
+                _sink->endSpan(_name, _attributes);
+            } catch(...) {
+
+            }
+        }
+    }
+
+    void details::TraceSpan::addAttribute(const char* name, const std::string& value)
+    {
+        if (_sink) {
+            _attributes.push_back(TraceAttribute(name, value));
+        }
+    }
+
+    void details::TraceSpan::addAttribute(const char* name, unsigned long long value)
+    {
+        if (_sink) {
+            _attributes.push_back(TraceAttribute(name, value));
+        }
+    }
+}
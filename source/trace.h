@@ -0,0 +1,95 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Pluggable tracing of parse, lookup and spawn phases.
+ */
+
+#ifndef MIMEAPPS_TRACE_H
+#define MIMEAPPS_TRACE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mimeapps
+{
+    /// \brief Named value attached to span, either string or number.
+    struct TraceAttribute
+    {
+        TraceAttribute(const char* name, const std::string& value);
+        TraceAttribute(const char* name, unsigned long long value);
+
+        const char* name;
+        std::string stringValue;
+        unsigned long long numberValue;
+        bool isNumber;
+    };
+
+    /**
+     * \brief Receiver of trace spans.
+     *
+     * Spans are reported by the following library functions:
+     *  - "parse_mimeapps_list" and "parse_mimeinfo_cache" (attribute "path") when association files are read;
+     *  - "parse_desktop_file" (attribute "path") when desktop file is read;
+     *  - "search_key_values" (attributes "lines" and "bytes") from SearchRequest::searchKeyValues();
+     *  - "resolve_desktop_id" (attributes "desktop_id" and "path", empty if not found) from findDesktopFile();
+     *  - "spawn_detached" (attributes "program", "pid" and "error") from spawnDetached();
+     *  - "write_mimeapps_list" (attributes "path" and "changes") from MimeAppsListEditor::commit();
+     *  - "generate_mimeinfo_cache" (attributes "path", "desktop_files" and "parsed") from generateMimeInfoCache();
+     *  - "update_application_search_index" (attributes "desktop_files" and "changed") from ApplicationSearchIndex::update();
+     *  - "load_icon_theme" (attributes "name", "cached_dirs" and "scanned_dirs") from IconLookup::findIcon();
+     *  - "serve_lookup" (attributes "mime_type" and "items") from LookupServer::run();
+     *  - "publish_association_snapshot" (attributes "generation", "mime_types" and "size") from AssociationSnapshotPublisher::publish().
+     *
+     * Spans may nest, e.g. "search_key_values" happens inside "parse_desktop_file".
+     * Methods are called from any thread that performs lookups, so implementation must be thread-safe.
+     * Span name is string literal, it's valid for the whole program lifetime.
+     */
+    struct TraceSink
+    {
+        virtual ~TraceSink();
+        virtual void beginSpan(const char* name) = 0;
+        virtual void endSpan(const char* name, const std::vector<TraceAttribute>& attributes) = 0;
+    };
+
+    /**
+     * \brief Install trace sink. Pass NULL to disable tracing.
+     *
+     * Sink is not owned by library and must outlive all lookups started while it's installed.
+     * When no sink is installed tracing costs one atomic load per span.
+     */
+    void setTraceSink(TraceSink* sink);
+
+    /// Get currently installed trace sink or NULL.
+    TraceSink* traceSink();
+
+    namespace details {
+        /// Report span covering lifetime of object to sink installed at construction time.
+        struct TraceSpan
+        {
+            explicit TraceSpan(const char* name);
+            ~TraceSpan();
+
+            /// Check if span is recorded. Use it to avoid computing attributes nobody receives.
+            bool active() const {
+                return _sink != NULL;
+            }
+
+            void addAttribute(const char* name, const std::string& value);
+            void addAttribute(const char* name, unsigned long long value);
+
+        private:
+            TraceSpan(const TraceSpan&);
+            TraceSpan& operator=(const TraceSpan&);
+
+            const char* _name;
+            TraceSink* _sink;
+            std::vector<TraceAttribute> _attributes;
+        };
+    }
+}
+
+#endif
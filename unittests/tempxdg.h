@@ -0,0 +1,84 @@
+// Copyright (c) 2016 Roman Chistokhodov
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+
+/**
+ * \file
+ * \brief Temporary directory with XDG environment pointing into it, shared by unittests and benchmarks.
+ */
+
+#ifndef MIMEAPPS_UNITTESTS_TEMPXDG_H
+#define MIMEAPPS_UNITTESTS_TEMPXDG_H
+
+#include <sys/stat.h>
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Temporary directory removed with all its contents on destruction.
+ *
+ * Environment variables changed with setVariable() are restored on destruction.
+ */
+struct TempXdgDir
+{
+    /// Create directory /tmp/prefix-XXXXXX.
+    explicit TempXdgDir(const std::string& prefix) {
+        std::string tmpl = "/tmp/" + prefix + "-XXXXXX";
+        const char* dir = ::mkdtemp(&tmpl[0]);
+        if (!dir) {
+            throw std::runtime_error("Could not create temporary directory");
+        }
+        root = dir;
+    }
+
+    ~TempXdgDir() {
+        for (std::size_t i=0; i<saved.size(); ++i) {
+            if (saved[i].second.second) {
+                ::setenv(saved[i].first.c_str(), saved[i].second.first.c_str(), 1);
+            } else {
+                ::unsetenv(saved[i].first.c_str());
+            }
+        }
+        ::nftw(root.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    /// Set environment variable, remembering its previous value.
+    void setVariable(const char* name, const std::string& value) {
+        const char* old = ::getenv(name);
+        saved.push_back(std::make_pair(std::string(name), std::make_pair(std::string(old ? old : ""), old != NULL)));
+        ::setenv(name, value.c_str(), 1);
+    }
+
+    /// Write file at absolute path, creating parent directories.
+    static void createFile(const std::string& path, const std::string& contents) {
+        for (std::string::size_type i = 1; i < path.size(); ++i) {
+            if (path[i] == '/') {
+                ::mkdir(path.substr(0, i).c_str(), 0755);
+            }
+        }
+        std::ofstream stream(path.c_str(), std::ofstream::binary);
+        stream << contents;
+    }
+
+    std::string root;
+
+private:
+    TempXdgDir(const TempXdgDir&);
+    TempXdgDir& operator=(const TempXdgDir&);
+
+    static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+        return ::remove(path);
+    }
+
+    std::vector<std::pair<std::string, std::pair<std::string, bool> > > saved;
+};
+
+#endif
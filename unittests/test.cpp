@@ -6,19 +6,70 @@
 #include <boost/test/unit_test.hpp>
 
 #include <vector>
+#include <deque>
+#include <iterator>
+#include <chrono>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include "splitter.h"
 #include "path.h"
 #include "inilike.h"
 #include "desktopfile.h"
+#include "desktopfilecache.h"
 #include "mimeapps.h"
+#include "mimehierarchy.h"
+#include "mimecache.h"
+#include "mimeglobs.h"
+#include "mimemagic.h"
+#include "classifier.h"
+#include "trace.h"
+#include "associationindex.h"
 #include "basedir.h"
+#include "mimeappslist.h"
+#include "mimeinfocache.h"
+#include "appsearch.h"
+#include "icontheme.h"
+#include "lookupdaemon.h"
+#include "associationsnapshot.h"
+#include "tempxdg.h"
 
 using namespace mimeapps;
 
+/**
+ * Temporary XDG hierarchy. XDG environment variables point into it while fixture is alive.
+ */
+struct XdgFixture : TempXdgDir
+{
+    XdgFixture() : TempXdgDir("mimeapps-test") {
+        setVariable("XDG_CONFIG_HOME", buildPath(root, "config"));
+        setVariable("XDG_DATA_HOME", buildPath(root, "data"));
+        setVariable("XDG_CONFIG_DIRS", buildPath(root, "etc"));
+        setVariable("XDG_DATA_DIRS", buildPath(root, "share"));
+    }
+
+    /// Write file at path relative to fixture root, creating parent directories.
+    std::string writeFile(const std::string& relPath, const std::string& contents) {
+        const std::string path = buildPath(root, relPath);
+        createFile(path, contents);
+        return path;
+    }
+};
+
 BOOST_AUTO_TEST_SUITE(splitter_test)
 
 template<typename SourceIterator>
@@ -139,6 +190,28 @@ BOOST_AUTO_TEST_CASE(unescapeValue_test)
     BOOST_CHECK_EQUAL(unescapeValue("a\\\\next\\nline\\top"), "a\\next\nline\top");
     BOOST_CHECK_EQUAL(unescapeValue("\\\\next\\nline\\top"), "\\next\nline\top");
     BOOST_CHECK_EQUAL(unescapeValue("noescape"), "noescape");
+    BOOST_CHECK_EQUAL(unescapeValue("a\\sb\\r"), "a b\r");
+    // Unknown escape sequences and trailing backslash are kept.
+    BOOST_CHECK_EQUAL(unescapeValue("\\x\\s\\"), "\\x \\");
+    BOOST_CHECK_EQUAL(unescapeValue("\\\\\\"), "\\\\");
+
+    // Storage does not need to be contiguous. Runs of ordinary characters here span several deque blocks.
+    const std::string escaped = std::string(1500, 'a') + "\\s" + std::string(1500, 'b');
+    const std::deque<char> chars(escaped.begin(), escaped.end());
+    BOOST_CHECK_EQUAL(unescapeValue(chars.begin(), chars.end()), unescapeValue(escaped));
+}
+
+BOOST_AUTO_TEST_CASE(CharTable_test)
+{
+    static_assert(details::CharClassTable::values[static_cast<unsigned char>('-')] == details::KeyChar, "'-' is key character");
+    static_assert(details::ValueEscapeTable::values[static_cast<unsigned char>('s')] == ' ', "\\s is space");
+    for (unsigned int c=0; c<256; ++c) {
+        const char ch = static_cast<char>(c);
+        BOOST_CHECK_EQUAL(details::hasCharClass(ch, details::KeyChar), (std::isalnum(c) != 0 && c < 128) || c == '-');
+        BOOST_CHECK_EQUAL(details::hasCharClass(ch, details::SpaceChar), c < 128 && std::isspace(c) != 0);
+    }
+    BOOST_CHECK(!isValidDesktopFileKey("Name\xc3\xa9"));
+    BOOST_CHECK(isValidDesktopFileKey("X-Vendor-Key2[de_DE]"));
 }
 
 BOOST_AUTO_TEST_CASE(isTrue_test)
@@ -267,6 +340,13 @@ BOOST_AUTO_TEST_CASE(unquoteExec_test)
     unquoteExec("test\\ \"one\"\"two\"\\ more\\ \\ test ", std::back_inserter(vec));
     BOOST_CHECK_EQUAL_COLLECTIONS(vec.begin(), vec.end(), expected.begin(), expected.end());
     vec.clear(); expected.clear();
+
+    const std::string exec = "program --" + std::string(1500, 'o') + " \"quoted arg\" last";
+    const std::deque<char> chars(exec.begin(), exec.end());
+    unquoteExec(exec, std::back_inserter(expected));
+    unquoteExec(chars.begin(), chars.end(), std::back_inserter(vec));
+    BOOST_CHECK_EQUAL_COLLECTIONS(vec.begin(), vec.end(), expected.begin(), expected.end());
+    vec.clear(); expected.clear();
 }
 
 BOOST_AUTO_TEST_CASE(expandExecArgs_test)
@@ -332,10 +412,615 @@ BOOST_AUTO_TEST_CASE(DesktopFile_test)
     BOOST_CHECK(file.terminal());
 }
 
+BOOST_AUTO_TEST_CASE(DesktopFile_copy_test)
+{
+    std::istringstream stream("[Desktop Entry]\nType=Application\nName=Vim\nExec=vim %f\n");
+    DesktopFile file(stream, "file.desktop");
+
+    DesktopFile copy = file;
+    BOOST_CHECK(copy.name().data() == file.name().data());
+    BOOST_CHECK_EQUAL(copy.fileName(), "file.desktop");
+
+    DesktopFile moved(std::move(copy));
+    BOOST_CHECK(moved.name().data() == file.name().data());
+    BOOST_CHECK(moved.isValid());
+    BOOST_CHECK(!copy.isValid());
+    BOOST_CHECK(copy.name().empty());
+
+    copy = moved;
+    BOOST_CHECK_EQUAL(copy.execValue(), "vim %f");
+
+    DesktopFile missing("nonexistent.desktop");
+    BOOST_CHECK(!missing.isValid());
+    BOOST_CHECK_EQUAL(missing.fileName(), "nonexistent.desktop");
+    BOOST_CHECK(DesktopFile().name().empty());
+}
+
+BOOST_AUTO_TEST_CASE(DesktopFile_show_in_test)
+{
+    std::istringstream stream(
+        "[Desktop Entry]\n"
+        "Type=Application\n"
+        "Exec=vim %f\n"
+        "TryExec=vim\n"
+        "Hidden=true\n"
+        "NoDisplay=true\n"
+        "OnlyShowIn=GNOME;XFCE;\n"
+        "NotShowIn=KDE;\n");
+    DesktopFile file(stream, "file.desktop");
+    BOOST_CHECK_EQUAL(file.tryExecValue(), "vim");
+    BOOST_CHECK(file.hidden());
+    BOOST_CHECK(file.noDisplay());
+    BOOST_CHECK_EQUAL(file.onlyShowInValue(), "GNOME;XFCE;");
+    BOOST_CHECK_EQUAL(file.notShowInValue(), "KDE;");
+
+    BOOST_CHECK(file.isShownIn(""));
+    BOOST_CHECK(file.isShownIn("XFCE"));
+    BOOST_CHECK(file.isShownIn("ubuntu:GNOME"));
+    BOOST_CHECK(!file.isShownIn("GNOME-Classic"));
+    BOOST_CHECK(!file.isShownIn("KDE:GNOME"));
+
+    std::istringstream notShownStream("[Desktop Entry]\nType=Application\nExec=vim\nNotShowIn=KDE;\n");
+    DesktopFile notShown(notShownStream, "file.desktop");
+    BOOST_CHECK(!notShown.hidden());
+    BOOST_CHECK(notShown.isShownIn("GNOME"));
+    BOOST_CHECK(!notShown.isShownIn("GNOME:KDE"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimehierarchy_test)
+
+BOOST_AUTO_TEST_CASE(MimeHierarchy_test)
+{
+    std::istringstream aliases(
+        "application/x-sh application/x-shellscript\n"
+        "text/x-c text/x-csrc\n");
+    std::istringstream subclasses(
+        "application/x-shellscript application/x-executable\n"
+        "application/x-shellscript text/plain\n"
+        "text/x-csrc text/plain\n"
+        "text/x-c++src text/x-csrc\n");
+
+    MimeHierarchy hierarchy;
+    hierarchy.addAliases(aliases);
+    hierarchy.addSubclasses(subclasses);
+
+    BOOST_CHECK_EQUAL(hierarchy.resolveAlias("application/x-sh"), "application/x-shellscript");
+    BOOST_CHECK_EQUAL(hierarchy.resolveAlias("text/plain"), "text/plain");
+
+    std::vector<std::string> result, expected;
+    expected.push_back("application/x-shellscript");
+    expected.push_back("application/x-executable");
+    expected.push_back("text/plain");
+    expected.push_back("application/octet-stream");
+    hierarchy.ancestors("application/x-sh", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    result.clear(); expected.clear();
+
+    expected.push_back("text/x-c++src");
+    expected.push_back("text/x-csrc");
+    expected.push_back("text/plain");
+    expected.push_back("application/octet-stream");
+    hierarchy.ancestors("text/x-c++src", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    result.clear(); expected.clear();
+
+    expected.push_back("text/x-unknown");
+    expected.push_back("text/plain");
+    expected.push_back("application/octet-stream");
+    hierarchy.ancestors("text/x-unknown", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    result.clear(); expected.clear();
+
+    expected.push_back("inode/directory");
+    hierarchy.ancestors("inode/directory", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimecache_test)
+
+/// Builder of big-endian mime.cache images.
+struct MimeCacheBuilder
+{
+    std::size_t offset() const {
+        return data.size();
+    }
+    void card16(unsigned int value) {
+        data.push_back(static_cast<char>((value >> 8) & 0xff));
+        data.push_back(static_cast<char>(value & 0xff));
+    }
+    void card32(unsigned int value) {
+        card16(value >> 16);
+        card16(value & 0xffff);
+    }
+    void patch32(std::size_t at, unsigned int value) {
+        MimeCacheBuilder tmp;
+        tmp.card32(value);
+        data.replace(at, 4, tmp.data);
+    }
+    std::size_t string(const char* str) {
+        std::size_t at = offset();
+        data.append(str, std::strlen(str) + 1);
+        while (data.size() % 4) {
+            data.push_back('\0');
+        }
+        return at;
+    }
+    std::string data;
+};
+
+/**
+ * Cache with alias application/x-sh -> application/x-shellscript, parent application/x-shellscript -> text/plain,
+ * literal "makefile", suffixes "*.sh" and "*.C" (case-sensitive) and glob "README*".
+ */
+static std::string buildMimeCache()
+{
+    MimeCacheBuilder b;
+    b.card16(1); b.card16(2);
+    for (int i=0; i<9; ++i) {
+        b.card32(0);
+    }
+
+    const std::size_t shellscript = b.string("application/x-shellscript");
+    const std::size_t alias = b.string("application/x-sh");
+    const std::size_t textPlain = b.string("text/plain");
+    const std::size_t makefile = b.string("text/x-makefile");
+    const std::size_t csrc = b.string("text/x-c++src");
+    const std::size_t readme = b.string("text/x-readme");
+    const std::size_t makefileLiteral = b.string("makefile");
+    const std::size_t readmeGlob = b.string("README*");
+
+    b.patch32(4, b.offset());
+    b.card32(1); b.card32(alias); b.card32(shellscript);
+
+    const std::size_t parents = b.offset();
+    b.card32(1); b.card32(textPlain);
+    b.patch32(8, b.offset());
+    b.card32(1); b.card32(shellscript); b.card32(parents);
+
+    b.patch32(12, b.offset());
+    b.card32(1); b.card32(makefileLiteral); b.card32(makefile); b.card32(50);
+
+    b.patch32(20, b.offset());
+    b.card32(1); b.card32(readmeGlob); b.card32(readme); b.card32(40);
+
+    // Reverse suffix tree: roots 'C' and 'h', 'h' -> 's' -> '.' -> leaf
+    b.patch32(16, b.offset());
+    const std::size_t tree = b.offset();
+    b.card32(2); b.card32(tree + 8);
+    const std::size_t rootC = b.offset();
+    b.card32('C'); b.card32(1); b.card32(0);
+    const std::size_t rootH = b.offset();
+    b.card32('h'); b.card32(1); b.card32(0);
+    const std::size_t dotC = b.offset();
+    b.card32('.'); b.card32(1); b.card32(0);
+    const std::size_t leafC = b.offset();
+    b.card32(0); b.card32(csrc); b.card32(50 | 0x100);
+    const std::size_t s = b.offset();
+    b.card32('s'); b.card32(1); b.card32(0);
+    const std::size_t dotS = b.offset();
+    b.card32('.'); b.card32(1); b.card32(0);
+    const std::size_t leafS = b.offset();
+    b.card32(0); b.card32(shellscript); b.card32(50);
+    b.patch32(rootC + 8, dotC);
+    b.patch32(dotC + 8, leafC);
+    b.patch32(rootH + 8, s);
+    b.patch32(s + 8, dotS);
+    b.patch32(dotS + 8, leafS);
+    return b.data;
+}
+
+BOOST_FIXTURE_TEST_CASE(MimeCache_test, XdgFixture)
+{
+    const std::string image = buildMimeCache();
+    writeFile("data/mime/mime.cache", image);
+
+    MimeCaches caches;
+    caches.load();
+    BOOST_REQUIRE_EQUAL(caches.size(), 1);
+    const MimeCache& cache = caches[0];
+
+    BOOST_CHECK_EQUAL(cache.resolveAlias("application/x-sh"), "application/x-shellscript");
+    BOOST_CHECK(cache.unalias("text/plain") == NULL);
+
+    std::vector<std::string> result, expected;
+    expected.push_back("application/x-shellscript");
+    expected.push_back("text/plain");
+    expected.push_back("application/octet-stream");
+    caches.ancestors("application/x-sh", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("makefile")), "text/x-makefile");
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("Makefile")), "text/x-makefile");
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("run.sh")), "application/x-shellscript");
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("RUN.SH")), "application/x-shellscript");
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("main.C")), "text/x-c++src");
+    BOOST_CHECK(cache.mimeTypeForFileName("main.c") == NULL);
+    BOOST_CHECK_EQUAL(std::string(cache.mimeTypeForFileName("README.md")), "text/x-readme");
+    BOOST_CHECK(cache.mimeTypeForFileName("sh") == NULL);
+
+    std::vector<GlobMatch> matches;
+    cache.globMatches("script.sh", std::back_inserter(matches));
+    BOOST_REQUIRE_EQUAL(matches.size(), 1);
+    BOOST_CHECK_EQUAL(matches[0].patternLength, 4);
+    BOOST_CHECK_EQUAL(matches[0].weight, 50);
+
+    // Truncated caches must not be read out of bounds.
+    for (std::size_t size = 0; size < image.size(); size += 4) {
+        const std::string path = writeFile("truncated.cache", image.substr(0, size));
+        try {
+            MimeCache truncated(path);
+            truncated.resolveAlias("application/x-sh");
+            truncated.mimeTypeForFileName("run.sh");
+            truncated.mimeTypeForFileName("README.md");
+            truncated.ancestors("application/x-sh", std::back_inserter(result));
+        } catch(std::runtime_error& e) {
+            BOOST_CHECK(size < 40);
+        }
+    }
+    BOOST_CHECK_THROW(MimeCache(buildPath(root, "nonexistent.cache")), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(system_MimeCache_test)
+{
+    MimeCaches caches;
+    caches.load();
+    std::cout << "mime.cache files: " << caches.size() << '\n';
+    for (std::size_t i=0; i<caches.size(); ++i) {
+        std::cout << caches[i].fileName() << '\n';
+    }
+    if (caches.size()) {
+        const char* mimeType = caches.mimeTypeForFileName("document.txt");
+        std::cout << "document.txt: " << (mimeType ? mimeType : "(none)") << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimeglobs_test)
+
+BOOST_FIXTURE_TEST_CASE(MimeGlobs_test, XdgFixture)
+{
+    writeFile("data/mime/globs2",
+        "# comment\n"
+        "50:text/x-makefile:makefile\n"
+        "50:application/x-compressed-tar:*.tar.gz\n"
+        "50:application/gzip:*.gz\n"
+        "70:text/x-c++src:*.C:cs\n"
+        "50:text/x-csrc:*.c\n"
+        "10:text/x-readme:README*\n"
+        "50:image/jpeg:__NOGLOBS__\n"
+        "50:image/jpeg:*.jpeg\n");
+    writeFile("share/mime/globs2",
+        "60:text/x-csrc-low:*.c\n"
+        "50:image/jpeg:*.jpg\n"
+        "50:text/x-log:*.log\n");
+    writeFile("share/mime/subclasses", "");
+
+    MimeGlobs globs;
+    globs.load();
+
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("Makefile")), "text/x-makefile");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("/some/dir/archive.tar.gz")), "application/x-compressed-tar");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("ARCHIVE.GZ")), "application/gzip");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("main.C")), "text/x-c++src");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("main.c")), "text/x-csrc-low");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("README.md")), "text/x-readme");
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("photo.jpeg")), "image/jpeg");
+    BOOST_CHECK(globs.mimeTypeForFileName("photo.jpg") == NULL);
+    BOOST_CHECK_EQUAL(std::string(globs.mimeTypeForFileName("server.log")), "text/x-log");
+    BOOST_CHECK(globs.mimeTypeForFileName("noextension") == NULL);
+    BOOST_CHECK(globs.mimeTypeForFileName("dir/") == NULL);
+
+    std::vector<GlobMatch> matches;
+    globs.globMatches("source.c", std::back_inserter(matches));
+    BOOST_REQUIRE_EQUAL(matches.size(), 2);
+    BOOST_CHECK_EQUAL(std::string(matches[0].mimeType), "text/x-csrc-low");
+    BOOST_CHECK_EQUAL(matches[0].weight, 60);
+    BOOST_CHECK_EQUAL(std::string(matches[1].mimeType), "text/x-csrc");
+}
+
+BOOST_AUTO_TEST_CASE(system_MimeGlobs_test)
+{
+    MimeGlobs globs;
+    globs.load();
+    if (globs.size()) {
+        const char* names[] = {"index.html", "photo.JPG", "archive.tar.gz", "Makefile", "CMakeLists.txt"};
+        for (std::size_t i=0; i<sizeof(names)/sizeof(const char*); ++i) {
+            const char* mimeType = globs.mimeTypeForFileName(names[i]);
+            std::cout << names[i] << ": " << (mimeType ? mimeType : "(none)") << '\n';
+        }
+        std::cout << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimemagic_test)
+
+/// Encode matchlet value in magic file format: big-endian length followed by bytes.
+static std::string magicValue(const std::string& bytes)
+{
+    std::string result;
+    result.push_back(static_cast<char>(bytes.size() >> 8));
+    result.push_back(static_cast<char>(bytes.size() & 0xff));
+    return result + bytes;
+}
+
+BOOST_FIXTURE_TEST_CASE(MimeMagic_test, XdgFixture)
+{
+    const std::string signature("MIME-Magic\0\n", 12);
+    writeFile("data/mime/magic", signature +
+        "[90:image/png]\n"
+        ">0=" + magicValue("\x89PNG") + "\n"
+        "[50:text/x-nested]\n"
+        ">0=" + magicValue("foo") + "\n"
+        "1>4=" + magicValue("bar") + "\n"
+        "1>4=" + magicValue("baz") + "\n"
+        "[40:application/x-masked]\n"
+        ">2=" + magicValue("AB") + "&" + std::string("\xdf\xdf") + "+8\n"
+        "[30:application/x-unknown-ext]\n"
+        ">0=" + magicValue("foo") + "?future\n"
+        "[20:image/x-blocked]\n"
+        "__NOMAGIC__\n");
+    writeFile("share/mime/magic", signature +
+        "[60:image/x-blocked]\n"
+        ">0=" + magicValue("BLK") + "\n"
+        "[10:application/x-word]\n"
+        ">0=" + magicValue(std::string("\x12\x34", 2)) + "~2\n");
+
+    MimeMagic magic;
+    magic.load();
+    BOOST_CHECK_EQUAL(magic.size(), 4);
+    BOOST_CHECK_EQUAL(magic.maxExtent(), 2 + 7 + 2);
+
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForData("\x89PNG\r\n", 6)), "image/png");
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForData("foo bar", 7)), "text/x-nested");
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForData("foo baz", 7)), "text/x-nested");
+    BOOST_CHECK(magic.mimeTypeForData("foo qux", 7) == NULL);
+    BOOST_CHECK(magic.mimeTypeForData("foo", 3) == NULL);
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForData("......ab", 8)), "application/x-masked");
+    BOOST_CHECK(magic.mimeTypeForData("BLK", 3) == NULL);
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForData("\x34\x12", 2)), "application/x-word");
+    BOOST_CHECK(magic.mimeTypeForData("", 0) == NULL);
+
+    const std::string png = writeFile("picture", "\x89PNG\r\n\x1a\n");
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForFile(png)), "image/png");
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForFile(png)), "image/png");
+    BOOST_CHECK_EQUAL(magic.cacheMisses(), 1);
+    BOOST_CHECK_EQUAL(magic.cacheHits(), 1);
+
+    writeFile("picture", "foo bar!!");
+    BOOST_CHECK_EQUAL(std::string(magic.mimeTypeForFile(png)), "text/x-nested");
+    BOOST_CHECK_EQUAL(magic.cacheMisses(), 2);
+    BOOST_CHECK_EQUAL(magic.cacheSize(), 2);
+
+    MimeMagic bounded(1);
+    bounded.load();
+    const std::string other = writeFile("other", "\x89PNG\r\n\x1a\n");
+    BOOST_CHECK_EQUAL(std::string(bounded.mimeTypeForFile(png)), "text/x-nested");
+    BOOST_CHECK_EQUAL(std::string(bounded.mimeTypeForFile(other)), "image/png");
+    BOOST_CHECK_EQUAL(bounded.cacheSize(), 1);
+    BOOST_CHECK_EQUAL(std::string(bounded.mimeTypeForFile(png)), "text/x-nested");
+    BOOST_CHECK_EQUAL(bounded.cacheMisses(), 3);
+
+    MimeMagic uncached(0);
+    uncached.load();
+    BOOST_CHECK_EQUAL(std::string(uncached.mimeTypeForFile(png)), "text/x-nested");
+    BOOST_CHECK_EQUAL(std::string(uncached.mimeTypeForFile(png)), "text/x-nested");
+    BOOST_CHECK_EQUAL(uncached.cacheSize(), 0);
+    BOOST_CHECK_EQUAL(uncached.cacheHits(), 0);
+
+    BOOST_CHECK(magic.mimeTypeForFile(root) == NULL);
+    BOOST_CHECK(magic.mimeTypeForFile(buildPath(root, "nonexistent")) == NULL);
+
+    std::istringstream notMagic("not a magic file");
+    BOOST_CHECK_THROW(magic.addMagic(notMagic), std::runtime_error);
+    std::istringstream truncated(signature + "[50:text/x-truncated]\n>0=" + magicValue("abc").substr(0, 3));
+    BOOST_CHECK_THROW(magic.addMagic(truncated), std::runtime_error);
+    BOOST_CHECK_EQUAL(magic.size(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(system_MimeMagic_test)
+{
+    MimeMagic magic;
+    magic.loadDirectory("/usr/share/mime");
+    if (magic.size() == 0) {
+        return;
+    }
+    const char png[] = "\x89PNG\r\n\x1a\n\0\0\0\rIHDR";
+    const char* mimeType = magic.mimeTypeForData(png, sizeof(png) - 1);
+    BOOST_REQUIRE(mimeType != NULL);
+    BOOST_CHECK_EQUAL(std::string(mimeType), "image/png");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(classifier_test)
+
+BOOST_FIXTURE_TEST_CASE(Classifier_test, XdgFixture)
+{
+    writeFile("data/mime/globs2", "50:text/plain:*.txt\n");
+    writeFile("data/mime/magic", std::string("MIME-Magic\0\n", 12) + "[50:image/png]\n>0=" + std::string("\0\x04\x89PNG\n", 7));
+    writeFile("data/applications/editor.desktop",
+              "[Desktop Entry]\n"
+              "Type=Application\n"
+              "Name=Editor\n"
+              "Exec=/bin/sh %f\n");
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=editor.desktop\n");
+
+    MimeGlobs globs;
+    globs.load();
+    MimeMagic magic;
+    magic.load();
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    const Classifier classifier(globs, magic, index, hierarchy);
+
+    const std::size_t count = 500;
+    std::vector<std::string> paths;
+    for (std::size_t i=0; i<count; ++i) {
+        std::ostringstream name;
+        name << "files/" << i;
+        if (i % 2) {
+            paths.push_back(writeFile(name.str() + ".txt", "text"));
+        } else {
+            paths.push_back(writeFile(name.str(), "\x89PNG\r\n\x1a\n"));
+        }
+    }
+    paths.push_back(buildPath(root, "files"));
+    paths.push_back(buildPath(root, "files/missing"));
+
+    std::vector<Classification> results;
+    ClassificationStats stats = classifier.classify(paths.begin(), paths.end(), std::back_inserter(results), 4);
+    BOOST_CHECK_EQUAL(stats.files, paths.size());
+    BOOST_CHECK_EQUAL(stats.resolved, count / 2);
+    BOOST_CHECK_EQUAL(stats.threads, 4);
+    BOOST_REQUIRE_EQUAL(results.size(), paths.size());
+
+    std::unordered_map<std::string, Classification> byPath;
+    for (std::vector<Classification>::const_iterator it = results.begin(); it != results.end(); ++it) {
+        byPath[it->path] = *it;
+    }
+    BOOST_REQUIRE_EQUAL(byPath.size(), paths.size());
+    BOOST_CHECK_EQUAL(byPath[paths[0]].mimeType, "image/png");
+    BOOST_CHECK(byPath[paths[0]].desktopId.empty());
+    BOOST_CHECK_EQUAL(byPath[paths[1]].mimeType, "text/plain");
+    BOOST_CHECK_EQUAL(byPath[paths[1]].desktopId, "editor.desktop");
+    BOOST_CHECK_EQUAL(byPath[buildPath(root, "files")].mimeType, "inode/directory");
+    BOOST_CHECK(byPath[buildPath(root, "files/missing")].mimeType.empty());
+
+    // Type is never guessed by name for directories and paths that don't exist.
+    writeFile("x.txt/inner", "");
+    BOOST_CHECK_EQUAL(classifier.mimeTypeForFile(buildPath(root, "x.txt")), "inode/directory");
+    BOOST_CHECK(classifier.mimeTypeForFile(buildPath(root, "missing.txt")).empty());
+    BOOST_CHECK(classifier.classify(buildPath(root, "missing.txt")).desktopId.empty());
+
+    results.clear();
+    stats = classifier.classify(paths.begin(), paths.begin(), std::back_inserter(results));
+    BOOST_CHECK_EQUAL(stats.files, 0);
+    BOOST_CHECK(results.empty());
+
+    stats = classifier.classify(paths.begin(), paths.begin() + 3, std::back_inserter(results), 1);
+    BOOST_CHECK_EQUAL(stats.files, 3);
+    BOOST_CHECK_EQUAL(stats.threads, 1);
+
+    // Input longer than one chunk is read from single-pass range piece by piece.
+    const std::size_t repeated = details::ClassificationChunkSize + 100;
+    std::ostringstream input;
+    for (std::size_t i=0; i<repeated; ++i) {
+        input << paths[1] << '\n';
+    }
+    std::istringstream inputStream(input.str());
+    std::size_t textFiles = 0;
+    results.clear();
+    stats = classifier.classify(std::istream_iterator<std::string>(inputStream), std::istream_iterator<std::string>(), std::back_inserter(results), 2);
+    BOOST_CHECK_EQUAL(stats.files, repeated);
+    BOOST_CHECK_EQUAL(stats.resolved, repeated);
+    for (std::vector<Classification>::const_iterator it = results.begin(); it != results.end(); ++it) {
+        textFiles += it->mimeType == "text/plain" ? 1 : 0;
+    }
+    BOOST_CHECK_EQUAL(textFiles, repeated);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(associationindex_test)
+
+BOOST_AUTO_TEST_CASE(AssociationIndex_test)
+{
+    std::istringstream userList(
+        "[Default Applications]\n"
+        "text/plain=editor.desktop;\n"
+        "[Removed Associations]\n"
+        "text/plain=viewer.desktop;\n"
+        "[Added Associations]\n"
+        "text/plain=editor.desktop;ide.desktop;\n");
+    std::istringstream systemList(
+        "[Default Applications]\n"
+        "text/plain=ide.desktop;editor.desktop\n"
+        "[Added Associations]\n"
+        "text/plain=viewer.desktop;\n");
+    std::istringstream cache(
+        "[MIME Cache]\n"
+        "text/plain=notepad.desktop;ide.desktop;\n"
+        "image/png=viewer.desktop;\n");
+
+    AssociationIndex index;
+    index.addMimeAppsList(userList);
+    index.addMimeAppsList(systemList);
+    index.addMimeInfoCache(cache);
+
+    BOOST_CHECK(index.contains("image/png"));
+    BOOST_CHECK(!index.contains("image/jpeg"));
+
+    std::vector<std::string> result, expected;
+    expected.push_back("editor.desktop");
+    expected.push_back("ide.desktop");
+    expected.push_back("notepad.desktop");
+    index.associatedApplications("text/plain", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    result.clear(); expected.clear();
+
+    expected.push_back("editor.desktop");
+    expected.push_back("ide.desktop");
+    index.defaultApplications("text/plain", std::back_inserter(result));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+
+    std::istringstream broken("[Added Associations]\ntext/plain=broken.desktop\nno equal sign\n");
+    BOOST_CHECK_THROW(index.addMimeAppsList(broken), std::runtime_error);
+    result.clear();
+    index.associatedApplications("text/plain", std::back_inserter(result));
+    BOOST_CHECK(std::find(result.begin(), result.end(), "broken.desktop") == result.end());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(mimeapps_test)
 
+static const char* const shellDesktopFile =
+    "[Desktop Entry]\n"
+    "Type=Application\n"
+    "Name=Shell\n"
+    "Exec=/bin/sh %f\n";
+
+BOOST_FIXTURE_TEST_CASE(parent_fallback_test, XdgFixture)
+{
+    writeFile("share/mime/subclasses", "application/x-shellscript text/plain\n");
+    writeFile("share/mime/aliases", "application/x-sh application/x-shellscript\n");
+    writeFile("data/applications/editor.desktop", shellDesktopFile);
+    writeFile("data/applications/runner.desktop", shellDesktopFile);
+    writeFile("data/applications/mimeinfo.cache",
+              "[MIME Cache]\n"
+              "text/plain=editor.desktop;\n"
+              "application/x-shellscript=runner.desktop;\n");
+
+    std::vector<DesktopFile> files;
+    findAssociatedApplications("application/x-sh", std::back_inserter(files));
+    BOOST_REQUIRE_EQUAL(files.size(), 2);
+    BOOST_CHECK_EQUAL(files[0].fileName(), buildPath(root, "data/applications/runner.desktop"));
+    BOOST_CHECK_EQUAL(files[1].fileName(), buildPath(root, "data/applications/editor.desktop"));
+
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+
+    files.clear();
+    findAssociatedApplications(index, hierarchy, "text/x-python", std::back_inserter(files));
+    BOOST_REQUIRE_EQUAL(files.size(), 1);
+    BOOST_CHECK_EQUAL(files[0].fileName(), buildPath(root, "data/applications/editor.desktop"));
+
+    BOOST_CHECK_EQUAL(findDefaultApplication("application/x-shellscript").fileName(), buildPath(root, "data/applications/runner.desktop"));
+    BOOST_CHECK_EQUAL(findDefaultApplication(index, hierarchy, "text/x-python").fileName(), buildPath(root, "data/applications/editor.desktop"));
+    BOOST_CHECK(!findDefaultApplication(index, hierarchy, "inode/directory").isValid());
+}
+
 BOOST_AUTO_TEST_CASE(findAssociatedApplications_test)
 {
     std::vector<DesktopFile> desktopFiles;
@@ -355,6 +1040,106 @@ BOOST_AUTO_TEST_CASE(findAssociatedApplications_test)
     std::cout << std::endl;
 }
 
+static std::string syntheticDesktopId(std::size_t i)
+{
+    std::ostringstream stream;
+    stream << "app" << i << ".desktop";
+    return stream.str();
+}
+
+static double timeListAssociatedApplications(XdgFixture& fixture, std::size_t count, std::vector<std::string>& result)
+{
+    std::string added, removed, cached;
+    for (std::size_t i=0; i<count; ++i) {
+        added += syntheticDesktopId(i) + ';';
+        if (i % 10 == 0) {
+            removed += syntheticDesktopId(i) + ';';
+        }
+        cached += syntheticDesktopId(count - 1 - i) + ';' + syntheticDesktopId(count + i) + ';';
+    }
+    fixture.writeFile("config/mimeapps.list", "[Removed Associations]\ntext/plain=" + removed + "\n[Added Associations]\ntext/plain=" + added + '\n');
+    fixture.writeFile("data/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=" + cached + '\n');
+
+    double best = 0;
+    for (int attempt = 0; attempt < 5; ++attempt) {
+        result.clear();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        listAssociatedApplications("text/plain", std::back_inserter(result));
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (attempt == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+BOOST_FIXTURE_TEST_CASE(listAssociatedApplications_scaling_test, XdgFixture)
+{
+    const std::size_t count = 2000;
+    std::vector<std::string> result;
+    const double halfTime = timeListAssociatedApplications(*this, count / 2, result);
+    const double fullTime = timeListAssociatedApplications(*this, count, result);
+
+    std::vector<std::string> expected;
+    for (std::size_t i=0; i<count; ++i) {
+        if (i % 10 != 0) {
+            expected.push_back(syntheticDesktopId(i));
+        }
+    }
+    for (std::size_t i=0; i<count; ++i) {
+        expected.push_back(syntheticDesktopId(count + i));
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+
+    std::cout << "listAssociatedApplications: " << count / 2 << " associations in " << halfTime * 1000 << " ms, "
+              << count << " associations in " << fullTime * 1000 << " ms" << std::endl;
+    BOOST_WARN_LT(fullTime, halfTime * 3);
+}
+
+BOOST_AUTO_TEST_CASE(isDesktopFileOk_test)
+{
+    const char* savedDesktop = std::getenv("XDG_CURRENT_DESKTOP");
+    const std::string saved = savedDesktop ? savedDesktop : "";
+    ::setenv("XDG_CURRENT_DESKTOP", "XFCE", 1);
+
+    const char* const contents[] = {
+        "[Desktop Entry]\nType=Application\nExec=/bin/sh\nNoDisplay=true\nOnlyShowIn=XFCE;\nTryExec=sh\n",
+        "[Desktop Entry]\nType=Application\nExec=/bin/sh\nHidden=true\n",
+        "[Desktop Entry]\nType=Application\nExec=/bin/sh\nOnlyShowIn=GNOME;\n",
+        "[Desktop Entry]\nType=Application\nExec=/bin/sh\nNotShowIn=XFCE;\n",
+        "[Desktop Entry]\nType=Application\nExec=/bin/sh\nTryExec=mimeapps-nonexistent-program\n",
+        "[Desktop Entry]\nType=Application\nExec=mimeapps-nonexistent-program\n"
+    };
+    for (std::size_t i=0; i<sizeof(contents)/sizeof(contents[0]); ++i) {
+        std::istringstream stream(contents[i]);
+        BOOST_CHECK_EQUAL(details::isDesktopFileOk(DesktopFile(stream, "file.desktop")), i == 0);
+    }
+
+    if (savedDesktop) {
+        ::setenv("XDG_CURRENT_DESKTOP", saved.c_str(), 1);
+    } else {
+        ::unsetenv("XDG_CURRENT_DESKTOP");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ExecutableCache_test)
+{
+    ExecutableCache cache;
+    const std::string sh = cache.find("sh");
+    BOOST_CHECK(!sh.empty());
+    BOOST_CHECK_EQUAL(cache.find("sh"), sh);
+    BOOST_CHECK(cache.find("mimeapps-nonexistent-program").empty());
+    BOOST_CHECK(cache.find("mimeapps-nonexistent-program").empty());
+    BOOST_CHECK_EQUAL(cache.hits(), 2);
+    BOOST_CHECK_EQUAL(cache.misses(), 2);
+
+    ExecutableCache expiring(std::chrono::milliseconds(0));
+    expiring.find("mimeapps-nonexistent-program");
+    expiring.find("mimeapps-nonexistent-program");
+    BOOST_CHECK_EQUAL(expiring.hits(), 0);
+    BOOST_CHECK_EQUAL(expiring.misses(), 2);
+}
+
 BOOST_AUTO_TEST_CASE(getMimeAppsListPaths_test)
 {
     std::vector<std::string> mimeAppsLists;
@@ -404,4 +1189,970 @@ BOOST_AUTO_TEST_CASE(basedir_paths_test)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(BaseDirs_test, XdgFixture)
+{
+    writeFile("share/mime/subclasses", "application/x-shellscript text/plain\n");
+    writeFile("share/applications/editor.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("share/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=editor.desktop;\n");
+    writeFile("other/applications/mimeapps.list", "[Default Applications]\ntext/plain=editor.desktop;\n");
+    BOOST_REQUIRE(::symlink(buildPath(root, "share").c_str(), buildPath(root, "link").c_str()) == 0);
+
+    const std::string share = buildPath(root, "share");
+    ::setenv("XDG_DATA_DIRS", (share + ':' + share + "/:" + root + "/missing:" + root + "/link").c_str(), 1);
+
+    resetStats();
+    BaseDirs baseDirs;
+    if (statsEnabled()) {
+        // Only existing directories are counted, each is stat'ed once however many directories precede it.
+        BOOST_CHECK_EQUAL(getStats().filesOpened, 3);
+        BOOST_CHECK_EQUAL(getStats().statCalls, 3);
+    }
+    BOOST_CHECK_EQUAL(baseDirs.configHome(), buildPath(root, "config"));
+    BOOST_CHECK_EQUAL(baseDirs.configHomeDirectory().fd, -1);
+    BOOST_CHECK(baseDirs.configDirectories().empty());
+    BOOST_REQUIRE_EQUAL(baseDirs.dataDirectories().size(), 1);
+    BOOST_CHECK_EQUAL(baseDirs.dataDirectories()[0].path, share);
+    BOOST_CHECK(baseDirs.dataDirectories()[0].fd >= 0);
+    struct stat st;
+    BOOST_REQUIRE(::stat(share.c_str(), &st) == 0);
+    BOOST_CHECK(baseDirs.dataDirectories()[0].device == st.st_dev);
+    BOOST_CHECK(baseDirs.dataDirectories()[0].inode == st.st_ino);
+
+    // Snapshot does not follow environment until refreshed.
+    ::setenv("XDG_DATA_DIRS", (buildPath(root, "other") + ':' + share).c_str(), 1);
+    std::vector<std::string> applicationsPaths;
+    getApplicationsPaths(baseDirs, std::back_inserter(applicationsPaths));
+    BOOST_REQUIRE_EQUAL(applicationsPaths.size(), 2);
+    BOOST_CHECK_EQUAL(applicationsPaths[1], buildPath(share, "applications"));
+
+    std::vector<DesktopFile> files;
+    findAssociatedApplications(baseDirs, "application/x-shellscript", std::back_inserter(files));
+    BOOST_REQUIRE_EQUAL(files.size(), 1);
+    BOOST_CHECK_EQUAL(files[0].fileName(), buildPath(share, "applications/editor.desktop"));
+
+    baseDirs.refresh();
+    BOOST_REQUIRE_EQUAL(baseDirs.dataDirectories().size(), 2);
+    BOOST_CHECK_EQUAL(baseDirs.dataDirectories()[0].path, buildPath(root, "other"));
+    std::string desktopId;
+    AssociationIndex index;
+    index.load(baseDirs);
+    MimeHierarchy hierarchy;
+    hierarchy.load(baseDirs);
+    BOOST_CHECK(findDefaultApplication(index, hierarchy, "text/plain", &desktopId, NULL, &baseDirs).isValid());
+    BOOST_CHECK_EQUAL(desktopId, "editor.desktop");
+    BOOST_CHECK(findDefaultApplication(baseDirs, "application/x-shellscript").isValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(stats_test)
+
+BOOST_FIXTURE_TEST_CASE(stats_counters_test, XdgFixture)
+{
+    writeFile("data/applications/editor.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=editor.desktop;\n");
+
+    resetStats();
+    std::vector<DesktopFile> files;
+    findAssociatedApplications("text/plain", std::back_inserter(files));
+    BOOST_CHECK_EQUAL(files.size(), 1);
+    findExecutable("sh");
+
+    const Stats stats = getStats();
+    if (statsEnabled()) {
+        BOOST_CHECK_GE(stats.filesOpened, 2);
+        BOOST_CHECK_GT(stats.bytesRead, 0);
+        BOOST_CHECK_GT(stats.statCalls, 0);
+        BOOST_CHECK_GT(stats.accessCalls, 0);
+        BOOST_CHECK_GE(stats.linesParsed, 6);
+        BOOST_CHECK_EQUAL(stats.entryPoints[FindAssociatedApplicationsCall].calls, 1);
+        BOOST_CHECK_GT(stats.entryPoints[FindAssociatedApplicationsCall].nanoseconds, 0);
+        BOOST_CHECK_GE(stats.entryPoints[FindExecutableCall].calls, 2);
+
+        resetStats();
+        BOOST_CHECK_EQUAL(getStats().filesOpened, 0);
+        BOOST_CHECK_EQUAL(getStats().entryPoints[FindAssociatedApplicationsCall].calls, 0);
+    } else {
+        BOOST_CHECK_EQUAL(stats.filesOpened, 0);
+        BOOST_CHECK_EQUAL(stats.linesParsed, 0);
+        BOOST_CHECK_EQUAL(stats.entryPoints[FindAssociatedApplicationsCall].calls, 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(trace_test)
+
+struct RecordingSink : TraceSink
+{
+    void beginSpan(const char* name) {
+        events.push_back(std::string("begin ") + name);
+    }
+    void endSpan(const char* name, const std::vector<TraceAttribute>& attributes) {
+        std::string event = std::string("end ") + name;
+        for (std::vector<TraceAttribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+            std::ostringstream value;
+            if (it->isNumber) {
+                value << it->numberValue;
+            } else {
+                value << it->stringValue;
+            }
+            event += std::string(" ") + it->name + "=" + value.str();
+        }
+        events.push_back(event);
+    }
+    std::vector<std::string> events;
+};
+
+BOOST_AUTO_TEST_CASE(trace_spans_test)
+{
+    RecordingSink sink;
+    setTraceSink(&sink);
+    BOOST_CHECK(traceSink() == &sink);
+
+    std::istringstream stream("[Group]\nKey=Value\n");
+    SearchRequest request;
+    request.addRequest("Group", "Key");
+    request.searchKeyValues(stream);
+
+    const std::vector<std::string> dirs(1, "/nonexistent");
+    findDesktopFile(dirs.begin(), dirs.end(), "app.desktop");
+
+    setTraceSink(NULL);
+    std::istringstream untraced("[Group]\n");
+    request.searchKeyValues(untraced);
+
+    BOOST_REQUIRE_EQUAL(sink.events.size(), 4);
+    BOOST_CHECK_EQUAL(sink.events[0], "begin search_key_values");
+    BOOST_CHECK_EQUAL(sink.events[1], "end search_key_values lines=2 bytes=18");
+    BOOST_CHECK_EQUAL(sink.events[2], "begin resolve_desktop_id");
+    BOOST_CHECK_EQUAL(sink.events[3], "end resolve_desktop_id desktop_id=app.desktop path=");
+}
+
+BOOST_FIXTURE_TEST_CASE(findDefaultApplication_stops_early_test, XdgFixture)
+{
+    writeFile("data/applications/editor.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/viewer.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=missing.desktop;editor.desktop\n");
+    writeFile("etc/mimeapps.list", "[Default Applications]\ntext/plain=viewer.desktop\ntext/x-python=viewer.desktop\n");
+
+    RecordingSink sink;
+    setTraceSink(&sink);
+    const DesktopFile file = findDefaultApplication("text/plain");
+    setTraceSink(NULL);
+    BOOST_CHECK_EQUAL(file.fileName(), buildPath(root, "data/applications/editor.desktop"));
+    BOOST_CHECK_EQUAL(std::count(sink.events.begin(), sink.events.end(), "begin parse_mimeapps_list"), 1);
+    BOOST_CHECK_EQUAL(std::count(sink.events.begin(), sink.events.end(), "begin parse_mimeinfo_cache"), 0);
+
+    // MIME hierarchy is not read when exact type has default application.
+    writeFile("share/mime/subclasses", "text/x-python text/plain\n");
+    if (statsEnabled()) {
+        resetStats();
+        findDefaultApplication("text/plain");
+        BOOST_CHECK_EQUAL(getStats().filesOpened, 2);
+    }
+
+    // Exact type found only in the last file still wins over parent type found in the first one.
+    BOOST_CHECK_EQUAL(findDefaultApplication("text/x-python").fileName(), buildPath(root, "data/applications/viewer.desktop"));
+}
+
+BOOST_FIXTURE_TEST_CASE(AssociatedApplications_test, XdgFixture)
+{
+    writeFile("share/mime/subclasses", "application/x-shellscript text/plain\n");
+    writeFile("data/applications/first.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/broken.desktop", "[Desktop Entry]\nType=Application\nName=Broken\nExec=/nonexistent/program\n");
+    writeFile("data/applications/second.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/mimeinfo.cache",
+              "[MIME Cache]\n"
+              "application/x-shellscript=first.desktop;broken.desktop;\n"
+              "text/plain=second.desktop;first.desktop;\n");
+
+    RecordingSink sink;
+    setTraceSink(&sink);
+    AssociatedApplications applications("application/x-shellscript");
+    AssociatedApplications::iterator it = applications.begin();
+    BOOST_REQUIRE(it != applications.end());
+    BOOST_CHECK_EQUAL(it->fileName(), buildPath(root, "data/applications/first.desktop"));
+    BOOST_CHECK_EQUAL(std::count(sink.events.begin(), sink.events.end(), "begin parse_desktop_file"), 1);
+    ++it;
+    setTraceSink(NULL);
+    BOOST_REQUIRE(it != applications.end());
+    BOOST_CHECK_EQUAL(it->fileName(), buildPath(root, "data/applications/second.desktop"));
+    BOOST_CHECK_EQUAL(std::count(sink.events.begin(), sink.events.end(), "begin parse_desktop_file"), 3);
+    ++it;
+    BOOST_CHECK(it == applications.end());
+
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    hierarchy.load();
+    std::vector<DesktopFile> files;
+    AssociatedApplications indexed(index, hierarchy, "application/x-shellscript");
+    std::copy(indexed.begin(), indexed.end(), std::back_inserter(files));
+    BOOST_REQUIRE_EQUAL(files.size(), 2);
+    BOOST_CHECK_EQUAL(files[0].fileName(), buildPath(root, "data/applications/first.desktop"));
+    BOOST_CHECK_EQUAL(files[1].fileName(), buildPath(root, "data/applications/second.desktop"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(desktopfilecache_test)
+
+BOOST_FIXTURE_TEST_CASE(DesktopFileCache_test, XdgFixture)
+{
+    const std::string first = writeFile("data/applications/first.desktop", mimeapps_test::shellDesktopFile);
+    const std::string second = writeFile("data/applications/second.desktop", mimeapps_test::shellDesktopFile);
+    const std::string third = writeFile("data/applications/third.desktop", mimeapps_test::shellDesktopFile);
+
+    DesktopFileCache cache(2);
+    BOOST_CHECK_EQUAL(cache.get(first).name(), "Shell");
+    BOOST_CHECK_EQUAL(cache.get(first).name(), "Shell");
+    BOOST_CHECK_EQUAL(cache.hits(), 1);
+    BOOST_CHECK_EQUAL(cache.misses(), 1);
+
+    writeFile("data/applications/first.desktop", "[Desktop Entry]\nType=Application\nName=Changed shell\nExec=/bin/sh %f\n");
+    BOOST_CHECK_EQUAL(cache.get(first).name(), "Changed shell");
+    BOOST_CHECK_EQUAL(cache.misses(), 2);
+
+    cache.get(second);
+    cache.get(first);
+    cache.get(third); // evicts second, which is least recently used
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    const std::size_t misses = cache.misses();
+    cache.get(first);
+    BOOST_CHECK_EQUAL(cache.misses(), misses);
+    cache.get(second);
+    BOOST_CHECK_EQUAL(cache.misses(), misses + 1);
+
+    BOOST_CHECK(!cache.get(buildPath(root, "data/applications/missing.desktop")).isValid());
+
+    writeFile("data/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=first.desktop;second.desktop;\n");
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+    DesktopFileCache shared;
+    std::vector<DesktopFile> files;
+    findAssociatedApplications(index, hierarchy, "text/plain", std::back_inserter(files), &shared);
+    findAssociatedApplications(index, hierarchy, "text/plain", std::back_inserter(files), &shared);
+    BOOST_CHECK_EQUAL(files.size(), 4);
+    BOOST_CHECK_EQUAL(shared.misses(), 2);
+    BOOST_CHECK_EQUAL(shared.hits(), 2);
+
+    std::string desktopId;
+    BOOST_CHECK_EQUAL(findDefaultApplication(index, hierarchy, "text/plain", &desktopId, &shared).fileName(), first);
+    BOOST_CHECK_EQUAL(desktopId, "first.desktop");
+    BOOST_CHECK_EQUAL(shared.hits(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(arena_test)
+
+BOOST_AUTO_TEST_CASE(Arena_test)
+{
+    Arena arena(256);
+    void* first = arena.allocate(3, 1);
+    void* second = arena.allocate(8, 8);
+    BOOST_CHECK(first != second);
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::size_t>(second) % 8, 0);
+    BOOST_CHECK_EQUAL(arena.chunkCount(), 0);
+
+    arena.allocate(Arena::InitialSize, 1);
+    BOOST_CHECK_EQUAL(arena.chunkCount(), 1);
+    BOOST_CHECK(arena.bytesAllocated() >= Arena::InitialSize + 11);
+
+    arena.release();
+    BOOST_CHECK_EQUAL(arena.chunkCount(), 0);
+    BOOST_CHECK_EQUAL(arena.bytesAllocated(), 0);
+    BOOST_CHECK(arena.allocate(3, 1) == first);
+
+    // Chunks grow from the initial chunk size again after release.
+    arena.allocate(Arena::InitialSize - 3, 1);
+    arena.allocate(200, 1);
+    arena.allocate(200, 1);
+    BOOST_CHECK_EQUAL(arena.chunkCount(), 2);
+    arena.release();
+
+    const ArenaAllocator<char> allocator(&arena);
+    ArenaStringVector strings(allocator);
+    for (int i=0; i<100; ++i) {
+        strings.emplace_back("a string too long for small string optimization");
+    }
+    BOOST_CHECK(strings.back().get_allocator() == allocator);
+    BOOST_CHECK(arena.chunkCount() < 10);
+
+    ArenaString heapString("not from arena");
+    BOOST_CHECK(heapString.get_allocator().arena() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(arena_queries_test)
+{
+    Arena arena;
+    BOOST_CHECK_EQUAL(buildPath("/usr/share", "applications", arena), "/usr/share/applications");
+    BOOST_CHECK_EQUAL(buildPath("/usr/share/", "/etc", arena), "/etc");
+
+    std::istringstream stream("[Group]\nKey=Value\nOther=Thing\n");
+    SearchRequest request(&arena);
+    request.addRequest("Group", "Key");
+    request.searchKeyValues(stream);
+    BOOST_CHECK_EQUAL(request.getValue("Group", "Key").value(), "Value");
+    BOOST_CHECK(!request.getValue("Group", "Other").found());
+
+    std::istringstream desktopStream("[Desktop Entry]\nType=Application\nName=Arena\nExec=/bin/sh\n");
+    const DesktopFile desktopFile(desktopStream, "arena.desktop", &arena);
+    BOOST_CHECK_EQUAL(desktopFile.name(), "Arena");
+    BOOST_CHECK_EQUAL(desktopFile.fileName(), "arena.desktop");
+
+    details::AssociationMerger merger(&arena);
+    merger.remove("removed.desktop");
+    BOOST_CHECK(!merger.add("removed.desktop"));
+    BOOST_CHECK(merger.add("added.desktop"));
+    BOOST_CHECK(!merger.add("added.desktop"));
+    BOOST_CHECK(arena.bytesAllocated() > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimeappslist_test)
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream stream(path.c_str());
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+BOOST_FIXTURE_TEST_CASE(MimeAppsListEditor_test, XdgFixture)
+{
+    const std::string listPath = writeFile("config/mimeapps.list",
+        "# Keep this comment\n"
+        "[Added Associations]\n"
+        "text/plain=gedit.desktop;\n"
+        "image/png=eog.desktop;\n"
+        "\n"
+        "[Custom Group]\n"
+        "text/plain=untouched\n");
+    writeFile("data/applications/mimeinfo.cache",
+              "[MIME Cache]\n"
+              "text/plain=kate.desktop;gedit.desktop;\n");
+    writeFile("data/applications/gedit.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/kate.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/vim.desktop", mimeapps_test::shellDesktopFile);
+
+    AssociationIndex index;
+    index.load();
+    MimeHierarchy hierarchy;
+
+    MimeAppsListEditor editor;
+    BOOST_CHECK_EQUAL(editor.path(), listPath);
+    editor.setDefaultApplication("text/plain", "vim.desktop");
+    editor.removeAssociation("text/plain", "kate.desktop");
+    editor.addAssociation("text/html", "gedit.desktop");
+    BOOST_CHECK_EQUAL(editor.changeCount(), 3);
+    editor.commit(&index);
+    BOOST_CHECK_EQUAL(editor.changeCount(), 0);
+
+    BOOST_CHECK_EQUAL(readFile(listPath),
+        "# Keep this comment\n"
+        "[Added Associations]\n"
+        "text/plain=vim.desktop;gedit.desktop;\n"
+        "image/png=eog.desktop;\n"
+        "text/html=gedit.desktop;\n"
+        "\n"
+        "[Custom Group]\n"
+        "text/plain=untouched\n"
+        "\n"
+        "[Default Applications]\n"
+        "text/plain=vim.desktop;\n"
+        "\n"
+        "[Removed Associations]\n"
+        "text/plain=kate.desktop;\n");
+
+    // Index is updated in place and agrees with reloaded one.
+    AssociationIndex reloaded;
+    reloaded.load();
+    const char* const types[] = {"text/plain", "text/html", "image/png"};
+    for (std::size_t i=0; i<sizeof(types)/sizeof(types[0]); ++i) {
+        std::vector<std::string> updatedIds, reloadedIds;
+        index.associatedApplications(types[i], std::back_inserter(updatedIds));
+        reloaded.associatedApplications(types[i], std::back_inserter(reloadedIds));
+        BOOST_CHECK_EQUAL_COLLECTIONS(updatedIds.begin(), updatedIds.end(), reloadedIds.begin(), reloadedIds.end());
+    }
+    std::vector<std::string> desktopIds;
+    index.associatedApplications("text/plain", std::back_inserter(desktopIds));
+    BOOST_REQUIRE_EQUAL(desktopIds.size(), 2);
+    BOOST_CHECK_EQUAL(desktopIds[0], "vim.desktop");
+    BOOST_CHECK_EQUAL(desktopIds[1], "gedit.desktop");
+
+    std::string desktopId;
+    BOOST_CHECK(findDefaultApplication(index, hierarchy, "text/plain", &desktopId).isValid());
+    BOOST_CHECK_EQUAL(desktopId, "vim.desktop");
+
+    // Removing the last added association deletes the key.
+    editor.removeAssociation("text/html", "gedit.desktop");
+    editor.commit(&index);
+    BOOST_CHECK(readFile(listPath).find("image/png=eog.desktop;\n\n[Custom Group]") != std::string::npos);
+    desktopIds.clear();
+    index.associatedApplications("text/html", std::back_inserter(desktopIds));
+    BOOST_CHECK(desktopIds.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(MimeAppsListEditor_new_file_test, XdgFixture)
+{
+    // Config home does not exist yet, but index still knows its place.
+    AssociationIndex index;
+    index.load();
+
+    MimeAppsListEditor editor(BaseDirs{});
+    editor.addAssociation("text/plain", "vim.desktop");
+    editor.commit(&index);
+
+    BOOST_CHECK_EQUAL(readFile(buildPath(root, "config/mimeapps.list")),
+        "[Added Associations]\n"
+        "text/plain=vim.desktop;\n");
+    std::vector<std::string> desktopIds;
+    index.associatedApplications("text/plain", std::back_inserter(desktopIds));
+    BOOST_REQUIRE_EQUAL(desktopIds.size(), 1);
+    BOOST_CHECK_EQUAL(desktopIds[0], "vim.desktop");
+
+    MimeAppsListEditor failing(buildPath(root, "config/mimeapps.list/impossible"));
+    failing.addAssociation("text/plain", "vim.desktop");
+    BOOST_CHECK_THROW(failing.commit(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(mimeinfocache_test)
+
+static std::string desktopFileWithMimeTypes(const char* mimeTypes)
+{
+    return std::string("[Desktop Entry]\nType=Application\nName=Test\nExec=test %f\nMimeType=") + mimeTypes + "\n";
+}
+
+BOOST_FIXTURE_TEST_CASE(generateMimeInfoCache_test, XdgFixture)
+{
+    const std::string applicationsDir = buildPath(root, "share/applications");
+    writeFile("share/applications/vim.desktop", desktopFileWithMimeTypes("text/plain;text/x-csrc;"));
+    writeFile("share/applications/gedit.desktop", desktopFileWithMimeTypes("text/plain;;text/plain"));
+    writeFile("share/applications/kde/kate.desktop", desktopFileWithMimeTypes("text/plain;text/html;"));
+    writeFile("share/applications/notes.txt", desktopFileWithMimeTypes("text/plain;"));
+    writeFile("share/applications/broken.desktop", "MimeType=text/plain;\n");
+    writeFile("share/applications/hidden.desktop", "[Desktop Entry]\nType=Application\nHidden=true\nMimeType=text/plain;\n");
+
+    DesktopFile desktopFile(buildPath(applicationsDir, "gedit.desktop"));
+    std::vector<std::string> mimeTypes;
+    desktopFile.mimeTypes(std::back_inserter(mimeTypes));
+    BOOST_REQUIRE_EQUAL(mimeTypes.size(), 2);
+    BOOST_CHECK_EQUAL(mimeTypes[0], "text/plain");
+    BOOST_CHECK_EQUAL(mimeTypes[1], "text/plain");
+
+    // Timestamps are coarse, make sure cache is newer than desktop files.
+    ::usleep(20000);
+    MimeInfoCacheStats stats = generateMimeInfoCache(applicationsDir, false, 3);
+    BOOST_CHECK_EQUAL(stats.desktopFiles, 5);
+    BOOST_CHECK_EQUAL(stats.parsed, 5);
+    BOOST_CHECK_EQUAL(stats.mimeTypes, 3);
+    BOOST_CHECK_EQUAL(stats.threads, 3);
+    const std::string expected =
+        "[MIME Cache]\n"
+        "text/html=kde-kate.desktop;\n"
+        "text/plain=gedit.desktop;kde-kate.desktop;vim.desktop;\n"
+        "text/x-csrc=vim.desktop;\n";
+    BOOST_CHECK_EQUAL(mimeappslist_test::readFile(buildPath(applicationsDir, "mimeinfo.cache")), expected);
+
+    // Output does not depend on number of threads.
+    generateMimeInfoCache(applicationsDir, false, 1);
+    BOOST_CHECK_EQUAL(mimeappslist_test::readFile(buildPath(applicationsDir, "mimeinfo.cache")), expected);
+
+    // Only changed files are parsed in incremental mode.
+    ::usleep(20000);
+    writeFile("share/applications/vim.desktop", desktopFileWithMimeTypes("text/x-csrc;"));
+    BOOST_CHECK(::unlink(buildPath(applicationsDir, "gedit.desktop").c_str()) == 0);
+    stats = generateMimeInfoCache(applicationsDir, true);
+    BOOST_CHECK_EQUAL(stats.desktopFiles, 4);
+    BOOST_CHECK_EQUAL(stats.parsed, 1);
+    BOOST_CHECK_EQUAL(mimeappslist_test::readFile(buildPath(applicationsDir, "mimeinfo.cache")),
+        "[MIME Cache]\n"
+        "text/html=kde-kate.desktop;\n"
+        "text/plain=kde-kate.desktop;\n"
+        "text/x-csrc=vim.desktop;\n");
+
+    // Renaming subdirectory changes desktop ids without touching files.
+    ::usleep(20000);
+    BOOST_REQUIRE(::rename(buildPath(applicationsDir, "kde").c_str(), buildPath(applicationsDir, "kde4").c_str()) == 0);
+    stats = generateMimeInfoCache(applicationsDir, true);
+    BOOST_CHECK_EQUAL(stats.parsed, 1);
+    BOOST_CHECK_EQUAL(mimeappslist_test::readFile(buildPath(applicationsDir, "mimeinfo.cache")),
+        "[MIME Cache]\n"
+        "text/html=kde4-kate.desktop;\n"
+        "text/plain=kde4-kate.desktop;\n"
+        "text/x-csrc=vim.desktop;\n");
+    BOOST_REQUIRE(::rename(buildPath(applicationsDir, "kde4").c_str(), buildPath(applicationsDir, "kde").c_str()) == 0);
+    generateMimeInfoCache(applicationsDir, true);
+
+    // Generated cache is used by lookups.
+    AssociationIndex index;
+    index.load();
+    std::vector<std::string> desktopIds;
+    index.associatedApplications("text/html", std::back_inserter(desktopIds));
+    BOOST_REQUIRE_EQUAL(desktopIds.size(), 1);
+    BOOST_CHECK_EQUAL(desktopIds[0], "kde-kate.desktop");
+
+    BOOST_CHECK_THROW(generateMimeInfoCache(buildPath(root, "nonexistent")), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(appsearch_test)
+
+static std::string application(const char* name, const char* extra = "")
+{
+    return std::string("[Desktop Entry]\nType=Application\nExec=/bin/sh\nName=") + name + "\n" + extra;
+}
+
+static std::vector<std::string> searchIds(const ApplicationSearchIndex& index, const std::string& query, std::size_t maxResults = 0)
+{
+    std::vector<ApplicationMatch> matches;
+    index.search(query, std::back_inserter(matches), maxResults);
+    std::vector<std::string> desktopIds;
+    for (std::size_t i=0; i<matches.size(); ++i) {
+        desktopIds.push_back(matches[i].desktopId);
+    }
+    return desktopIds;
+}
+
+BOOST_FIXTURE_TEST_CASE(ApplicationSearchIndex_test, XdgFixture)
+{
+    writeFile("data/applications/firefox.desktop", application("Firefox", "GenericName=Web Browser\nKeywords=Internet;WWW;\n"));
+    writeFile("data/applications/gnome/web.desktop", application("Web", "Comment=Browse the web\n"));
+    writeFile("data/applications/webcam.desktop", application("Cheese", "Comment=Take photos with webcam\n"));
+    writeFile("data/applications/hidden.desktop", application("Web hidden", "NoDisplay=true\n"));
+    writeFile("share/applications/firefox.desktop", application("Shadowed Firefox"));
+    writeFile("share/applications/xterm.desktop", application("XTerm"));
+
+    ApplicationSearchIndex index;
+    index.load();
+    BOOST_CHECK_EQUAL(index.size(), 4);
+
+    std::vector<ApplicationMatch> matches;
+    index.search("WEB", std::back_inserter(matches));
+    BOOST_REQUIRE_EQUAL(matches.size(), 3);
+    BOOST_CHECK_EQUAL(matches[0].desktopId, "gnome-web.desktop");
+    BOOST_CHECK_EQUAL(matches[0].rank, NamePrefixMatch);
+    BOOST_CHECK_EQUAL(matches[0].file.name(), "Web");
+    // Equal ranks are ordered by name.
+    BOOST_CHECK_EQUAL(matches[1].desktopId, "webcam.desktop");
+    BOOST_CHECK_EQUAL(matches[1].rank, WordPrefixMatch);
+    BOOST_CHECK_EQUAL(matches[2].desktopId, "firefox.desktop");
+    BOOST_CHECK_EQUAL(matches[2].rank, WordPrefixMatch);
+
+    BOOST_CHECK_EQUAL(searchIds(index, "WEB", 1).size(), 1);
+    BOOST_CHECK_EQUAL(searchIds(index, "fox").size(), 1);
+    BOOST_CHECK_EQUAL(searchIds(index, "www").size(), 1);
+    BOOST_CHECK_EQUAL(searchIds(index, "x").size(), 1);
+    BOOST_CHECK_EQUAL(searchIds(index, "w").size(), 3);
+    BOOST_CHECK(searchIds(index, "shadowed").empty());
+    BOOST_CHECK(searchIds(index, "browser web").empty());
+    BOOST_CHECK(searchIds(index, "").empty());
+
+    // Index picks up changes without reparsing unchanged files.
+    ::usleep(20000);
+    writeFile("data/applications/webcam.desktop", application("Cheese", "Comment=Take photos\n"));
+    BOOST_CHECK(::unlink(buildPath(root, "data/applications/gnome/web.desktop").c_str()) == 0);
+    writeFile("data/applications/terminal.desktop", application("Terminal"));
+    BOOST_CHECK_EQUAL(index.update(), 3);
+    BOOST_CHECK_EQUAL(index.update(), 0);
+    BOOST_CHECK_EQUAL(index.size(), 4);
+
+    const std::vector<std::string> web = searchIds(index, "web");
+    BOOST_REQUIRE_EQUAL(web.size(), 1);
+    BOOST_CHECK_EQUAL(web[0], "firefox.desktop");
+    const std::vector<std::string> term = searchIds(index, "term");
+    BOOST_REQUIRE_EQUAL(term.size(), 2);
+    BOOST_CHECK_EQUAL(term[0], "terminal.desktop");
+    BOOST_CHECK_EQUAL(term[1], "xterm.desktop");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(icontheme_test)
+
+static void appendCard16(std::string& data, unsigned int value)
+{
+    data += static_cast<char>((value >> 8) & 0xff);
+    data += static_cast<char>(value & 0xff);
+}
+
+static void appendCard32(std::string& data, unsigned int value)
+{
+    appendCard16(data, value >> 16);
+    appendCard16(data, value & 0xffff);
+}
+
+/// icon-theme.cache with single png icon "cached" in directory "32x32/apps". The icon lands in bucket 0 of 3.
+static std::string iconThemeCache()
+{
+    std::string data;
+    appendCard16(data, 1);
+    appendCard16(data, 0);
+    appendCard32(data, 12); // hash
+    appendCard32(data, 52); // directory list
+    appendCard32(data, 3);
+    appendCard32(data, 28);
+    appendCard32(data, 0xffffffff);
+    appendCard32(data, 0xffffffff);
+    appendCard32(data, 0xffffffff); // icon: chain, name, image list
+    appendCard32(data, 71);
+    appendCard32(data, 40);
+    appendCard32(data, 1);
+    appendCard16(data, 0);
+    appendCard16(data, 4);
+    appendCard32(data, 0);
+    appendCard32(data, 1);
+    appendCard32(data, 60);
+    data += std::string("32x32/apps\0cached\0", 18);
+    return data;
+}
+
+BOOST_FIXTURE_TEST_CASE(IconLookup_test, XdgFixture)
+{
+    writeFile("data/icons/Custom/index.theme",
+              "[Icon Theme]\nName=Custom\nInherits=Parent\nDirectories=16x16/apps,48x48/apps,scalable/apps\n"
+              "[16x16/apps]\nSize=16\nType=Fixed\n"
+              "[48x48/apps]\nSize=48\nType=Fixed\n"
+              "[scalable/apps]\nSize=48\nMinSize=8\nMaxSize=512\nType=Scalable\n");
+    const std::string small = writeFile("data/icons/Custom/16x16/apps/editor.png", "");
+    const std::string large = writeFile("data/icons/Custom/48x48/apps/editor.png", "");
+    const std::string vector = writeFile("share/icons/Custom/scalable/apps/player.svg", "");
+    writeFile("data/icons/Parent/index.theme", "[Icon Theme]\nInherits=Custom\nDirectories=22x22/apps\n[22x22/apps]\nSize=22\n");
+    const std::string parent = writeFile("data/icons/Parent/22x22/apps/terminal.png", "");
+    writeFile("share/icons/hicolor/index.theme", "[Icon Theme]\nDirectories=32x32/apps\n[32x32/apps]\nSize=32\nType=Fixed\n");
+    writeFile("share/icons/hicolor/32x32/apps/uncached.png", "");
+    writeFile("share/icons/hicolor/icon-theme.cache", iconThemeCache());
+    const std::string pixmap = writeFile("pixmaps/legacy.xpm", "");
+
+    std::vector<std::string> basePaths;
+    basePaths.push_back(buildPath(root, "data/icons"));
+    basePaths.push_back(buildPath(root, "share/icons"));
+    basePaths.push_back(buildPath(root, "pixmaps"));
+    IconLookup lookup(basePaths, "Custom");
+    BOOST_CHECK_EQUAL(lookup.themeName(), "Custom");
+
+    BOOST_CHECK_EQUAL(lookup.findIcon("editor", 16), small);
+    BOOST_CHECK_EQUAL(lookup.findIcon("editor", 48), large);
+    BOOST_CHECK_EQUAL(lookup.findIcon("editor", 40), large);
+    BOOST_CHECK_EQUAL(lookup.findIcon("editor.png", 20), small);
+    // Scalable icon matches, so it's preferred over the closest fixed one.
+    BOOST_CHECK_EQUAL(lookup.findIcon("player", 128), vector);
+    // Inherits chain with a loop back to the theme.
+    BOOST_CHECK_EQUAL(lookup.findIcon("terminal", 64), parent);
+    // hicolor is served from cache without scanning, so icon missing in cache is not found there.
+    BOOST_CHECK_EQUAL(lookup.findIcon("cached", 32), buildPath(root, "share/icons/hicolor/32x32/apps/cached.png"));
+    BOOST_CHECK(lookup.findIcon("uncached", 32).empty());
+    BOOST_CHECK_EQUAL(lookup.findIcon("legacy", 32), pixmap);
+    BOOST_CHECK_EQUAL(lookup.findIcon(small, 32), small);
+    BOOST_CHECK(lookup.findIcon("nonexistent", 32).empty());
+
+    BOOST_CHECK_EQUAL(lookup.misses(), 10);
+    BOOST_CHECK_EQUAL(lookup.findIcon("editor", 16), small);
+    BOOST_CHECK(lookup.findIcon("nonexistent", 32).empty());
+    BOOST_CHECK_EQUAL(lookup.hits(), 2);
+
+    // Outdated cache is ignored and directory is scanned instead.
+    ::usleep(20000);
+    writeFile("share/icons/hicolor/new.txt", "");
+    lookup.clear();
+    BOOST_CHECK_EQUAL(lookup.findIcon("uncached", 32), buildPath(root, "share/icons/hicolor/32x32/apps/uncached.png"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(lookupdaemon_test)
+
+BOOST_AUTO_TEST_CASE(protocol_test)
+{
+    details::LookupRequestType type;
+    std::string mimeType;
+    BOOST_CHECK(details::decodeLookupRequest(details::encodeLookupRequest(details::ListDefaultApplicationsRequest, "text/plain"), type, mimeType));
+    BOOST_CHECK_EQUAL(type, details::ListDefaultApplicationsRequest);
+    BOOST_CHECK_EQUAL(mimeType, "text/plain");
+    BOOST_CHECK(!details::decodeLookupRequest(std::string("\x01\x09\x00\x00", 4), type, mimeType));
+    BOOST_CHECK(!details::decodeLookupRequest(std::string("\x01\x01\x00\x05text", 8), type, mimeType));
+
+    std::vector<details::LookupItem> items;
+    items.push_back(details::LookupItem("editor.desktop", "/usr/share/applications/editor.desktop"));
+    items.push_back(details::LookupItem("", "/opt/viewer.desktop"));
+    std::vector<details::LookupItem> decoded;
+    BOOST_CHECK(details::decodeLookupResponse(details::encodeLookupResponse(true, items), decoded));
+    BOOST_CHECK(decoded == items);
+    BOOST_CHECK(!details::decodeLookupResponse(details::encodeLookupResponse(false, items), decoded));
+    BOOST_CHECK(decoded.empty());
+    BOOST_CHECK(!details::decodeLookupResponse(std::string("\x00\xff\xff\xff\xff", 5), decoded));
+}
+
+static void runServer(LookupServer* server)
+{
+    server->run();
+}
+
+BOOST_FIXTURE_TEST_CASE(LookupServer_test, XdgFixture)
+{
+    writeFile("share/mime/subclasses", "application/x-shellscript text/plain\n");
+    writeFile("data/applications/editor.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/viewer.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=viewer.desktop;editor.desktop;\n");
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=editor.desktop\n");
+
+    const std::string socketPath = buildPath(root, "mimeapps.socket");
+    // Stale socket file must not prevent daemon from starting.
+    writeFile("mimeapps.socket", "");
+    std::unique_ptr<LookupServer> server(new LookupServer(socketPath));
+    BOOST_CHECK_THROW(LookupServer second(socketPath), std::runtime_error);
+    std::thread thread(runServer, server.get());
+
+    LookupClient client(socketPath);
+    BOOST_CHECK_EQUAL(client.findDefaultApplication("application/x-shellscript").fileName(), buildPath(root, "data/applications/editor.desktop"));
+    BOOST_CHECK(client.usedDaemon());
+
+    std::vector<std::string> ids, expectedIds;
+    client.listAssociatedApplications("text/plain", std::back_inserter(ids));
+    BOOST_CHECK(client.usedDaemon());
+    listAssociatedApplications("text/plain", std::back_inserter(expectedIds));
+    BOOST_CHECK(ids == expectedIds);
+
+    ids.clear();
+    client.listDefaultApplications("text/plain", std::back_inserter(ids));
+    BOOST_REQUIRE_EQUAL(ids.size(), 1);
+    BOOST_CHECK_EQUAL(ids[0], "editor.desktop");
+
+    std::vector<DesktopFile> files;
+    client.findAssociatedApplications("application/x-shellscript", std::back_inserter(files));
+    BOOST_CHECK(client.usedDaemon());
+    BOOST_REQUIRE_EQUAL(files.size(), 2);
+    BOOST_CHECK_EQUAL(files[0].fileName(), buildPath(root, "data/applications/viewer.desktop"));
+    BOOST_CHECK_EQUAL(files[1].fileName(), buildPath(root, "data/applications/editor.desktop"));
+
+    BOOST_CHECK(!client.findDefaultApplication("image/png").isValid());
+    BOOST_CHECK(client.usedDaemon());
+
+    // Daemon notices changed configuration.
+    ::sleep(1);
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=viewer.desktop\n");
+    BOOST_CHECK_EQUAL(client.findDefaultApplication("text/plain").fileName(), buildPath(root, "data/applications/viewer.desktop"));
+    BOOST_CHECK(client.usedDaemon());
+
+    // Client sending incomplete request does not hold up others and is disconnected.
+    const int slow = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    BOOST_REQUIRE(::connect(slow, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+    BOOST_REQUIRE_EQUAL(::send(slow, "\0\0", 2, 0), 2);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL(client.findDefaultApplication("text/plain").fileName(), buildPath(root, "data/applications/viewer.desktop"));
+    BOOST_CHECK(client.usedDaemon());
+    BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+    char byte;
+    BOOST_CHECK_EQUAL(::recv(slow, &byte, 1, 0), 0);
+    ::close(slow);
+
+    server->stop();
+    thread.join();
+    BOOST_CHECK_EQUAL(server->requestCount(), 7);
+    server.reset();
+    BOOST_CHECK(::access(socketPath.c_str(), F_OK) != 0);
+
+    // Without daemon lookups are done in-process.
+    BOOST_CHECK_EQUAL(client.findDefaultApplication("text/plain").fileName(), buildPath(root, "data/applications/viewer.desktop"));
+    BOOST_CHECK(!client.usedDaemon());
+    ids.clear();
+    client.listDefaultApplications("text/plain", std::back_inserter(ids));
+    BOOST_CHECK(!client.usedDaemon());
+    BOOST_REQUIRE_EQUAL(ids.size(), 1);
+    BOOST_CHECK_EQUAL(ids[0], "viewer.desktop");
+}
+
+// Listen on socketPath as another user and answer every request with forged application.
+static void serveForged(const std::string& socketPath, int readyFd)
+{
+    if (::setuid(65534) != 0) {
+        ::_exit(1);
+    }
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd == -1 || ::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 4) != 0) {
+        ::_exit(1);
+    }
+    const std::string payload = details::encodeLookupResponse(true, std::vector<details::LookupItem>(1, details::LookupItem("evil.desktop", "/forged.desktop")));
+    std::string frame;
+    frame += static_cast<char>(0);
+    frame += static_cast<char>(0);
+    frame += static_cast<char>((payload.size() >> 8) & 0xff);
+    frame += static_cast<char>(payload.size() & 0xff);
+    frame += payload;
+    ssize_t result = ::write(readyFd, "", 1);
+    (void)result;
+    while(true) {
+        const int client = ::accept(fd, NULL, NULL);
+        char buffer[256];
+        if (client != -1 && ::recv(client, buffer, sizeof(buffer), 0) > 0) {
+            result = ::send(client, frame.data(), frame.size(), MSG_NOSIGNAL);
+        }
+        ::close(client);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(LookupClient_foreign_daemon_test, XdgFixture)
+{
+    if (::geteuid() != 0) {
+        BOOST_TEST_MESSAGE("Skipped: switching to another user requires root");
+        return;
+    }
+    BOOST_REQUIRE(::chmod(root.c_str(), 0777) == 0);
+    const std::string socketPath = buildPath(root, "mimeapps.socket");
+    int ready[2];
+    BOOST_REQUIRE(::pipe(ready) == 0);
+    const pid_t child = ::fork();
+    BOOST_REQUIRE(child != -1);
+    if (child == 0) {
+        serveForged(socketPath, ready[1]);
+    }
+    char byte;
+    BOOST_REQUIRE_EQUAL(::read(ready[0], &byte, 1), 1);
+    ::close(ready[0]);
+    ::close(ready[1]);
+
+    // Daemon of another user is not trusted, lookup is done in-process.
+    LookupClient client(socketPath);
+    BOOST_CHECK(!client.findDefaultApplication("text/plain").isValid());
+    BOOST_CHECK(!client.usedDaemon());
+    BOOST_CHECK_THROW(LookupServer server(socketPath), std::runtime_error);
+
+    ::kill(child, SIGKILL);
+    ::waitpid(child, NULL, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(associationsnapshot_test)
+
+BOOST_FIXTURE_TEST_CASE(AssociationSnapshot_test, XdgFixture)
+{
+    writeFile("share/mime/subclasses", "application/x-shellscript text/plain\n");
+    writeFile("data/applications/editor.desktop", "[Desktop Entry]\nType=Application\nName=Editor\nIcon=accessories-text-editor\nExec=/bin/sh %f\nTerminal=true\n");
+    writeFile("data/applications/kde4/viewer.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("data/applications/mimeinfo.cache", "[MIME Cache]\ntext/plain=kde4-viewer.desktop;editor.desktop;\n");
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=editor.desktop\n");
+
+    const std::string path = buildPath(root, "mimeapps.snapshot");
+    AssociationSnapshot snapshot(path);
+    BOOST_CHECK(!snapshot.isValid());
+    BOOST_CHECK(!snapshot.contains("text/plain"));
+
+    AssociationSnapshotPublisher publisher(path);
+    BOOST_CHECK_EQUAL(publisher.publish(), 1);
+    BOOST_CHECK(snapshot.refresh());
+    BOOST_CHECK_EQUAL(snapshot.generation(), 1);
+    BOOST_CHECK(!snapshot.isStale());
+
+    // Reference lookup reads files, so it's done before counting.
+    std::vector<std::string> ids, expectedIds;
+    listAssociatedApplications("text/plain", std::back_inserter(expectedIds));
+
+    resetStats();
+    SnapshotApplication application;
+    BOOST_REQUIRE(snapshot.findDefaultApplication("application/x-shellscript", application));
+    BOOST_CHECK_EQUAL(application.desktopId, "editor.desktop");
+    BOOST_CHECK_EQUAL(application.fileName, buildPath(root, "data/applications/editor.desktop"));
+    BOOST_CHECK_EQUAL(application.name, "Editor");
+    BOOST_CHECK_EQUAL(application.icon, "accessories-text-editor");
+    BOOST_CHECK_EQUAL(application.exec, "/bin/sh %f");
+    BOOST_CHECK(application.terminal);
+
+    std::vector<SnapshotApplication> applications;
+    BOOST_CHECK(snapshot.findAssociatedApplications("application/x-shellscript", std::back_inserter(applications)));
+    BOOST_REQUIRE_EQUAL(applications.size(), 2);
+    BOOST_CHECK_EQUAL(applications[0].desktopId, "kde4-viewer.desktop");
+    BOOST_CHECK_EQUAL(applications[1].desktopId, "editor.desktop");
+
+    BOOST_CHECK(snapshot.listAssociatedApplications("text/plain", std::back_inserter(ids)));
+    BOOST_CHECK(ids == expectedIds);
+    ids.clear();
+    BOOST_CHECK(snapshot.listDefaultApplications("text/plain", std::back_inserter(ids)));
+    BOOST_REQUIRE_EQUAL(ids.size(), 1);
+    BOOST_CHECK_EQUAL(ids[0], "editor.desktop");
+    ids.clear();
+    BOOST_CHECK(snapshot.listDefaultApplications("application/x-shellscript", std::back_inserter(ids)));
+    BOOST_CHECK(ids.empty());
+
+    BOOST_CHECK(snapshot.findApplication("kde4-viewer.desktop", application));
+    BOOST_CHECK_EQUAL(application.fileName, buildPath(root, "data/applications/kde4/viewer.desktop"));
+    BOOST_CHECK(!snapshot.findApplication("missing.desktop", application));
+    BOOST_CHECK(!snapshot.contains("image/png"));
+    BOOST_CHECK(!snapshot.findDefaultApplication("image/png", application));
+    // Lookups are served from the mapping.
+    BOOST_CHECK_EQUAL(getStats().statCalls, 0);
+    BOOST_CHECK_EQUAL(getStats().filesOpened, 0);
+
+    // New generation makes mapped snapshot stale. Old mapping stays readable until refresh.
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=kde4-viewer.desktop\n");
+    BOOST_CHECK_EQUAL(publisher.publish(), 2);
+    BOOST_CHECK(snapshot.isStale());
+    BOOST_CHECK(snapshot.findDefaultApplication("text/plain", application));
+    BOOST_CHECK_EQUAL(application.desktopId, "editor.desktop");
+    BOOST_CHECK(snapshot.refresh());
+    BOOST_CHECK_EQUAL(snapshot.generation(), 2);
+    BOOST_CHECK(!snapshot.refresh());
+    BOOST_CHECK(snapshot.findDefaultApplication("text/plain", application));
+    BOOST_CHECK_EQUAL(application.desktopId, "kde4-viewer.desktop");
+
+    // Restarted publisher continues generations and supersedes the current one.
+    AssociationSnapshotPublisher restarted(path);
+    BOOST_CHECK_EQUAL(restarted.generation(), 2);
+    BOOST_CHECK_EQUAL(restarted.publish(), 3);
+    BOOST_CHECK(snapshot.isStale());
+    BOOST_CHECK(snapshot.refresh());
+    BOOST_CHECK_EQUAL(snapshot.generation(), 3);
+
+    // Truncated file is rejected.
+    const std::string contents = mimeappslist_test::readFile(path);
+    writeFile("truncated.snapshot", contents.substr(0, contents.size() - 3));
+    BOOST_CHECK(!AssociationSnapshot(buildPath(root, "truncated.snapshot")).isValid());
+}
+
+BOOST_FIXTURE_TEST_CASE(AssociationSnapshot_ownership_test, XdgFixture)
+{
+    writeFile("data/applications/editor.desktop", mimeapps_test::shellDesktopFile);
+    writeFile("config/mimeapps.list", "[Default Applications]\ntext/plain=editor.desktop\n");
+    const std::string path = buildPath(root, "mimeapps.snapshot");
+    {
+        AssociationSnapshotPublisher publisher(path);
+        BOOST_CHECK_EQUAL(publisher.publish(), 1);
+    }
+    BOOST_CHECK(AssociationSnapshot(path).isValid());
+
+    // Snapshot writable by others may be forged.
+    BOOST_REQUIRE(::chmod(path.c_str(), 0666) == 0);
+    BOOST_CHECK(!AssociationSnapshot(path).isValid());
+    BOOST_CHECK_EQUAL(AssociationSnapshotPublisher(path).generation(), 0);
+
+    if (::geteuid() == 0) {
+        // Snapshot of another user is not trusted either.
+        BOOST_REQUIRE(::chmod(path.c_str(), 0644) == 0);
+        BOOST_REQUIRE(::chown(path.c_str(), 65534, 65534) == 0);
+        BOOST_CHECK(!AssociationSnapshot(path).isValid());
+        BOOST_CHECK_EQUAL(AssociationSnapshotPublisher(path).generation(), 0);
+    }
+
+    // FIFO at snapshot path does not block reader.
+    BOOST_REQUIRE(::unlink(path.c_str()) == 0);
+    BOOST_REQUIRE(::mkfifo(path.c_str(), 0600) == 0);
+    BOOST_CHECK(!AssociationSnapshot(path).isValid());
+}
+
 BOOST_AUTO_TEST_SUITE_END()